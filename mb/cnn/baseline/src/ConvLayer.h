@@ -15,6 +15,7 @@
 #ifndef TYPES_H
 #include "types.h"
 #endif
+#include "fastconv.h"
       
 /**
  *  Data structure definining a convolutional layer for a ConvNet. Input is
@@ -37,6 +38,7 @@ typedef struct {
     data_t *b;         ///< pointer to the biases.
     data_t *x;         ///< pointer to the input feature maps.
     data_t *y;         ///< pointer to the output feature maps.
+    int batch;         ///< number of images per exec, one after the other in x, y and the local buffers.
     data_t *loc_w0;        ///< pointer to the weights.
     data_t *loc_w1;        ///< pointer to the weights.
     data_t *loc_b;         ///< pointer to the biases.
@@ -73,6 +75,9 @@ typedef struct {
     unsigned char tlast_h;
     unsigned char tlast_w;
     unsigned qf;
+    int conv_algo;        ///< convolution backend (CONV_DIRECT, CONV_GEMM, ...), see FastConv_choose.
+    FastConv **conv_prep; ///< weights prepared for the backend per (nof,nif) tile, on first use.
+    struct quant_weights_tag *w_quant; ///< 8-bit or 4-bit weights replacing *w, NULL for none; not owned, needs the fetch stage (not HWCE).
 } ConvLayer;
 
 ConvLayer *ConvLayer_new(
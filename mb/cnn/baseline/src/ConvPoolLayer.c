@@ -11,6 +11,8 @@
 
 #include "linalg.h"
 #include "tiling.h"
+#include "pipeline.h"
+#include "quant.h"
 #include "ConvPoolLayer.h"
 #ifdef CCN_HWCE_ACCEL
   #include "hwce.h"
@@ -140,7 +142,9 @@ ConvPoolLayer *ConvPoolLayer_new(
     layer->b             = b;
     layer->x             = x;
     layer->y             = y;
+    layer->batch         = 1;
     layer->qf            = qf;
+    layer->w_quant       = NULL;
     layer->pool_size     = pool_size;
 
 #ifndef CCN_CACHE
@@ -170,8 +174,8 @@ ConvPoolLayer *ConvPoolLayer_new(
     // then every other tile only for tiling_max_height-_fs+1
     int ntile_h;
     int ntile_w;
-    int tlast_h;
-    int tlast_w;
+    int tlast_h = height; // a single tile is the last one
+    int tlast_w = width;
     if(height <= tiling_max_height) {
         ntile_h = 1;
     }
@@ -245,14 +249,14 @@ ConvPoolLayer *ConvPoolLayer_new(
                     }
 
                     if(bb*tiling_max_nif > n_in_feat-tiling_max_nif) {
-                        tile_grid_nif[aa][bb][ii][jj] = (unsigned char) n_in_feat % tiling_max_nif;
+                        tile_grid_nif[aa][bb][ii][jj] = (unsigned char) (n_in_feat % tiling_max_nif);
                     }
                     else {
                         tile_grid_nif[aa][bb][ii][jj] = (unsigned char) tiling_max_nif;
                     }
 
                     if(aa*tiling_max_nof > n_out_feat-tiling_max_nof) {
-                        tile_grid_nof[aa][bb][ii][jj] = (unsigned char) n_out_feat % tiling_max_nof;
+                        tile_grid_nof[aa][bb][ii][jj] = (unsigned char) (n_out_feat % tiling_max_nof);
                     }
                     else {
                         tile_grid_nof[aa][bb][ii][jj] = (unsigned char) tiling_max_nof;
@@ -363,6 +367,16 @@ ConvPoolLayer *ConvPoolLayer_new(
     }
 #endif /* TILING_DEBUG */
 
+    // convolution backend, for the largest tile
+    layer->conv_algo = FastConv_choose(filter_size, tiling_max_nof, tiling_max_nif, tiling_max_height-filter_size+1, tiling_max_width-filter_size+1);
+    // and the split of the tiles among the threads
+    if(parallel_type == PARALLEL_AUTO)
+        layer->parallel_type = linalg_parallel_choose(tiling_max_nof, tiling_max_height-filter_size+1);
+    layer->conv_prep = ccn_malloc(sizeof(FastConv *)*layer->ntile_nof*layer->ntile_nif);
+    for(int i=0; i<layer->ntile_nof*layer->ntile_nif; i++) {
+        layer->conv_prep[i] = NULL;
+    }
+
 #ifdef CCN_PULP_HWCE
 #if PULP_CHIP==CHIP_FULMINE
     hwce_enable();
@@ -391,6 +405,10 @@ void ConvPoolLayer_delete(
     ccn_free(layer->tile_grid_h);
     ccn_free(layer->tile_grid_w);
 #endif /* ~CCN_TILING */
+    for(int i=0; i<layer->ntile_nof*layer->ntile_nif; i++) {
+        FastConv_delete(layer->conv_prep[i]);
+    }
+    ccn_free(layer->conv_prep);
     ccn_free(layer);
 }
 
@@ -451,46 +469,51 @@ static void ConvPoolLayer_pipe_fe(
         );
 #endif /* ~CHIP_MIA && ~CHIP_PULP3 && ~CHIP_FULMINE && ~CHIP_HONEY */
 
+        // for every image of the batch
+        for(int n=0; n<layer->batch; n++) {
+            data_t *loc_x = layer->loc_x_fe + n*_nif*_h*_w;
+            data_t *l2_xn = l2_x + n*layer->n_in_feat*layer->height*layer->width;
 #ifdef CCN_TILING_3D
-        /* with no additional assumptions, the tiling grid is three-dimensional */
-        // X tile copy-in
-        ccn_memcpy_async_3d(
-            layer->loc_x_fe, // pointers
-            l2_x,
-            _nif, // sizes
-            _h,
-            _w*sizeof(data_t),
-            _h, // local strides
-            _w*sizeof(data_t),
-            layer->height, // remote strides
-            layer->width*sizeof(data_t)
-        );
+            /* with no additional assumptions, the tiling grid is three-dimensional */
+            // X tile copy-in
+            ccn_memcpy_async_3d(
+                loc_x, // pointers
+                l2_xn,
+                _nif, // sizes
+                _h,
+                _w*sizeof(data_t),
+                _h, // local strides
+                _w*sizeof(data_t),
+                layer->height, // remote strides
+                layer->width*sizeof(data_t)
+            );
 #endif /* CCN_TILING_3D */
 #ifdef CCN_TILING_2D
-        /* Assuming that tiles are internally contiguous in the j feature map dimension,
-           the tiling grid is two-dimensional.
-           Moreover, _w=layer->width */
-        // X tile copy-in
-        ccn_memcpy_async_2d(
-            layer->loc_x_fe, // pointers
-            l2_x,
-            _nif, // sizes
-            _h*_w*sizeof(data_t),
-            _h*_w*sizeof(data_t), // local strides
-            layer->height*layer->width*sizeof(data_t) // remote strides
-        );
+            /* Assuming that tiles are internally contiguous in the j feature map dimension,
+               the tiling grid is two-dimensional.
+               Moreover, _w=layer->width */
+            // X tile copy-in
+            ccn_memcpy_async_2d(
+                loc_x, // pointers
+                l2_xn,
+                _nif, // sizes
+                _h*_w*sizeof(data_t),
+                _h*_w*sizeof(data_t), // local strides
+                layer->height*layer->width*sizeof(data_t) // remote strides
+            );
 #endif /* CCN_TILING_2D */
 #ifdef CCN_TILING_1D
-        /* Assuming that tiles are internally contiguous in the i,j feature map dimensions,
-           the tiling grid is one-dimensional.
-           Moreover, _h=layer->height,_w=layer->width */
-        // X tile copy-in
-        ccn_memcpy_async(
-            layer->loc_x_fe, // pointers
-            l2_x,
-            _nif*_h*_w*sizeof(data_t)
-        );
+            /* Assuming that tiles are internally contiguous in the i,j feature map dimensions,
+               the tiling grid is one-dimensional.
+               Moreover, _h=layer->height,_w=layer->width */
+            // X tile copy-in
+            ccn_memcpy_async(
+                loc_x, // pointers
+                l2_xn,
+                _nif*_h*_w*sizeof(data_t)
+            );
 #endif /* CCN_TILING_1D */
+        }
 
         // W copy-in
 #if PULP_CHIP == CHIP_MIA || PULP_CHIP == CHIP_PULP3 || PULP_CHIP == CHIP_FULMINE || PULP_CHIP == CHIP_HONEY
@@ -504,7 +527,20 @@ static void ConvPoolLayer_pipe_fe(
             }
         }
 #else /* ~CHIP_MIA && ~CHIP_PULP3 */
-        if(layer->parallel_type != PARALLEL_HWCE) {
+        if(layer->w_quant != NULL) {
+            // W unpacking; the codes of an output feature map are contiguous over its input maps
+            for(int a=0; a<_nof; a++) {
+                int oa = aa*layer->tiling_max_nof+a;
+                quant_unpack(
+                    layer->w_quant,
+                    ((size_t) oa*layer->n_in_feat + bb*layer->tiling_max_nif)*_fs*_fs,
+                    _nif*_fs*_fs,
+                    oa,
+                    layer->loc_w_fe + a*_nif*_fs*_fs
+                );
+            }
+        }
+        else if(layer->parallel_type != PARALLEL_HWCE) {
             for(int a=0; a<_nof; a++) {
                 for(int b=0; b<_nif; b++) {
                     ccn_memcpy_async(
@@ -648,9 +684,64 @@ static void ConvPoolLayer_pipe_ex(
 
 #endif /* CCN_CACHE */
 
+    // the images of the batch, one tile (or, with CCN_CACHE, one image) after
+    // the other; the weights stay the same
+#ifndef CCN_CACHE
+    int _xs = _nif*_h*_w;
+    int _ys = _nof*_oh*_ow;
+#else /* CCN_CACHE */
+    int _xs = layer->n_in_feat*layer->height*layer->width;
+    int _ys = layer->n_out_feat*(layer->height-_fs+1)*(layer->width-_fs+1);
+#endif /* CCN_CACHE */
+    data_t *_x0 = _x;
+    data_t *_y0 = _y;
+    data_t *_W0 = _W;
+#ifdef USE_TMP_BUFFER
+    data_t *_y20 = _y2;
+#endif /* USE_TMP_BUFFER */
+    for(int n=0; n<layer->batch; n++) {
+    _x = _x0 + n*_xs;
+#ifdef USE_TMP_BUFFER
+    // the temporary buffer holds one tile, pooled right away
+    _y2 = _y20 + n*_ys;
+    _y = (bb == layer->ntile_nif-1) ? _y0 : _y2;
+#else /* ~USE_TMP_BUFFER */
+    _y = _y0 + n*_ys;
+#endif /* ~USE_TMP_BUFFER */
+    _W = _W0;
+
+#ifdef LINALG_2DCONV_NOF
+    // y_a[i,j] = b_a for every output feature a, pixel (i,j)
+    if(bb == 0) {
+        for(int a=0; a<_nof; a++) {
+            data_t _b = layer->b[aa*layer->tiling_max_nof+a];
+            for(int i=0; i<_oh*_ow; i++) {
+                _y[a*_oh*_ow+i] = _b;
+            }
+        }
+    }
+
+    // convolution "core", all output features at once
+#ifndef NOCOMPUTATION
+    FastConv *prep = NULL;
+    if(layer->conv_algo != CONV_DIRECT && _nof > 0) {
+        // the weights of a tile never change, prepare them once
+        FastConv **p = &layer->conv_prep[aa*layer->ntile_nif+bb];
+        if(*p == NULL)
+            *p = FastConv_new(layer->conv_algo, _W, _fs, _nof, _nif);
+        prep = *p;
+    }
+    if(prep != NULL)
+        FastConv_exec(prep, _x, _y, _h, _w, layer->parallel_type, layer->qf);
+    else
+        linalg_2dconv_nof(_W, _x, _y, _h, _w, _fs, _nof, _nif, layer->parallel_type, layer->qf);
+#endif /* NOCOMPUTATION */
+#endif /* LINALG_2DCONV_NOF */
+
     // loop over output features
     for(int a=0; a<_nof; a++) {
 
+#ifndef LINALG_2DCONV_NOF
         // #pragma omp barrier
         // y_a[i,j] = b_a for every output feature a, pixel (i,j)
         if(bb == 0) {
@@ -676,6 +767,7 @@ static void ConvPoolLayer_pipe_ex(
         linalg_2dconv(_W, _x, _y, layer->height, layer->width, _fs, a, layer->n_in_feat, layer->parallel_type, layer->qf);
 #endif /* CCN_CACHE */
 #endif /* NOCOMPUTATION */
+#endif /* ~LINALG_2DCONV_NOF */
 
 #ifdef DETAILED_DEBUG
         #pragma omp master
@@ -710,24 +802,13 @@ static void ConvPoolLayer_pipe_ex(
             //         firstprivate(_y2,_ps)
             // {
 
-                if(layer->activation == ACTIVATION_TANH) {
-                    // #pragma omp for \
-                    //         collapse(2)
-                    for (int i=0; i<_oh; i++) {
-                        for (int j=0; j<_ow; j++) {
-                            _y[a*_oh*_ow+i*_ow+j] = ccn_tanh(_y[a*_oh*_ow+i*_ow+j]);
-                        }
-                    }
-                }
-                else if(layer->activation == ACTIVATION_RELU) {
-                    // #pragma omp for \
-                    //         collapse(2)
-                    for (int i=0; i<_oh; i++) {
-                        for (int j=0; j<_ow; j++) {
-                            _y[a*_oh*_ow+i*_ow+j] = ccn_relu(_y[a*_oh*_ow+i*_ow+j]);
-                        }
-                    }
+#ifndef CCN_WB_ACTIVATION
+                // else in ConvPoolLayer_pipe_wb, after the pooling: tanh and
+                // relu never decrease, so they commute with the max
+                if(layer->activation != ACTIVATION_NONE) {
+                    linalg_activation(_y + a*_oh*_ow, _y + a*_oh*_ow, _oh*_ow, layer->activation, layer->qf);
                 }
+#endif /* ~CCN_WB_ACTIVATION */
 
                 // #pragma omp for \
                 //             collapse(2)
@@ -803,6 +884,8 @@ static void ConvPoolLayer_pipe_ex(
 
     } /* for(int a=a_start; a<_nof; a++) */
 
+    } /* for(int n=0; n<layer->batch; n++) */
+
 #ifdef TILE_CHECKSUM
     // #pragma omp barrier
     // #pragma omp master
@@ -932,6 +1015,7 @@ static void ConvPoolLayer_pipe_wb(
                 _ph, _pw,
                 0, 0, 0
             );
+            int _l2_ys = layer->n_out_feat*_ph*_pw;
 
 #ifdef WRITEBACK_CHECKSUM
             int32_t sum = 0;
@@ -968,42 +1052,81 @@ static void ConvPoolLayer_pipe_wb(
 #ifdef CCN_TILING_3D
             /* with no additional assumptions, the tiling grid is three-dimensional */
             // Y tile copy-out
-            ccn_memcpy_async_3d(
-                l2_y, // pointers
-                layer->loc_y_wb,
-                _nof, // sizes
-                _oph,
-                _opw*sizeof(data_t),
-                _ph, // remote strides
-                _pw*sizeof(data_t),
-                _oph, // local strides
-                _opw*sizeof(data_t)
-            );
+            for(int n=0; n<layer->batch; n++) {
+#ifdef CCN_WB_ACTIVATION
+                // activation on the way out, map by map
+                if(layer->activation != ACTIVATION_NONE) {
+                    for(int a=0; a<_nof; a++) {
+                        linalg_activation_2d(
+                            l2_y + n*_l2_ys + a*_ph*_pw,
+                            layer->loc_y_wb + n*_nof*_oh*_ow + a*_oph*_opw,
+                            _oph, _opw,
+                            _pw, _opw,
+                            layer->activation, layer->qf
+                        );
+                    }
+                    continue;
+                }
+#endif /* CCN_WB_ACTIVATION */
+                ccn_memcpy_async_3d(
+                    l2_y + n*_l2_ys, // pointers
+                    layer->loc_y_wb + n*_nof*_oh*_ow,
+                    _nof, // sizes
+                    _oph,
+                    _opw*sizeof(data_t),
+                    _ph, // remote strides
+                    _pw*sizeof(data_t),
+                    _oph, // local strides
+                    _opw*sizeof(data_t)
+                );
+            }
 #endif /* CCN_TILING_3D */
 #ifdef CCN_TILING_2D
             /* Assuming that tiles are internally contiguous in the j feature map dimension,
                the tiling grid is two-dimensional.
                Moreover, _w=layer->width */
             // Y tile copy-in
-            ccn_memcpy_async_2d(
-                l2_y, // pointers
-                layer->loc_y_wb,
-                _nof, // sizes
-                _oph*_opw*sizeof(data_t),
-                _ph*_pw*sizeof(data_t), // local strides
-                _oph*_opw*sizeof(data_t) // remote strides
-            );
+            for(int n=0; n<layer->batch; n++) {
+#ifdef CCN_WB_ACTIVATION
+                if(layer->activation != ACTIVATION_NONE) {
+                    linalg_activation_2d(
+                        l2_y + n*_l2_ys,
+                        layer->loc_y_wb + n*_nof*_oh*_ow,
+                        _nof, _oph*_opw,
+                        _ph*_pw, _oph*_opw,
+                        layer->activation, layer->qf
+                    );
+                    continue;
+                }
+#endif /* CCN_WB_ACTIVATION */
+                ccn_memcpy_async_2d(
+                    l2_y + n*_l2_ys, // pointers
+                    layer->loc_y_wb + n*_nof*_oh*_ow,
+                    _nof, // sizes
+                    _oph*_opw*sizeof(data_t),
+                    _ph*_pw*sizeof(data_t), // local strides
+                    _oph*_opw*sizeof(data_t) // remote strides
+                );
+            }
 #endif /* CCN_TILING_2D */
 #ifdef CCN_TILING_1D
             /* Assuming that tiles are internally contiguous in the i,j feature map dimensions,
                the tiling grid is one-dimensional.
                Moreover, _h=layer->height,_w=layer->width */
             // Y tile copy-in
-            ccn_memcpy_async(
-                l2_y, // pointers
-                layer->loc_y_wb,
-                _nof*_oph*_opw*sizeof(data_t)
-            );
+            for(int n=0; n<layer->batch; n++) {
+#ifdef CCN_WB_ACTIVATION
+                if(layer->activation != ACTIVATION_NONE) {
+                    linalg_activation(l2_y + n*_l2_ys, layer->loc_y_wb + n*_nof*_oh*_ow, _nof*_oph*_opw, layer->activation, layer->qf);
+                    continue;
+                }
+#endif /* CCN_WB_ACTIVATION */
+                ccn_memcpy_async(
+                    l2_y + n*_l2_ys, // pointers
+                    layer->loc_y_wb + n*_nof*_oh*_ow,
+                    _nof*_oph*_opw*sizeof(data_t)
+                );
+            }
 #endif /* CCN_TILING_1D */
         }
 
@@ -1022,6 +1145,38 @@ static void ConvPoolLayer_pipe_wb(
 #endif /* WRITEBACK_PROFILE */
 }
 
+#ifdef CCN_PIPE_THREADS
+// the stages as run by the pipeline threads, each on the local buffers of its
+// tile (see pipeline.h)
+// the input channel tiles (bb) of an output tile accumulate into the same y
+// buffer, so y rotates per output tile, not per k
+static data_t *ConvPoolLayer_loc_y(ConvPoolLayer *layer, const ccn_tile_t *t) {
+    int s = (t->k / layer->ntile_nif) % CCN_PIPE_NBUF_Y;
+    return s == 0 ? layer->loc_y0 : s == 1 ? layer->loc_y1 : layer->loc_y2;
+}
+
+static void ConvPoolLayer_thread_fe(void *arg, const ccn_tile_t *t) {
+    ConvPoolLayer *layer = arg;
+    layer->loc_x_fe = t->k % CCN_PIPE_NBUF_X ? layer->loc_x1 : layer->loc_x0;
+    layer->loc_w_fe = t->k % CCN_PIPE_NBUF_X ? layer->loc_w1 : layer->loc_w0;
+    ConvPoolLayer_pipe_fe(layer, t->aa, t->bb, t->ii, t->jj);
+}
+
+static void ConvPoolLayer_thread_ex(void *arg, const ccn_tile_t *t) {
+    ConvPoolLayer *layer = arg;
+    layer->loc_x_ex = t->k % CCN_PIPE_NBUF_X ? layer->loc_x1 : layer->loc_x0;
+    layer->loc_w_ex = t->k % CCN_PIPE_NBUF_X ? layer->loc_w1 : layer->loc_w0;
+    layer->loc_y_ex = ConvPoolLayer_loc_y(layer, t);
+    ConvPoolLayer_pipe_ex(layer, t->aa, t->bb, t->ii, t->jj);
+}
+
+static void ConvPoolLayer_thread_wb(void *arg, const ccn_tile_t *t) {
+    ConvPoolLayer *layer = arg;
+    layer->loc_y_wb = ConvPoolLayer_loc_y(layer, t);
+    ConvPoolLayer_pipe_wb(layer, t->aa, t->bb, t->ii, t->jj);
+}
+#endif /* CCN_PIPE_THREADS */
+
 /**
  *  Executes the given ConvPoolLayer, i.e. computes its outputs given the inputs
  *  defined in the data structure.
@@ -1039,6 +1194,21 @@ void ConvPoolLayer_exec(ConvPoolLayer *layer) {
     //   write-back (wb) : DMA out of a tile
     // all indeces have a fetch, execute and write-back version
 
+#ifndef CCN_CACHE
+    // initialize state of fe local buffer pointers
+    layer->loc_x_fe = layer->loc_x0;
+    layer->loc_w_fe = layer->loc_w0;
+    layer->loc_y_fe = layer->loc_y0;
+#endif /* ~CCN_CACHE */
+
+    // reset the weights!
+    memset(layer->loc_w0, 0, sizeof(data_t)*layer->tiling_max_nof*layer->tiling_max_nif*MULTIPLE4(layer->filter_size*layer->filter_size));
+    memset(layer->loc_w1, 0, sizeof(data_t)*layer->tiling_max_nof*layer->tiling_max_nif*MULTIPLE4(layer->filter_size*layer->filter_size));
+
+#ifdef CCN_TILING
+#ifdef CCN_PIPE_THREADS
+    ccn_pipe_run(layer, ConvPoolLayer_thread_fe, ConvPoolLayer_thread_ex, ConvPoolLayer_thread_wb, layer->ntile_nof, layer->ntile_h, layer->ntile_w, layer->ntile_nif);
+#else /* ~CCN_PIPE_THREADS */
     int aa_pipe,bb_pipe,ii_pipe,jj_pipe;
 
     int aa_fe = -1, bb_fe = -1, ii_fe = -1, jj_fe = -1;
@@ -1052,18 +1222,6 @@ void ConvPoolLayer_exec(ConvPoolLayer *layer) {
     int doublebuf_state_y_wb = 0;
 #endif /* CCN_DOUBLEBUF */
 
-#ifndef CCN_CACHE
-    // initialize state of fe local buffer pointers
-    layer->loc_x_fe = layer->loc_x0;
-    layer->loc_w_fe = layer->loc_w0;
-    layer->loc_y_fe = layer->loc_y0;
-#endif /* ~CCN_CACHE */
-
-    // reset the weights!
-    memset(layer->loc_w0, 0, sizeof(data_t)*layer->tiling_max_nof*layer->tiling_max_nif*MULTIPLE4(layer->filter_size*layer->filter_size));
-    memset(layer->loc_w1, 0, sizeof(data_t)*layer->tiling_max_nof*layer->tiling_max_nif*MULTIPLE4(layer->filter_size*layer->filter_size));
-
-#ifdef CCN_TILING
     for(aa_pipe=0; aa_pipe<layer->ntile_nof+NB_PIPE_STAGE-1; aa_pipe++) {
 
         for(ii_pipe=0; ii_pipe<layer->ntile_h; ii_pipe++) {
@@ -1120,7 +1278,7 @@ void ConvPoolLayer_exec(ConvPoolLayer *layer) {
                     printf("  wb: aa=%d bb=%d ii=%d jj=%d\n", aa_wb, bb_wb, ii_wb, jj_wb);
                     printf("  doublebuf states: %d %d %d\n", doublebuf_state_x_fe, doublebuf_state_y_fe, doublebuf_state_y_wb);
                     printf("\n");
-#endif PIPE_DEBUG
+#endif /* PIPE_DEBUG */
 #ifdef PIPE_PROFILE
                     reset_timer();
                     start_timer();
@@ -1179,23 +1337,27 @@ void ConvPoolLayer_exec(ConvPoolLayer *layer) {
                     else {
                         doublebuf_state_x_fe = 0;
                     }
-                    if (doublebuf_state_y_fe == 0) {
-                        doublebuf_state_y_fe = 1;
-                    }
-                    else if (doublebuf_state_y_fe == 1) {
-                        doublebuf_state_y_fe = 2;
-                    }
-                    else {
-                        doublebuf_state_y_fe = 0;
-                    }
-                    if (doublebuf_state_y_wb == 0) {
-                        doublebuf_state_y_wb = 1;
-                    }
-                    else if (doublebuf_state_y_wb == 1) {
-                        doublebuf_state_y_wb = 2;
-                    }
-                    else {
-                        doublebuf_state_y_wb = 0;
+                    // y is switched only after the last input channel tile,
+                    // the ones before accumulate into the same buffer
+                    if (bb_pipe == layer->ntile_nif-1) {
+                        if (doublebuf_state_y_fe == 0) {
+                            doublebuf_state_y_fe = 1;
+                        }
+                        else if (doublebuf_state_y_fe == 1) {
+                            doublebuf_state_y_fe = 2;
+                        }
+                        else {
+                            doublebuf_state_y_fe = 0;
+                        }
+                        if (doublebuf_state_y_wb == 0) {
+                            doublebuf_state_y_wb = 1;
+                        }
+                        else if (doublebuf_state_y_wb == 1) {
+                            doublebuf_state_y_wb = 2;
+                        }
+                        else {
+                            doublebuf_state_y_wb = 0;
+                        }
                     }
 #endif /* CCN_DOUBLEBUF */
 #endif /* ~CCN_CACHE */
@@ -1207,6 +1369,7 @@ void ConvPoolLayer_exec(ConvPoolLayer *layer) {
         }
 
     }
+#endif /* ~CCN_PIPE_THREADS */
 #else /* ~CCN_TILING */
     // fetch stage
     ConvPoolLayer_pipe_fe(layer, 0, 0, 0, 0);
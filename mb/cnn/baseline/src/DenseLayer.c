@@ -11,6 +11,8 @@
 
 #include "linalg.h"
 #include "tiling.h"
+#include "huffman.h"
+#include "quant.h"
 #include "DenseLayer.h"
 
 #ifdef CCN_TILING_LESSTIME
@@ -94,7 +96,12 @@ DenseLayer *DenseLayer_new(
     layer->b             = b;
     layer->x             = x;
     layer->y             = y;
+    layer->batch         = 1;
     layer->qf            = qf;
+    layer->w_code        = NULL;
+    layer->w_bits        = NULL;
+    layer->w_tile_pos    = NULL;
+    layer->w_quant       = NULL;
 
 #ifndef CCN_CACHE
     layer->loc_x0 = loc_x0;
@@ -141,14 +148,14 @@ DenseLayer *DenseLayer_new(
 
 #ifdef CCN_TILING_LESSTIME
             if(bb*tiling_max_nin > n_in_neurons-tiling_max_nin) {
-                tile_grid_nin[aa][bb] = (unsigned char) n_in_neurons % tiling_max_nin;
+                tile_grid_nin[aa][bb] = (unsigned char) (n_in_neurons % tiling_max_nin);
             }
             else {
                 tile_grid_nin[aa][bb] = (unsigned char) tiling_max_nin;
             }
 
             if(aa*tiling_max_non > n_out_neurons-tiling_max_non) {
-                tile_grid_non[aa][bb] = (unsigned char) n_out_neurons % tiling_max_non;
+                tile_grid_non[aa][bb] = (unsigned char) (n_out_neurons % tiling_max_non);
             }
             else {
                 tile_grid_non[aa][bb] = (unsigned char) tiling_max_non;
@@ -168,8 +175,8 @@ DenseLayer *DenseLayer_new(
 #ifdef CCN_TILING_LESSTIME
     for(aa=layer->ntile_non; aa<layer->ntile_non+NB_PIPE_STAGE-1; aa++) {
         for(bb=0; bb<layer->ntile_nin; bb++) {
-            tile_grid_nin[aa][bb] = tiling_max_nin;
-            tile_grid_non[aa][bb] = tiling_max_non;
+            tile_grid_nin[aa][bb] = 0;
+            tile_grid_non[aa][bb] = 0;
         }
     }
 #endif /* CCN_TILING_LESSTIME */
@@ -216,9 +223,102 @@ void DenseLayer_delete(
     ccn_free(layer->tile_grid_non);
     ccn_free(layer->tile_grid_nin);
 #endif /* ~CCN_TILING */
+    if(layer->w_code != NULL) {
+        huffman_table_free(layer->w_code);
+        free(layer->w_code);
+        free(layer->w_bits);
+        free(layer->w_tile_pos);
+    }
     ccn_free(layer);
 }
 
+/**
+ *  Compresses the weights of the given DenseLayer, which the fetch stage then
+ *  decodes tile by tile into the local weight buffers instead of copying
+ *  them. The bytes of the weights are Huffman-coded with one canonical code,
+ *  and every tile is coded on its own, in its local [nin][non] layout, so it
+ *  can be decoded independently.
+ *
+ *  @return 0 on success, 1 if the weights could not be coded (or are
+ *  quantised, see w_quant) or out of memory.
+ *
+ *  @param *layer
+ *      a pointer to the DenseLayer data structure; *w must not change after.
+ */
+int DenseLayer_compress(DenseLayer *layer) {
+
+    size_t nbytes = sizeof(data_t)*layer->n_in_neurons*layer->n_out_neurons;
+    const unsigned char *w = (const unsigned char *) layer->w;
+    unsigned long freq[MAX_SYMBOLS];
+    unsigned char lengths[MAX_SYMBOLS];
+    int aa, bb;
+
+    if(layer->w_quant != NULL)
+        return 1;
+    memset(freq, 0, sizeof(freq));
+    for(size_t i=0; i<nbytes; i++) {
+        freq[w[i]]++;
+    }
+    if(huffman_lengths(freq, lengths, HUFFMAN_MAX_BITS))
+        return 1;
+
+    // the tiles cover every weight once, so this is the exact coded size
+    size_t nbits = 0;
+    for(int s=0; s<MAX_SYMBOLS; s++) {
+        nbits += freq[s]*lengths[s];
+    }
+
+    huffman_table *code = malloc(sizeof(huffman_table));
+    unsigned char *bits = malloc(nbits/8+1);
+    size_t *pos = malloc(sizeof(size_t)*layer->ntile_non*layer->ntile_nin);
+    data_t *tile = malloc(sizeof(data_t)*layer->tiling_max_non*layer->tiling_max_nin);
+    if(code == NULL || bits == NULL || pos == NULL || tile == NULL || huffman_table_init(code, lengths)) {
+        free(code);
+        free(bits);
+        free(pos);
+        free(tile);
+        return 1;
+    }
+
+    size_t bitpos = 0;
+    for(aa=0; aa<layer->ntile_non; aa++) {
+        for(bb=0; bb<layer->ntile_nin; bb++) {
+            _dense_tiling_init();
+
+            data_t *l2_W = ccn_get_tile_2d(
+                layer->w,
+                bb, aa,
+                layer->tiling_max_nin, layer->tiling_max_non,
+                layer->n_out_neurons
+            );
+            for(int b=0; b<_nin; b++) {
+                memcpy(tile + b*_non, l2_W + b*layer->n_out_neurons, _non*sizeof(data_t));
+            }
+            pos[aa*layer->ntile_nin+bb] = bitpos;
+            huffman_encode(lengths, (unsigned char *) tile, _nin*_non*sizeof(data_t), bits, nbits/8+1, &bitpos);
+        }
+    }
+    free(tile);
+
+    if(layer->w_code != NULL) {
+        huffman_table_free(layer->w_code);
+        free(layer->w_code);
+        free(layer->w_bits);
+        free(layer->w_tile_pos);
+    }
+    layer->w_code     = code;
+    layer->w_bits     = bits;
+    layer->w_bits_len = nbits/8+1;
+    layer->w_tile_pos = pos;
+    return 0;
+}
+
+// 1 if the activation can be applied to every tile of outputs on its own,
+// i.e. unless it is a softmax over more than one tile
+static int DenseLayer_tile_activation(DenseLayer *layer) {
+    return layer->activation != ACTIVATION_SOFTMAX || layer->ntile_non == 1;
+}
+
 static void DenseLayer_pipe_fe(
     DenseLayer *layer,
     int aa,
@@ -259,28 +359,48 @@ static void DenseLayer_pipe_fe(
             layer->n_out_neurons
         );
 
-        // X tile copy-in
-        ccn_memcpy_async(
-            layer->loc_x_fe, // pointers
-            l2_x,
-            _nin*sizeof(data_t)
-        );
-        // W copy-in (check misalignment)
-        ccn_memcpy_async_2d(
-            layer->loc_w_fe, // pointers
-            l2_W,
-            _nin, // sizes
-            _non*sizeof(data_t),
-            _non*sizeof(data_t), // local strides
-            layer->n_out_neurons*sizeof(data_t) // remote strides
-        );
-        // b copy-in
-        if(bb==0) {
+        // X tile copy-in, one per image
+        for(int n=0; n<layer->batch; n++) {
             ccn_memcpy_async(
-               layer->loc_b,
-               &layer->b[aa*layer->tiling_max_non],
-               _non*sizeof(data_t)
-           );
+                layer->loc_x_fe + n*_nin, // pointers
+                l2_x + n*layer->n_in_neurons,
+                _nin*sizeof(data_t)
+            );
+        }
+        if(layer->w_quant != NULL) {
+            // W tile copy-in, still packed: rows of _non codes
+            int lda = quant_bytes(layer->w_quant->bits, _non);
+            for(int b=0; b<_nin; b++) {
+                quant_copy(
+                    layer->w_quant,
+                    (size_t) (bb*layer->tiling_max_nin+b)*layer->n_out_neurons + aa*layer->tiling_max_non,
+                    _non,
+                    (unsigned char *) layer->loc_w_fe + b*lda
+                );
+            }
+        }
+        else if(layer->w_code != NULL) {
+            // W tile decoding
+            size_t bitpos = layer->w_tile_pos[aa*layer->ntile_nin+bb];
+            huffman_table_decode(
+                layer->w_code,
+                layer->w_bits,
+                layer->w_bits_len,
+                &bitpos,
+                (unsigned char *) layer->loc_w_fe,
+                _nin*_non*sizeof(data_t)
+            );
+        }
+        else {
+            // W copy-in (check misalignment)
+            ccn_memcpy_async_2d(
+                layer->loc_w_fe, // pointers
+                l2_W,
+                _nin, // sizes
+                _non*sizeof(data_t),
+                _non*sizeof(data_t), // local strides
+                layer->n_out_neurons*sizeof(data_t) // remote strides
+            );
         }
 
 #ifdef FETCH_CHECKSUM
@@ -340,7 +460,6 @@ static void DenseLayer_pipe_ex(
     data_t *_x = layer->loc_x_ex;
     data_t *_y = layer->loc_y_ex;
     data_t *_W = layer->loc_w_ex;
-    data_t *_b = layer->loc_b;
 
 #ifndef CCN_DOUBLEBUF
     // wait for the end of the fetch stage if not doing double buffering
@@ -371,15 +490,31 @@ static void DenseLayer_pipe_ex(
 
 #endif /* CCN_CACHE */
 
-    // biasing y
+    // biasing y; the biases are read in place, like in ConvLayer: a single
+    // loc_b would be refetched for the next output tile while this one still
+    // needs it
+    data_t *_b = &layer->b[aa*layer->tiling_max_non];
     if(bb==0) {
-        for(int a=0; a<_non; a++) {
-            _y[a] = _b[a];
+        for(int n=0; n<layer->batch; n++) {
+            for(int a=0; a<_non; a++) {
+                _y[n*_non+a] = _b[a];
+            }
         }
     }
 
-    // matrix x vector product
-    linalg_mvprod(_W, 0, _x, _y, _nin, _non, layer->qf);
+    // matrix x matrix product, the W tile is shared by all images of the batch
+#ifndef CCN_CACHE
+    if(layer->w_quant != NULL) {
+        const quant_weights *qw = layer->w_quant;
+        linalg_mmprod_q(
+            (unsigned char *) _W, qw->bits, quant_bytes(qw->bits, _non),
+            qw->mult + aa*layer->tiling_max_non, qw->shift,
+            _x, _y, _nin, _non, layer->batch, layer->qf
+        );
+    }
+    else
+#endif /* ~CCN_CACHE */
+    linalg_mmprod(_W, _x, _y, _nin, _non, layer->batch, layer->qf);
     // plp_matmul_i16(_W, _x, _y, _nin, _non, 1);
 
     // if(bb == layer->ntile_nin-1) {
@@ -391,17 +526,14 @@ static void DenseLayer_pipe_ex(
     //     }
     // }
 
-    // activation
-    if(layer->activation == ACTIVATION_TANH) {
-        for(int a=0; a<_non; a++) {
-            _y[a] = ccn_tanh(_y[a]);
-        }
-    }
-    else if(layer->activation == ACTIVATION_RELU) {
-        for(int a=0; a<_non; a++) {
-            _y[a] = (_y[a] < 0) ? 0 : _y[a];
-        }
+#ifndef CCN_WB_ACTIVATION
+    // activation, once the last input tile has been accumulated (else in
+    // DenseLayer_pipe_wb); a softmax split among tiles is left to
+    // DenseLayer_exec
+    if(bb == layer->ntile_nin-1 && layer->activation != ACTIVATION_NONE && DenseLayer_tile_activation(layer)) {
+        linalg_activation_2d(_y, _y, layer->batch, _non, _non, _non, layer->activation, layer->qf);
     }
+#endif /* ~CCN_WB_ACTIVATION */
 
 #ifdef TILE_CHECKSUM
     {
@@ -482,13 +614,28 @@ static void DenseLayer_pipe_wb(
 #endif /* WRITEBACK_DEBUG */
 
         // Y tile copy-out
-        if(bb == layer->ntile_nin-1) {
-            ccn_memcpy_async(//
-                l2_y, // pointers
+#ifdef CCN_WB_ACTIVATION
+        if(bb == layer->ntile_nin-1 && layer->activation != ACTIVATION_NONE && DenseLayer_tile_activation(layer)) {
+            // activation on the way out
+            linalg_activation_2d(
+                l2_y,
                 layer->loc_y_wb,
-                _non*sizeof(data_t)
+                layer->batch, _non,
+                layer->n_out_neurons, _non,
+                layer->activation, layer->qf
             );
         }
+        else
+#endif /* CCN_WB_ACTIVATION */
+        if(bb == layer->ntile_nin-1) {
+            for(int n=0; n<layer->batch; n++) {
+                ccn_memcpy_async(//
+                    l2_y + n*layer->n_out_neurons, // pointers
+                    layer->loc_y_wb + n*_non,
+                    _non*sizeof(data_t)
+                );
+            }
+        }
 
     }
 #ifdef WRITEBACK_DEBUG
@@ -594,7 +741,7 @@ void DenseLayer_exec(DenseLayer *layer) {
             printf("  wb: aa=%d bb=%d\n", aa_wb, bb_wb);
             printf("  doublebuf states: %d %d %d\n", doublebuf_state_x_fe, doublebuf_state_y_fe, doublebuf_state_y_wb);
             printf("\n");
-#endif PIPE_DEBUG
+#endif /* PIPE_DEBUG */
 #ifdef PIPE_PROFILE
             reset_timer();
             start_timer();
@@ -677,4 +824,15 @@ void DenseLayer_exec(DenseLayer *layer) {
     DenseLayer_pipe_wb(layer, 0, 0);
 #endif /* CCN_TILING */
 
+    // the softmax needs all the outputs of an image
+    if(!DenseLayer_tile_activation(layer)) {
+        linalg_activation_2d(
+            layer->y,
+            layer->y,
+            layer->batch, layer->n_out_neurons,
+            layer->n_out_neurons, layer->n_out_neurons,
+            layer->activation, layer->qf
+        );
+    }
+
 }
@@ -33,9 +33,10 @@ typedef struct {
     data_t *b;         ///< pointer to the biases.
     data_t *x;         ///< pointer to the input feature maps.
     data_t *y;         ///< pointer to the output feature maps.
+    int batch;         ///< number of images per exec, one after the other in x, y and the local buffers.
     data_t *loc_w0;        ///< pointer to the weights.
     data_t *loc_w1;        ///< pointer to the weights.
-    data_t *loc_b;         ///< pointer to the biases.
+    data_t *loc_b;         ///< local biases, not used: pipe_ex reads b in place.
     data_t *loc_x0;
     data_t *loc_x1;
     data_t *loc_y0;
@@ -59,6 +60,11 @@ typedef struct {
     unsigned char tlast_non;
     unsigned char tlast_nin;
     unsigned qf;
+    struct huffman_table_tag *w_code; ///< code of the compressed weights, NULL to fetch them from *w.
+    unsigned char *w_bits;            ///< compressed weight tiles, see DenseLayer_compress().
+    size_t w_bits_len;
+    size_t *w_tile_pos;               ///< bit offset of tile (aa,bb) in w_bits, at [aa*ntile_nin+bb].
+    struct quant_weights_tag *w_quant; ///< 8-bit or 4-bit weights replacing *w, NULL for none; not owned, needs the fetch stage.
 } DenseLayer;
 
 DenseLayer *DenseLayer_new(
@@ -85,6 +91,8 @@ DenseLayer *DenseLayer_new(
     int tiling_max_nin,
     unsigned qf
 );
+int DenseLayer_compress(DenseLayer *layer);
 void DenseLayer_exec(DenseLayer *layer);
+void DenseLayer_delete(DenseLayer *layer);
 
 #endif /* DENSELAYER_H */
@@ -16,6 +16,7 @@
 #define _w    width_tile
 #define _oh   layer->out_height
 #define _ow   layer->out_width
+#define _pz   layer->pool_size
 #define _ps   layer->pool_stride
 
 #define X(k,i,j) x[((k*layer->height)+i)*layer->width+j]
@@ -28,6 +29,9 @@
  *
  *  @param n_feat
  *      the number of input feature maps.
+ *  @param pool_size
+ *      the size of the pooling window; windows overlap if it is larger than
+ *      pool_stride, and are clipped at the bottom and right borders.
  *  @param pool_stride
  *      the pooling factor.
  *  @param height
@@ -55,6 +59,7 @@ PoolLayer *PoolLayer_new(
     data_t *loc_y0,
     data_t *loc_y1,
     int n_feat,
+    int pool_size,
     int pool_stride,
     int height,
     int width,
@@ -71,13 +76,15 @@ PoolLayer *PoolLayer_new(
 #endif /* CCN_NOALLOC */
 
     layer->n_feat      = n_feat;
+    layer->pool_size   = pool_size;
     layer->pool_stride = pool_stride;
     layer->height      = height;
     layer->width       = width;
-    layer->out_height  = height/pool_stride + height%pool_stride;
-    layer->out_width   = width /pool_stride + width %pool_stride;
+    layer->out_height  = (height+pool_stride-1)/pool_stride;
+    layer->out_width   = (width +pool_stride-1)/pool_stride;
     layer->x           = x;
     layer->y           = y;
+    layer->batch       = 1;
 
 #ifndef CCN_CACHE
     layer->loc_x0 = loc_x0;
@@ -100,10 +107,22 @@ void PoolLayer_delete(PoolLayer *layer) {
     free(layer);
 }
 
+// maximum of the pz*pz window at (i0,j0) of feature map k, clipped to the map
+static inline data_t PoolLayer_window_max(data_t *x, int h, int w, int pz, int k, int i0, int j0) {
+    data_t max = -DATA_T_MAX;
+    for(int i=i0; i<i0+pz && i<h; i++) {
+        for(int j=j0; j<j0+pz && j<w; j++) {
+            data_t xtmp = x[((k*h)+i)*w+j];
+            if(xtmp > max)
+                max = xtmp;
+        }
+    }
+    return max;
+}
+
 static void PoolLayer_tile_loop(PoolLayer *layer, int nfeat_tile, int height_tile, int width_tile, int ii, int jj, int kk, int *doublebuf) {
 
-    int i,j,k,i1,j1;
-    data_t max, xtmp;
+    int k;
 
     data_t *_x;
     data_t *_y;
@@ -137,7 +156,7 @@ static void PoolLayer_tile_loop(PoolLayer *layer, int nfeat_tile, int height_til
 #ifdef INTERM_CHECKSUM
     // #pragma omp master
     {
-        int sum = 0;
+        int i, j, i1, j1, sum = 0;
         for(k=0; k<_nf; k++) {
             for(i=0; i<_oh; i++) {
                 for(j=0; j<_ow; j++) {
@@ -157,17 +176,9 @@ static void PoolLayer_tile_loop(PoolLayer *layer, int nfeat_tile, int height_til
     if(layer->parallel_type == PARALLEL_FEAT) {
         #pragma omp parallel for
         for(k=0; k<_nf; k++) {
-            for(i=0; i<_oh; i++) {
-                for(j=0; j<_ow; j++) {
-                    max = -DATA_T_MAX;
-                    for(i1=0; i1<_ps; i1++) {
-                        for(j1=0; j1<_ps; j1++) {
-                            xtmp = _x[((k*_h)+(i*_ps+i1))*_w+(j*_ps+j1)];
-                            if(xtmp > max)
-                                max = xtmp;
-                        }
-                    }
-                    _y[((k*_oh)+i)*_ow+j] = max;
+            for(int i=0; i<_oh; i++) {
+                for(int j=0; j<_ow; j++) {
+                    _y[((k*_oh)+i)*_ow+j] = PoolLayer_window_max(_x, _h, _w, _pz, k, i*_ps, j*_ps);
                 }
             }
         }
@@ -175,17 +186,9 @@ static void PoolLayer_tile_loop(PoolLayer *layer, int nfeat_tile, int height_til
     else {
         for(k=0; k<_nf; k++) {
             #pragma omp parallel for
-            for(i=0; i<_oh; i++) {
-                for(j=0; j<_ow; j++) {
-                    max = -DATA_T_MAX;
-                    for(i1=0; i1<_ps; i1++) {
-                        for(j1=0; j1<_ps; j1++) {
-                            xtmp = _x[((k*_h)+(i*_ps+i1))*_w+(j*_ps+j1)];
-                            if(xtmp > max)
-                                max = xtmp;
-                        }
-                    }
-                    _y[((k*_oh)+i)*_ow+j] = max;
+            for(int i=0; i<_oh; i++) {
+                for(int j=0; j<_ow; j++) {
+                    _y[((k*_oh)+i)*_ow+j] = PoolLayer_window_max(_x, _h, _w, _pz, k, i*_ps, j*_ps);
                 }
             }
         }
@@ -194,7 +197,7 @@ static void PoolLayer_tile_loop(PoolLayer *layer, int nfeat_tile, int height_til
 #ifdef INTERM_CHECKSUM
     // #pragma omp master
     {
-        int sum = 0;
+        int i, j, sum = 0;
         for(k=0; k<_nf; k++) {
             for(i=0; i<_oh; i++) {
                 for(j=0; j<_ow; j++) {
@@ -220,16 +223,8 @@ static void PoolLayer_tile_loop(PoolLayer *layer, int nfeat_tile, int height_til
 
 }
 
-/**
- *  Executes the given PoolLayer, i.e. computes its outputs given the inputs
- *  defined in the data structure.
- *  The PoolLayer reduces the size of the feature maps by max-pooling.
- *
- *  @param *layer
- *      a pointer to the PoolLayer data structure to execute.
- */
-
-void PoolLayer_exec(PoolLayer *layer) {
+// pools the image at layer->x into layer->y
+static void PoolLayer_exec_image(PoolLayer *layer) {
 
     int i,j, ii,jj,kk;
     int max_nfeat_tile = layer->tiling_max_nfeat;
@@ -290,7 +285,6 @@ void PoolLayer_exec(PoolLayer *layer) {
         nfeat_tile = nfeat_int;
         // normal height
         for(jj=0; height_int > max_height_tile-1; jj+=max_height_tile) {
-            unsigned int sptr;
             int width_tile;
             height_tile = max_height_tile;
             // normal width
@@ -330,3 +324,28 @@ void PoolLayer_exec(PoolLayer *layer) {
 
 }
 
+/**
+ *  Executes the given PoolLayer, i.e. computes its outputs given the inputs
+ *  defined in the data structure.
+ *  The PoolLayer reduces the size of the feature maps by max-pooling.
+ *  The layer has no weights to share, so the images of a batch are simply
+ *  pooled one after the other.
+ *
+ *  @param *layer
+ *      a pointer to the PoolLayer data structure to execute.
+ */
+void PoolLayer_exec(PoolLayer *layer) {
+
+    data_t *x = layer->x;
+    data_t *y = layer->y;
+    int xs = layer->n_feat*layer->height*layer->width;
+    int ys = layer->n_feat*layer->out_height*layer->out_width;
+
+    for(int n=0; n<layer->batch; n++) {
+        layer->x = x + n*xs;
+        layer->y = y + n*ys;
+        PoolLayer_exec_image(layer);
+    }
+    layer->x = x;
+    layer->y = y;
+}
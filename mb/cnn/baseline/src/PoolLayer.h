@@ -25,6 +25,7 @@
  */
 typedef struct {
     int n_feat;      ///< number of input feature maps.
+    int pool_size;   ///< size of the pooling window.
     int pool_stride; ///< pooling factor.
     int height;      ///< height of the input feature maps.
     int width;       ///< width of the input feature maps.
@@ -32,6 +33,7 @@ typedef struct {
     int out_width;   ///< width of the output feature maps.
     data_t *x;       ///< pointer to the input feature maps.
     data_t *y;       ///< pointer to the output feature maps.
+    int batch;       ///< number of images per exec, one after the other in x, y and the local buffers.
     data_t *loc_x0;
     data_t *loc_x1;
     data_t *loc_y0;
@@ -53,6 +55,7 @@ PoolLayer *PoolLayer_new(
   data_t *loc_y0,
   data_t *loc_y1,
   int n_feat,
+  int pool_size,
   int pool_stride,
   int height,
   int width,
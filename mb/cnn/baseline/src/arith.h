@@ -199,17 +199,16 @@ static inline data_t ccn_relu(data_t x) {
       return x;
 }
 
-// CConvNet softmax (fixed- or floating-point)
-static inline ccn_softmax(data_t * __restrict__ x, data_t * __restrict__ y, int len) {
+// CConvNet softmax (fixed- or floating-point); see linalg_softmax for one
+// with the qf of a layer that does not overflow
+static inline void ccn_softmax(data_t * __restrict__ x, data_t * __restrict__ y, int len) {
    int i = 0;
    int sum = 0;
    for(i=0; i<len; i++) {
       y[i] = ccn_exp(x[i]);
       sum += y[i];
    }
-   printf("sum=%d\n", sum);
    for(i=0; i<len; i++) {
-      printf(" y[i]=%d sum=%d\n", y[i], sum);
       y[i] = ccn_div(y[i], sum);
    }
 }
@@ -0,0 +1,698 @@
+/*
+ * fastconv.c
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ *
+ * Alternative backends for the 2d convolution of the layers, both built on
+ * one blocked int16 GEMM with 32-bit accumulation:
+ *   - CONV_GEMM: im2col, i.e. y[a][i,j] += sum_k W[a][k] * col[k][i,j] where
+ *     k runs over the input feature maps and filter taps, so every weight is
+ *     read once per tile instead of once per output pixel block;
+ *   - CONV_WINOGRAD: Winograd F(2x2,3x3) or F(2x2,5x5), and CONV_WINOGRAD4:
+ *     F(4x4,3x3). The input tiles d and filters g are transformed to
+ *     V = B^T d B and U = G g G^T, for every of the alpha*alpha transformed
+ *     points a GEMM M = U V sums over the input feature maps, and the
+ *     outputs are A^T M A. U and V are requantised to int16 with a
+ *     power-of-two scale per transformed point (for V per call), M is
+ *     requantised to qf before the output transform, which is exact in int32.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "fastconv.h"
+
+#if defined(CCN_X86) && (defined(__x86_64__) || defined(__i386__))
+#define FASTCONV_SIMD
+#include <immintrin.h>
+#endif
+
+#define GEMM_MR 4           ///< rows of A per register block.
+#define WINO_UBITS 14       ///< bits of the requantised transformed weights.
+#define WINO_VBITS 13       ///< bits of the requantised transformed inputs.
+#define WINO_TB 16          ///< tiles per transform block.
+
+struct FastConv {
+    int algo;
+    int fs, nof, nif;
+    int m, alpha;       ///< Winograd output and input tile size.
+    int k2;             ///< GEMM depth, rounded up to even.
+    int shift[6*6];     ///< U = 2^shift * stored weights, per point (Winograd).
+    int16_t *Wp;        ///< packed weights, [alpha*alpha] GEMM A operands for Winograd.
+    void *raw;
+};
+
+// Winograd matrices G, for the points 0, 1, -1 (, 2, -2) and infinity; B^T
+// and A^T are spelled out in the 1d transforms below
+static const double wino_g23[4*3] = {
+   -1.0,  0.0, 0.0,
+    0.5,  0.5, 0.5,
+    0.5, -0.5, 0.5,
+    0.0,  0.0, 1.0
+};
+static const double wino_g43[6*3] = {
+    1.0/4,       0,     0,
+   -1.0/6, -1.0/6, -1.0/6,
+   -1.0/6,  1.0/6, -1.0/6,
+    1.0/24, 1.0/12, 1.0/6,
+    1.0/24,-1.0/12, 1.0/6,
+    0,       0,     1.0
+};
+static const double wino_g25[6*5] = {
+    1.0/4,       0,      0,      0,      0,
+   -1.0/6, -1.0/6, -1.0/6, -1.0/6, -1.0/6,
+   -1.0/6,  1.0/6, -1.0/6,  1.0/6, -1.0/6,
+    1.0/24, 1.0/12, 1.0/6,  1.0/3,  2.0/3,
+    1.0/24,-1.0/12, 1.0/6, -1.0/3,  2.0/3,
+    0,       0,      0,      0,      1.0
+};
+
+static void *fastconv_alloc(size_t size, void **raw) {
+    *raw = malloc(size+63);
+    if(*raw == NULL) {
+        printf("Out of memory in FastConv\n");
+        exit(1);
+    }
+    return (void *) (((uintptr_t) *raw + 63) & ~(uintptr_t) 63);
+}
+
+// per-thread scratch buffers, grown on demand
+static __thread void *scratch_raw[4];
+static __thread void *scratch_buf[4];
+static __thread size_t scratch_size[4];
+
+static void *fastconv_scratch(int i, size_t size) {
+    if(size > scratch_size[i]) {
+        free(scratch_raw[i]);
+        scratch_buf[i] = fastconv_alloc(size, &scratch_raw[i]);
+        scratch_size[i] = size;
+    }
+    return scratch_buf[i];
+}
+
+static inline int round_up(int x, int n) {
+    return (x+n-1)/n*n;
+}
+
+// columns of B per register block
+static inline int gemm16_nr(int isa) {
+    return isa == 2 ? 48 : isa == 1 ? 24 : 8;
+}
+
+/*
+ * The GEMM operands are packed in pairs along K, as vpmaddwd takes them:
+ *   A[M][K] as Ap[M/GEMM_MR][K/2][GEMM_MR][2],
+ *   B[K][N] as Bp[N/nr][K/2][nr][2],
+ * with M, N and K rounded up to GEMM_MR, nr and 2.
+ */
+static inline size_t gemm16_a(int m, int k, int k2) {
+    return (size_t) (m/GEMM_MR)*k2*GEMM_MR + (k>>1)*GEMM_MR*2 + (m%GEMM_MR)*2 + (k&1);
+}
+
+static inline size_t gemm16_b(int k, int n, int k2, int nr) {
+    return (size_t) (n/nr)*k2*nr + (k>>1)*nr*2 + (n%nr)*2 + (k&1);
+}
+
+static void gemm16_ref(const int16_t *__restrict__ Ap, const int16_t *__restrict__ Bp, int32_t *__restrict__ C, int M, int N, int k2, int ldc) {
+    const int nr = 8;
+    for(int n0=0; n0<N; n0+=nr) {
+        for(int m0=0; m0<M; m0+=GEMM_MR) {
+            const int16_t *a = Ap + (size_t) m0*k2;
+            const int16_t *b = Bp + (size_t) n0*k2;
+            uint32_t acc[GEMM_MR][8] = {{0}};
+            for(int kp=0; kp<k2/2; kp++) {
+                for(int mi=0; mi<GEMM_MR; mi++) {
+                    int32_t a0 = a[kp*GEMM_MR*2+mi*2], a1 = a[kp*GEMM_MR*2+mi*2+1];
+                    for(int ni=0; ni<8; ni++) {
+                        acc[mi][ni] += (uint32_t) (a0 * b[kp*16+ni*2]);
+                        acc[mi][ni] += (uint32_t) (a1 * b[kp*16+ni*2+1]);
+                    }
+                }
+            }
+            for(int mi=0; mi<GEMM_MR; mi++) {
+                for(int ni=0; ni<8; ni++) {
+                    C[(m0+mi)*ldc+n0+ni] = (int32_t) acc[mi][ni];
+                }
+            }
+        }
+    }
+}
+
+#ifdef FASTCONV_SIMD
+
+static inline int32_t gemm16_pair(const int16_t *a) {
+    int32_t p;
+    memcpy(&p, a, sizeof(p));
+    return p;
+}
+
+__attribute__((target("avx2")))
+static void gemm16_avx2(const int16_t *__restrict__ Ap, const int16_t *__restrict__ Bp, int32_t *__restrict__ C, int M, int N, int k2, int ldc) {
+    const int nr = 24;
+    for(int n0=0; n0<N; n0+=nr) {
+        for(int m0=0; m0<M; m0+=GEMM_MR) {
+            const int16_t *a = Ap + (size_t) m0*k2;
+            const int16_t *b = Bp + (size_t) n0*k2;
+            __m256i c[GEMM_MR][3];
+            for(int mi=0; mi<GEMM_MR; mi++) {
+                c[mi][0] = c[mi][1] = c[mi][2] = _mm256_setzero_si256();
+            }
+            for(int kp=0; kp<k2/2; kp++) {
+                __m256i b0 = _mm256_load_si256((__m256i *) (b + kp*nr*2));
+                __m256i b1 = _mm256_load_si256((__m256i *) (b + kp*nr*2 + 16));
+                __m256i b2 = _mm256_load_si256((__m256i *) (b + kp*nr*2 + 32));
+                for(int mi=0; mi<GEMM_MR; mi++) {
+                    __m256i av = _mm256_set1_epi32(gemm16_pair(a + kp*GEMM_MR*2 + mi*2));
+                    c[mi][0] = _mm256_add_epi32(c[mi][0], _mm256_madd_epi16(av, b0));
+                    c[mi][1] = _mm256_add_epi32(c[mi][1], _mm256_madd_epi16(av, b1));
+                    c[mi][2] = _mm256_add_epi32(c[mi][2], _mm256_madd_epi16(av, b2));
+                }
+            }
+            for(int mi=0; mi<GEMM_MR; mi++) {
+                _mm256_storeu_si256((__m256i *) (C + (m0+mi)*ldc + n0),      c[mi][0]);
+                _mm256_storeu_si256((__m256i *) (C + (m0+mi)*ldc + n0 + 8),  c[mi][1]);
+                _mm256_storeu_si256((__m256i *) (C + (m0+mi)*ldc + n0 + 16), c[mi][2]);
+            }
+        }
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void gemm16_avx512(const int16_t *__restrict__ Ap, const int16_t *__restrict__ Bp, int32_t *__restrict__ C, int M, int N, int k2, int ldc) {
+    const int nr = 48;
+    for(int n0=0; n0<N; n0+=nr) {
+        for(int m0=0; m0<M; m0+=GEMM_MR) {
+            const int16_t *a = Ap + (size_t) m0*k2;
+            const int16_t *b = Bp + (size_t) n0*k2;
+            __m512i c[GEMM_MR][3];
+            for(int mi=0; mi<GEMM_MR; mi++) {
+                c[mi][0] = c[mi][1] = c[mi][2] = _mm512_setzero_si512();
+            }
+            for(int kp=0; kp<k2/2; kp++) {
+                __m512i b0 = _mm512_load_si512(b + kp*nr*2);
+                __m512i b1 = _mm512_load_si512(b + kp*nr*2 + 32);
+                __m512i b2 = _mm512_load_si512(b + kp*nr*2 + 64);
+                for(int mi=0; mi<GEMM_MR; mi++) {
+                    __m512i av = _mm512_set1_epi32(gemm16_pair(a + kp*GEMM_MR*2 + mi*2));
+                    c[mi][0] = _mm512_add_epi32(c[mi][0], _mm512_madd_epi16(av, b0));
+                    c[mi][1] = _mm512_add_epi32(c[mi][1], _mm512_madd_epi16(av, b1));
+                    c[mi][2] = _mm512_add_epi32(c[mi][2], _mm512_madd_epi16(av, b2));
+                }
+            }
+            for(int mi=0; mi<GEMM_MR; mi++) {
+                _mm512_storeu_si512(C + (m0+mi)*ldc + n0,      c[mi][0]);
+                _mm512_storeu_si512(C + (m0+mi)*ldc + n0 + 16, c[mi][1]);
+                _mm512_storeu_si512(C + (m0+mi)*ldc + n0 + 32, c[mi][2]);
+            }
+        }
+    }
+}
+
+#endif /* FASTCONV_SIMD */
+
+/**
+ *  C = A B for packed A[M][K] and B[K][N]; C has round_up(M,GEMM_MR) rows
+ *  of ldc >= round_up(N,nr) columns, the padding is overwritten.
+ */
+static void gemm16(const int16_t *Ap, const int16_t *Bp, int32_t *C, int M, int N, int k2, int ldc, int isa) {
+#ifdef FASTCONV_SIMD
+    if(isa == 2) {
+        gemm16_avx512(Ap, Bp, C, M, N, k2, ldc);
+        return;
+    }
+    if(isa == 1) {
+        gemm16_avx2(Ap, Bp, C, M, N, k2, ldc);
+        return;
+    }
+#endif /* FASTCONV_SIMD */
+    gemm16_ref(Ap, Bp, C, M, N, k2, ldc);
+}
+
+// y += v, with the wrap-around or saturation of the direct convolution
+static inline data_t fastconv_acc(data_t y, int32_t v) {
+#if defined(FULL_PRECISION) && !defined(DONT_SATURATE)
+    v += y;
+    if(v > +32767)
+        v = 32767;
+    else if(v < -32768)
+        v = -32768;
+    return v;
+#else
+    return (data_t) (y + v);
+#endif
+}
+
+static inline int32_t fastconv_shift(int32_t v, int s) {
+    return s >= 0 ? v >> s : (int32_t) ((uint32_t) v << -s);
+}
+
+// number of bits of |v|
+static inline int bitlen(uint32_t v) {
+    int n = 0;
+    while(v) {
+        n++;
+        v >>= 1;
+    }
+    return n;
+}
+
+/**
+ *  @brief Prepares the weights W[nof][nif][fs][fs] for a backend.
+ *
+ *  GEMM packs them as A[nof][nif*fs*fs]. Winograd transforms them to U and
+ *  packs one A[nof][nif] per transformed point. Returns NULL if the backend
+ *  does not support the filter size.
+ */
+FastConv *FastConv_new(int algo, data_t *W, int fs, int nof, int nif) {
+    FastConv *conv = ccn_malloc(sizeof(FastConv));
+    conv->algo = algo;
+    conv->fs = fs;
+    conv->nof = nof;
+    conv->nif = nif;
+
+    if(algo == CONV_GEMM) {
+        int k = nif*fs*fs;
+        conv->k2 = round_up(k, 2);
+        conv->Wp = fastconv_alloc(sizeof(int16_t)*round_up(nof, GEMM_MR)*conv->k2, &conv->raw);
+        memset(conv->Wp, 0, sizeof(int16_t)*round_up(nof, GEMM_MR)*conv->k2);
+        // flipped taps: y[i][j] += sum W[a][b][fs-1-u][fs-1-v] x[b][i+u][j+v]
+        for(int a=0; a<nof; a++) {
+            for(int b=0; b<nif; b++) {
+                for(int u=0; u<fs; u++) {
+                    for(int v=0; v<fs; v++) {
+                        conv->Wp[gemm16_a(a, (b*fs+u)*fs+v, conv->k2)] = W[((a*nif+b)*fs+(fs-1-u))*fs+(fs-1-v)];
+                    }
+                }
+            }
+        }
+        return conv;
+    }
+
+    const double *G;
+    if(algo == CONV_WINOGRAD && fs == 3) {
+        conv->m = 2;
+        G = wino_g23;
+    }
+    else if(algo == CONV_WINOGRAD4 && fs == 3) {
+        conv->m = 4;
+        G = wino_g43;
+    }
+    else if(algo == CONV_WINOGRAD && fs == 5) {
+        conv->m = 2;
+        G = wino_g25;
+    }
+    else {
+        ccn_free(conv);
+        return NULL;
+    }
+    int alpha = conv->alpha = conv->m+fs-1;
+    int na = alpha*alpha;
+    size_t size = (size_t) round_up(nof, GEMM_MR)*round_up(nif, 2);
+    conv->k2 = round_up(nif, 2);
+
+    // U = G g G^T of the flipped filters, then the scale for WINO_UBITS;
+    // per point, as the rows of G differ by up to 24x in magnitude
+    double *U = ccn_malloc(sizeof(double)*na*nof*nif);
+    double umax[6*6] = {0.0};
+    for(int a=0; a<nof; a++) {
+        for(int b=0; b<nif; b++) {
+            double t[6*5];
+            data_t *g = W + (a*nif+b)*fs*fs;
+            for(int i=0; i<alpha; i++) {
+                for(int v=0; v<fs; v++) {
+                    double s = 0.0;
+                    for(int u=0; u<fs; u++)
+                        s += G[i*fs+u] * g[(fs-1-u)*fs+(fs-1-v)];
+                    t[i*fs+v] = s;
+                }
+            }
+            for(int i=0; i<alpha; i++) {
+                for(int j=0; j<alpha; j++) {
+                    double s = 0.0;
+                    for(int v=0; v<fs; v++)
+                        s += t[i*fs+v] * G[j*fs+v];
+                    U[((size_t) (i*alpha+j)*nof+a)*nif+b] = s;
+                    if(fabs(s) > umax[i*alpha+j])
+                        umax[i*alpha+j] = fabs(s);
+                }
+            }
+        }
+    }
+    conv->Wp = fastconv_alloc(sizeof(int16_t)*na*size, &conv->raw);
+    memset(conv->Wp, 0, sizeof(int16_t)*na*size);
+    for(int p=0; p<na; p++) {
+        conv->shift[p] = bitlen((uint32_t) ceil(umax[p])) - WINO_UBITS;
+        for(int a=0; a<nof; a++) {
+            for(int b=0; b<nif; b++) {
+                conv->Wp[p*size + gemm16_a(a, b, conv->k2)] = (int16_t) lrint(ldexp(U[((size_t) p*nof+a)*nif+b], -conv->shift[p]));
+            }
+        }
+    }
+    ccn_free(U);
+    return conv;
+}
+
+void FastConv_delete(FastConv *conv) {
+    if(conv == NULL)
+        return;
+    free(conv->raw);
+    ccn_free(conv);
+}
+
+// im2col of the n output pixels from p0 on, straight into the packed layout
+// of B[k2][n] and in its order; the padding of N is never read
+static void fastconv_im2col(FastConv *conv, const data_t *x, int16_t *Bp, int h, int w, int p0, int n, int nr) {
+    int fs = conv->fs, nif = conv->nif, k2 = conv->k2;
+    int ow = w-fs+1;
+
+    // the offsets of the taps in x and of the output pixels
+    int *koff = fastconv_scratch(2, sizeof(int)*(k2+n));
+    int *noff = koff + k2;
+    for(int b=0; b<nif; b++) {
+        for(int u=0; u<fs; u++) {
+            for(int v=0; v<fs; v++) {
+                koff[(b*fs+u)*fs+v] = (b*h+u)*w+v;
+            }
+        }
+    }
+    if(k2 > nif*fs*fs)
+        koff[k2-1] = koff[k2-2];    // meets zero weights
+    for(int q=0; q<n; q++) {
+        noff[q] = (p0+q)/ow*w + (p0+q)%ow;
+    }
+    for(int n0=0; n0<n; n0+=nr) {
+        int nn = n-n0 < nr ? n-n0 : nr;
+        int16_t *Bn = Bp + (size_t) n0*k2;
+        for(int k=0; k<k2; k+=2) {
+            const data_t *x0 = x + koff[k], *x1 = x + koff[k+1];
+            for(int ni=0; ni<nn; ni++) {
+                Bn[ni*2]   = x0[noff[n0+ni]];
+                Bn[ni*2+1] = x1[noff[n0+ni]];
+            }
+            Bn += nr*2;
+        }
+    }
+}
+
+/*
+ * PARALLEL_FEAT: the threads build B together, then each multiplies its
+ * blocks of GEMM_MR output maps. PARALLEL_PIXEL: each builds B for its rows
+ * of output pixels and multiplies all of A with it.
+ */
+static void fastconv_gemm(FastConv *conv, data_t *x, data_t *y, int h, int w, int parallel_type, unsigned qf, int isa) {
+    int fs = conv->fs, nof = conv->nof, k2 = conv->k2;
+    int oh = h-fs+1, ow = w-fs+1, N = oh*ow;
+    int nr = gemm16_nr(isa);
+    int ldc = round_up(N, nr);
+    int nunit = parallel_type == PARALLEL_FEAT ? (nof+GEMM_MR-1)/GEMM_MR : oh;
+    // shared by the threads with PARALLEL_FEAT
+    int16_t *Bp = parallel_type == PARALLEL_FEAT ? fastconv_scratch(0, sizeof(int16_t)*ldc*k2) : NULL;
+
+    #pragma omp parallel if(nunit > 1)
+    {
+        int lo, hi;
+        if(parallel_type == PARALLEL_FEAT) {
+            linalg_thread_range((N+nr-1)/nr, &lo, &hi);
+            if(hi > lo)
+                fastconv_im2col(conv, x, Bp + (size_t) lo*nr*k2, h, w, lo*nr, (hi*nr < N ? hi*nr : N) - lo*nr, nr);
+            #pragma omp barrier
+
+            linalg_thread_range(nunit, &lo, &hi);
+            int a0 = lo*GEMM_MR, a1 = hi*GEMM_MR < nof ? hi*GEMM_MR : nof;
+            if(a1 > a0) {
+                int32_t *C = fastconv_scratch(1, sizeof(int32_t)*round_up(a1-a0, GEMM_MR)*ldc);
+                gemm16(conv->Wp + (size_t) a0*k2, Bp, C, a1-a0, N, k2, ldc, isa);
+                for(int a=a0; a<a1; a++) {
+                    for(int n=0; n<N; n++) {
+                        y[a*N+n] = fastconv_acc(y[a*N+n], C[(a-a0)*ldc+n] >> qf);
+                    }
+                }
+            }
+        }
+        else {
+            linalg_thread_range(nunit, &lo, &hi);
+            int p0 = lo*ow, n = (hi-lo)*ow;
+            if(n > 0) {
+                int ldn = round_up(n, nr);
+                int16_t *Bn = fastconv_scratch(0, sizeof(int16_t)*ldn*k2);
+                int32_t *C = fastconv_scratch(1, sizeof(int32_t)*round_up(nof, GEMM_MR)*ldn);
+                fastconv_im2col(conv, x, Bn, h, w, p0, n, nr);
+                gemm16(conv->Wp, Bn, C, nof, n, k2, ldn, isa);
+                for(int a=0; a<nof; a++) {
+                    for(int q=0; q<n; q++) {
+                        y[a*N+p0+q] = fastconv_acc(y[a*N+p0+q], C[a*ldn+q] >> qf);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * The 1d transforms out[i*so] = sum_k T[i][k] in[k*si] by B^T or A^T, on
+ * WINO_TB tiles at a time, the tile innermost, so that they vectorise.
+ */
+typedef int32_t wino_vec[WINO_TB];
+
+static inline void wino_bt_1d(int alpha, const wino_vec *in, int si, wino_vec *out, int so) {
+    if(alpha == 4) {
+        for(int tt=0; tt<WINO_TB; tt++) {
+            int32_t d0 = in[0][tt], d1 = in[si][tt], d2 = in[2*si][tt], d3 = in[3*si][tt];
+            out[0][tt]    = d2 - d0;
+            out[so][tt]   = d1 + d2;
+            out[2*so][tt] = d2 - d1;
+            out[3*so][tt] = d3 - d1;
+        }
+        return;
+    }
+    for(int tt=0; tt<WINO_TB; tt++) {
+        int32_t d0 = in[0][tt], d1 = in[si][tt], d2 = in[2*si][tt];
+        int32_t d3 = in[3*si][tt], d4 = in[4*si][tt], d5 = in[5*si][tt];
+        out[0][tt]    = 4*d0 - 5*d2 + d4;
+        out[so][tt]   = -4*(d1 + d2) + d3 + d4;
+        out[2*so][tt] = 4*(d1 - d2) - d3 + d4;
+        out[3*so][tt] = 2*(d3 - d1) - d2 + d4;
+        out[4*so][tt] = 2*(d1 - d3) - d2 + d4;
+        out[5*so][tt] = 4*d1 - 5*d3 + d5;
+    }
+}
+
+static inline void wino_at_1d(int m, int alpha, const wino_vec *in, int si, wino_vec *out, int so) {
+    if(alpha == 4) {
+        for(int tt=0; tt<WINO_TB; tt++) {
+            int32_t m0 = in[0][tt], m1 = in[si][tt], m2 = in[2*si][tt], m3 = in[3*si][tt];
+            out[0][tt]  = m0 + m1 + m2;
+            out[so][tt] = m1 - m2 + m3;
+        }
+        return;
+    }
+    for(int tt=0; tt<WINO_TB; tt++) {
+        int32_t m0 = in[0][tt], m1 = in[si][tt], m2 = in[2*si][tt];
+        int32_t m3 = in[3*si][tt], m4 = in[4*si][tt], m5 = in[5*si][tt];
+        int32_t p12 = m1 + m2, n12 = m1 - m2, p34 = m3 + m4, n34 = m3 - m4;
+        out[0][tt]  = m0 + p12 + p34;
+        if(m == 2) {
+            out[so][tt] = n12 + 2*n34 + m5;
+        }
+        else {
+            out[so][tt]   = n12 + 2*n34;
+            out[2*so][tt] = p12 + 4*p34;
+            out[3*so][tt] = n12 + 8*n34 + m5;
+        }
+    }
+}
+
+// V = B^T d B
+static void wino_input(int alpha, const wino_vec *d, wino_vec *V) {
+    wino_vec t[6*6];
+    for(int j=0; j<alpha; j++)
+        wino_bt_1d(alpha, d+j, alpha, t+j, alpha);
+    for(int i=0; i<alpha; i++)
+        wino_bt_1d(alpha, t+i*alpha, 1, V+i*alpha, 1);
+}
+
+// Y = A^T M A
+static void wino_output(int m, int alpha, const wino_vec *M, wino_vec *Y) {
+    wino_vec t[4*6];
+    for(int j=0; j<alpha; j++)
+        wino_at_1d(m, alpha, M+j, alpha, t+j, alpha);
+    for(int i=0; i<m; i++)
+        wino_at_1d(m, alpha, t+i*alpha, 1, Y+i*m, 1);
+}
+
+/*
+ * The threads share the tile blocks for the input transform, the points for
+ * the GEMMs, and for the output transform the output maps (PARALLEL_FEAT) or
+ * the tile blocks (PARALLEL_PIXEL).
+ */
+static void fastconv_winograd(FastConv *conv, data_t *x, data_t *y, int h, int w, int parallel_type, unsigned qf, int isa) {
+    int fs = conv->fs, nof = conv->nof, nif = conv->nif, k2 = conv->k2;
+    int m = conv->m, alpha = conv->alpha, na = alpha*alpha;
+    int oh = h-fs+1, ow = w-fs+1;
+    int th = (oh+m-1)/m, tw = (ow+m-1)/m, T = th*tw;
+    int nr = gemm16_nr(isa);
+    int ldc = round_up(T, nr);
+    int mp = round_up(nof, GEMM_MR);
+    int ntb = (T+WINO_TB-1)/WINO_TB;
+    int32_t *V = fastconv_scratch(2, sizeof(int32_t)*na*nif*T);
+    int16_t *Bp = fastconv_scratch(0, sizeof(int16_t)*na*ldc*k2);
+    int32_t *M = fastconv_scratch(1, sizeof(int32_t)*na*mp*ldc);
+    uint32_t vmax[6*6] = {0};
+    int sv[6*6];
+
+    #pragma omp parallel if(ntb > 1)
+    {
+        wino_vec d[6*6], Vt[6*6];
+
+        // input transform of the alpha*alpha tiles to V[na][nif][T], zero beyond
+        // the borders
+        uint32_t vmax_t[6*6] = {0};
+        #pragma omp for
+        for(int t0=0; t0<T; t0+=WINO_TB) {
+            int n = T-t0 < WINO_TB ? T-t0 : WINO_TB;
+            int r0[WINO_TB], c0[WINO_TB];
+            for(int tt=0; tt<WINO_TB; tt++) {
+                r0[tt] = tt < n ? (t0+tt)/tw*m : h;
+                c0[tt] = (t0+tt)%tw*m;
+            }
+            for(int b=0; b<nif; b++) {
+                const data_t *xb = x + b*h*w;
+                for(int i=0; i<alpha; i++) {
+                    for(int j=0; j<alpha; j++) {
+                        for(int tt=0; tt<WINO_TB; tt++) {
+                            int r = r0[tt]+i, c = c0[tt]+j;
+                            d[i*alpha+j][tt] = (r < h && c < w) ? xb[r*w+c] : 0;
+                        }
+                    }
+                }
+                wino_input(alpha, d, Vt);
+                for(int p=0; p<na; p++) {
+                    int32_t *Vp = V + ((size_t) p*nif+b)*T + t0;
+                    for(int tt=0; tt<n; tt++) {
+                        uint32_t v = Vt[p][tt] < 0 ? -(uint32_t) Vt[p][tt] : (uint32_t) Vt[p][tt];
+                        vmax_t[p] |= v;   // the bit length of the maximum
+                        Vp[tt] = Vt[p][tt];
+                    }
+                }
+            }
+        }
+        #pragma omp critical
+        for(int p=0; p<na; p++) {
+            vmax[p] |= vmax_t[p];
+        }
+        #pragma omp barrier
+
+        // requantise V to WINO_VBITS per point, rounding, and pack a B[nif][T]
+        // per point; the padding of K meets zero weights, that of N is never read
+        #pragma omp for
+        for(int p=0; p<na; p++) {
+            sv[p] = bitlen(vmax[p]) - WINO_VBITS;
+            if(sv[p] < 0)
+                sv[p] = 0;
+            int32_t half = sv[p] ? 1 << (sv[p]-1) : 0;
+            int16_t *Bn = Bp + (size_t) p*ldc*k2;
+            for(int t0=0; t0<T; t0+=nr) {
+                int n = T-t0 < nr ? T-t0 : nr;
+                for(int b=0; b<k2; b+=2) {
+                    const int32_t *V0 = V + ((size_t) p*nif+b)*T + t0;
+                    const int32_t *V1 = b+1 < nif ? V0 + T : V0;
+                    for(int t=0; t<n; t++) {
+                        Bn[t*2]   = (V0[t] + half) >> sv[p];
+                        Bn[t*2+1] = (V1[t] + half) >> sv[p];
+                    }
+                    Bn += nr*2;
+                }
+            }
+            gemm16(conv->Wp + (size_t) p*mp*k2, Bp + (size_t) p*ldc*k2, M + (size_t) p*mp*ldc, nof, T, k2, ldc, isa);
+        }
+
+        // requantise M to qf, output transform
+        int lo, hi, a0 = 0, a1 = nof, tb0 = 0, tb1 = ntb;
+        if(parallel_type == PARALLEL_FEAT) {
+            linalg_thread_range(nof, &lo, &hi);
+            a0 = lo;
+            a1 = hi;
+        }
+        else {
+            linalg_thread_range(ntb, &tb0, &tb1);
+        }
+        for(int a=a0; a<a1; a++) {
+            for(int t0=tb0*WINO_TB; t0<T && t0<tb1*WINO_TB; t0+=WINO_TB) {
+                int n = T-t0 < WINO_TB ? T-t0 : WINO_TB;
+                wino_vec *Mt = d, *Y = Vt;
+                for(int p=0; p<na; p++) {
+                    const int32_t *Mp = M + ((size_t) p*mp+a)*ldc + t0;
+                    int s = qf - conv->shift[p] - sv[p];
+                    for(int tt=0; tt<WINO_TB; tt++)
+                        Mt[p][tt] = tt < n ? fastconv_shift(Mp[tt], s) : 0;
+                }
+                wino_output(m, alpha, Mt, Y);
+                for(int tt=0; tt<n; tt++) {
+                    int ti = (t0+tt)/tw, tj = (t0+tt)%tw;
+                    for(int i=0; i<m && ti*m+i<oh; i++) {
+                        for(int j=0; j<m && tj*m+j<ow; j++) {
+                            data_t *yp = y + (a*oh+ti*m+i)*ow+tj*m+j;
+                            *yp = fastconv_acc(*yp, Y[i*m+j][tt]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ *  @brief Adds the convolution of x[nif][h][w] with the prepared weights to
+ *  y[nof][h-fs+1][w-fs+1], on the OpenMP threads split as by parallel_type
+ *  (see linalg_parallel_choose).
+ */
+void FastConv_exec(FastConv *conv, data_t *x, data_t *y, int h, int w, int parallel_type, unsigned qf) {
+    int isa = linalg_simd_isa();
+    if(conv->algo == CONV_GEMM)
+        fastconv_gemm(conv, x, y, h, w, parallel_type, qf, isa);
+    else
+        fastconv_winograd(conv, x, y, h, w, parallel_type, qf, isa);
+}
+
+/**
+ *  @brief Picks the backend for a layer tile of nif input and nof output maps
+ *  of oh*ow pixels, filter size fs.
+ *
+ *  From the CIFAR-10 layers on one Xeon core: with AVX-512 the GEMM beats
+ *  the direct kernel by 10-20%, with AVX2 the direct kernel wins by about as
+ *  much; without SIMD (or off x86) the GEMM and Winograd F(2x2) are 3-6x
+ *  faster than the direct loops, Winograd from about 16 input maps on.
+ *  Against the exact sums (nif 32, qf 12) the GEMM is off by 1 LSB, the
+ *  direct kernel by 22, F(2x2,3x3) by 7, but F(2x2,5x5) by 66 and
+ *  F(4x4,3x3) by 111: only F(2x2,3x3) is ever chosen, the others only
+ *  when set as the layer's conv_algo (cnn-infer -c).
+ */
+int FastConv_choose(int fs, int nof, int nif, int oh, int ow) {
+    int isa = linalg_simd_isa();
+    if(nof <= 0 || oh <= 0 || ow <= 0)
+        return CONV_DIRECT;
+    if(isa == 2)
+        return CONV_GEMM;
+    if(isa == 1)
+        return CONV_DIRECT;
+    if(fs == 3 && nif >= 16)
+        return CONV_WINOGRAD;
+    return CONV_GEMM;
+}
+
+/**
+ *  @brief Tells if the backend algo computes filters of size fs: Winograd
+ *  F(2x2) only 3x3 and 5x5, F(4x4) only 3x3 ones.
+ */
+int FastConv_supports(int algo, int fs) {
+    if(algo == CONV_WINOGRAD)
+        return fs == 3 || fs == 5;
+    if(algo == CONV_WINOGRAD4)
+        return fs == 3;
+    return 1;
+}
@@ -0,0 +1,32 @@
+/*
+ * fastconv.h
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef FASTCONV_H
+#define FASTCONV_H
+
+#ifndef TYPES_H
+#include "types.h"
+#endif
+
+/**
+ *  A convolution with prepared (packed or transformed) weights, computed by
+ *  one of the alternative backends CONV_GEMM, CONV_WINOGRAD or
+ *  CONV_WINOGRAD4. Like linalg_2dconv_nof it adds the convolution of x with
+ *  the nof*nif filters of size fs to y, but it shifts by qf once per output
+ *  pixel rather than once per input feature map, so results may differ from
+ *  the direct convolution in the last bits.
+ */
+typedef struct FastConv FastConv;
+
+FastConv *FastConv_new(int algo, data_t *W, int fs, int nof, int nif);
+void FastConv_delete(FastConv *conv);
+void FastConv_exec(FastConv *conv, data_t *x, data_t *y, int h, int w, int parallel_type, unsigned qf);
+int  FastConv_choose(int fs, int nof, int nif, int oh, int ow);
+int  FastConv_supports(int algo, int fs);
+
+#endif /* FASTCONV_H */
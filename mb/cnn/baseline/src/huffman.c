@@ -1,4 +1,4 @@
-/* 
+/*
  * huffman.c
  * Francesco Conti <f.conti@unibo.it>
  *
@@ -9,9 +9,437 @@
  * of the BSD license.  See the LICENSE file for details.
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include "huffman.h"
 
-int huffman_decode(
+/*
+ * Entries of a huffman_table: the nsym codes that fit in a root index, of
+ * len bits in all and len1 bits for the first, decode to
+ *   len | nsym << 8 | len1 << 16 | symbols << 32
+ * with the first symbol in bits 32..39 and up to HUFFMAN_LUT_SYMS of them
+ * (nsym 0 if no code starts with these bits). A root prefix continuing into
+ * a second-level table of 2^subbits entries at sub[offset] is
+ *   subbits | HUFFMAN_LINK | offset << 32
+ * and the second-level entries hold one code each, with its full length.
+ * Like the stream, the codes are read from bit 0 on.
+ */
+#define HUFFMAN_LUT_SYMS 4
+#define HUFFMAN_LINK     (1ull << 24)
+
+static int huffman_table_build(
+    huffman_table       *table,
+    const unsigned char lengths[MAX_SYMBOLS],
+    const uint32_t      codes[MAX_SYMBOLS]
+) {
+    const int k = HUFFMAN_LUT_BITS;
+    const uint32_t kmask = (1u << k) - 1;
+    unsigned char subbits[1 << HUFFMAN_LUT_BITS];
+    uint32_t suboff[1 << HUFFMAN_LUT_BITS];
+    uint16_t single[1 << HUFFMAN_LUT_BITS];
+    uint32_t nsub = 0;
+
+    memset(table->lut, 0, sizeof(table->lut));
+    memset(subbits, 0, sizeof(subbits));
+    memset(single, 0, sizeof(single));
+    table->sub = NULL;
+    table->max_bits = 0;
+
+    // size the second-level tables by the longest code of each root prefix
+    for(int s=0; s<MAX_SYMBOLS; s++) {
+        int len = lengths[s];
+        if(len > HUFFMAN_MAX_BITS)
+            return 1;
+        if(len > table->max_bits)
+            table->max_bits = len;
+        if(len > k && len-k > subbits[codes[s] & kmask])
+            subbits[codes[s] & kmask] = len-k;
+    }
+    for(uint32_t p=0; p<=kmask; p++) {
+        suboff[p] = nsub;
+        if(subbits[p])
+            nsub += 1u << subbits[p];
+    }
+    if(nsub > 0) {
+        table->sub = (uint64_t *) calloc(nsub, sizeof(uint64_t));
+        if(table->sub == NULL)
+            return 1;
+    }
+
+    // every code fills the entries of all the bit strings it is a prefix of;
+    // single[] holds the one code of each root index, as len | symbol << 8
+    for(int s=0; s<MAX_SYMBOLS; s++) {
+        int len = lengths[s];
+        if(len == 0) {
+            continue;
+        }
+        else if(len <= k) {
+            for(uint32_t j=0; j < 1u << (k-len); j++)
+                single[codes[s] | j << len] = len | s << 8;
+        }
+        else {
+            uint32_t p = codes[s] & kmask;
+            for(uint32_t j=0; j < 1u << (subbits[p]-(len-k)); j++)
+                table->sub[suboff[p] + ((codes[s] >> k) | j << (len-k))] = len | 1 << 8 | len << 16 | (uint64_t) s << 32;
+        }
+    }
+
+    // a root entry takes as many codes as lie entirely within its k bits
+    for(uint32_t p=0; p<=kmask; p++) {
+        if(subbits[p]) {
+            table->lut[p] = subbits[p] | HUFFMAN_LINK | (uint64_t) suboff[p] << 32;
+            continue;
+        }
+        int len = 0, nsym = 0;
+        uint64_t syms = 0;
+        while(nsym < HUFFMAN_LUT_SYMS && len < k) {
+            int l = single[p >> len] & 0xff;
+            if(l == 0 || len+l > k)
+                break;
+            syms |= (uint64_t) (single[p >> len] >> 8) << (8*nsym);
+            len += l;
+            nsym++;
+        }
+        if(nsym)
+            table->lut[p] = len | nsym << 8 | (single[p] & 0xff) << 16 | syms << 32;
+    }
+    return 0;
+}
+
+// bit i of x becomes bit len-1-i
+static uint32_t reverse_code(
+    uint32_t x,
+    int      len
+) {
+    uint32_t r = 0;
+    for(int i=0; i<len; i++) {
+        r = r << 1 | (x & 1);
+        x >>= 1;
+    }
+    return r;
+}
+
+/*
+ * Assigns the canonical code of the given lengths: shorter codes first, and
+ * by symbol among codes of the same length. As in DEFLATE, the most
+ * significant bit of a code comes first in the stream.
+ */
+static int canonical_codes(
+    const unsigned char lengths[MAX_SYMBOLS],
+    uint32_t            codes[MAX_SYMBOLS]
+) {
+    int count[HUFFMAN_MAX_BITS+1];
+    uint32_t next[HUFFMAN_MAX_BITS+1];
+    long left = 1;
+
+    memset(count, 0, sizeof(count));
+    for(int s=0; s<MAX_SYMBOLS; s++) {
+        if(lengths[s] > HUFFMAN_MAX_BITS)
+            return 1;
+        count[lengths[s]]++;
+    }
+    count[0] = 0;
+
+    // the lengths must not over-subscribe the code space
+    uint32_t code = 0;
+    for(int bits=1; bits<=HUFFMAN_MAX_BITS; bits++) {
+        left = (left << 1) - count[bits];
+        if(left < 0)
+            return 1;
+        code = (code + count[bits-1]) << 1;
+        next[bits] = code;
+    }
+    for(int s=0; s<MAX_SYMBOLS; s++) {
+        codes[s] = lengths[s] ? reverse_code(next[lengths[s]]++, lengths[s]) : 0;
+    }
+    return 0;
+}
+
+/*
+ * Builds the decoding tables of the canonical code with the given lengths in
+ * bits per symbol (0 for symbols that do not occur). Returns 0 on success, 1
+ * if the lengths do not form a prefix code or exceed HUFFMAN_MAX_BITS.
+ */
+int huffman_table_init(
+    huffman_table       *table,
+    const unsigned char lengths[MAX_SYMBOLS]
+) {
+    uint32_t codes[MAX_SYMBOLS];
+    table->sub = NULL;
+    if(canonical_codes(lengths, codes))
+        return 1;
+    return huffman_table_build(table, lengths, codes);
+}
+
+void huffman_table_free(
+    huffman_table *table
+) {
+    free(table->sub);
+    table->sub = NULL;
+}
+
+// tops up the bit buffer to at least 56 bits, or to the end of the stream
+static inline void huffman_refill(
+    const unsigned char *buf,
+    size_t              buf_len,
+    size_t              *pos,
+    uint64_t            *acc,
+    int                 *nbits
+) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if(*pos + 8 <= buf_len) {
+        uint64_t v;
+        memcpy(&v, buf + *pos, sizeof(v));
+        *acc |= v << *nbits;
+        *pos += (63 - *nbits) >> 3;
+        *nbits |= 56;
+        return;
+    }
+#endif
+    while(*nbits <= 56 && *pos < buf_len) {
+        *acc |= (uint64_t) buf[(*pos)++] << *nbits;
+        *nbits += 8;
+    }
+}
+
+/*
+ * Decodes decoded_len symbols into decoded_buf, starting at bit *bitpos of
+ * encoded_buf, and advances *bitpos past them; it allocates nothing, so
+ * independently coded tiles can be decoded straight into local buffers. Every
+ * step resolves up to HUFFMAN_LUT_BITS bits, i.e. up to HUFFMAN_LUT_SYMS short
+ * codes, with one table lookup, or a longer code with two. Returns the number of symbols decoded, less than decoded_len
+ * if the stream ends or holds a bit string that is not a code.
+ */
+size_t huffman_table_decode(
+    const huffman_table *table,
+    const unsigned char *encoded_buf,
+    size_t              encoded_buf_len,
+    size_t              *bitpos,
+    unsigned char       *decoded_buf,
+    size_t              decoded_len
+) {
+    const uint32_t kmask = (1u << HUFFMAN_LUT_BITS) - 1;
+    size_t pos = *bitpos >> 3;
+    int skip = *bitpos & 7;
+    uint64_t acc = 0;
+    int nbits = 0;
+    size_t i;
+
+    if(pos >= encoded_buf_len)
+        return 0;
+    huffman_refill(encoded_buf, encoded_buf_len, &pos, &acc, &nbits);
+    acc >>= skip;
+    nbits -= skip;
+
+    for(i=0; i<decoded_len; ) {
+        if(nbits < HUFFMAN_MAX_BITS)
+            huffman_refill(encoded_buf, encoded_buf_len, &pos, &acc, &nbits);
+        uint64_t e = table->lut[acc & kmask];
+        if(e & HUFFMAN_LINK)
+            e = table->sub[(e >> 32) + ((acc >> HUFFMAN_LUT_BITS) & ((1u << (e & 0xff)) - 1))];
+        int nsym = (e >> 8) & 0xff;
+        int len = e & 0xff;
+        uint32_t syms = e >> 32;
+        if(len > nbits || i+nsym > decoded_len) {
+            // only the first code is in the stream, or wanted
+            nsym = nsym ? 1 : 0;
+            len = (e >> 16) & 0xff;
+        }
+        if(nsym == 0 || len > nbits)
+            break;
+        if(i+HUFFMAN_LUT_SYMS <= decoded_len) {
+            decoded_buf[i]   = (unsigned char) syms;
+            decoded_buf[i+1] = (unsigned char) (syms >> 8);
+            decoded_buf[i+2] = (unsigned char) (syms >> 16);
+            decoded_buf[i+3] = (unsigned char) (syms >> 24);
+        }
+        else {
+            for(int j=0; j<nsym; j++)
+                decoded_buf[i+j] = (unsigned char) (syms >> (8*j));
+        }
+        i += nsym;
+        acc >>= len;
+        nbits -= len;
+    }
+    *bitpos = pos*8 - nbits;
+    return i;
+}
+
+/*
+ * Computes the lengths of a Huffman code for the given symbol frequencies,
+ * limited to max_bits by flattening the frequencies until the code fits.
+ * Symbols of frequency 0 get no code. Returns 0 on success.
+ */
+int huffman_lengths(
+    const unsigned long freq[MAX_SYMBOLS],
+    unsigned char       lengths[MAX_SYMBOLS],
+    int                 max_bits
+) {
+    unsigned long weight[2*MAX_SYMBOLS];
+    int parent[2*MAX_SYMBOLS];
+    int symbol[MAX_SYMBOLS];
+    int n = 0;
+
+    memset(lengths, 0, MAX_SYMBOLS);
+    for(int s=0; s<MAX_SYMBOLS; s++) {
+        if(freq[s]) {
+            symbol[n] = s;
+            weight[n] = freq[s];
+            n++;
+        }
+    }
+    if(n == 0)
+        return 0;
+    if(n == 1) {
+        lengths[symbol[0]] = 1;
+        return 0;
+    }
+    if(max_bits > HUFFMAN_MAX_BITS || (1 << max_bits) < n)
+        return 1;
+
+    for(;;) {
+        // merge the two lightest live nodes until one is left
+        int nodes = n;
+        for(int i=0; i<2*n; i++)
+            parent[i] = -1;
+        for(int m=0; m<n-1; m++) {
+            int a = -1, b = -1;
+            for(int i=0; i<nodes; i++) {
+                if(parent[i] >= 0)
+                    continue;
+                if(a < 0 || weight[i] < weight[a]) {
+                    b = a;
+                    a = i;
+                }
+                else if(b < 0 || weight[i] < weight[b]) {
+                    b = i;
+                }
+            }
+            weight[nodes] = weight[a] + weight[b];
+            parent[a] = parent[b] = nodes;
+            nodes++;
+        }
+
+        int longest = 0;
+        for(int i=0; i<n; i++) {
+            int len = 0;
+            for(int p=i; parent[p] >= 0; p=parent[p])
+                len++;
+            lengths[symbol[i]] = len;
+            if(len > longest)
+                longest = len;
+        }
+        if(longest <= max_bits)
+            return 0;
+
+        for(int i=0; i<n; i++)
+            weight[i] = (weight[i] >> 1) | 1;
+    }
+}
+
+/*
+ * Appends the canonical code of buf_len symbols from buf to encoded_buf, from
+ * bit *bitpos on, and advances *bitpos past them. The bits below *bitpos in
+ * its byte are kept. Returns 1 if a symbol has no code or encoded_buf is too
+ * short.
+ */
+int huffman_encode(
+    const unsigned char lengths[MAX_SYMBOLS],
+    const unsigned char *buf,
+    size_t              buf_len,
+    unsigned char       *encoded_buf,
+    size_t              encoded_buf_len,
+    size_t              *bitpos
+) {
+    uint32_t codes[MAX_SYMBOLS];
+    size_t pos = *bitpos >> 3;
+    int nbits = *bitpos & 7;
+    uint64_t acc = 0;
+
+    if(canonical_codes(lengths, codes))
+        return 1;
+    if(nbits) {
+        if(pos >= encoded_buf_len)
+            return 1;
+        acc = encoded_buf[pos] & ((1u << nbits) - 1);
+    }
+    for(size_t i=0; i<buf_len; i++) {
+        int len = lengths[buf[i]];
+        if(len == 0)
+            return 1;
+        acc |= (uint64_t) codes[buf[i]] << nbits;
+        nbits += len;
+        while(nbits >= 8) {
+            if(pos >= encoded_buf_len)
+                return 1;
+            encoded_buf[pos++] = (unsigned char) acc;
+            acc >>= 8;
+            nbits -= 8;
+        }
+    }
+    if(nbits) {
+        if(pos >= encoded_buf_len)
+            return 1;
+        encoded_buf[pos] = (unsigned char) acc;
+    }
+    *bitpos = pos*8 + nbits;
+    return 0;
+}
+
+/*
+ * Reads the code table at the head of an encoded buffer into the code
+ * lengths and bits of each symbol. Returns 0 on success, 1 if the buffer is
+ * malformed, and 2 if a code is too long for a huffman_table.
+ */
+static int read_code_table(
+    const unsigned char *encoded_buf,
+    unsigned int        encoded_buf_len,
+    unsigned int        *pindex,
+    unsigned int        *pDataBytes,
+    unsigned char       lengths[MAX_SYMBOLS],
+    uint32_t            codes[MAX_SYMBOLS]
+) {
+    unsigned int count;
+    int ret = 0;
+
+    memset(lengths, 0, MAX_SYMBOLS);
+    memset(codes, 0, MAX_SYMBOLS*sizeof(uint32_t));
+
+    /* Read the number of entries and of data bytes
+       (they are stored in network byte order). */
+    if(memread(encoded_buf, encoded_buf_len, pindex, &count, sizeof(count)))
+        return 1;
+    count = ntohl(count);
+    if(memread(encoded_buf, encoded_buf_len, pindex, pDataBytes, sizeof(*pDataBytes)))
+        return 1;
+    *pDataBytes = ntohl(*pDataBytes);
+
+    /* Read the entries; the first bit of a code is bit 0 of its first byte. */
+    while(count-- > 0) {
+        unsigned char symbol;
+        unsigned char numbits;
+        unsigned char bytes[32];
+
+        if(memread(encoded_buf, encoded_buf_len, pindex, &symbol, sizeof(symbol)))
+            return 1;
+        if(memread(encoded_buf, encoded_buf_len, pindex, &numbits, sizeof(numbits)))
+            return 1;
+        if(memread(encoded_buf, encoded_buf_len, pindex, bytes, numbytes_from_numbits(numbits)))
+            return 1;
+
+        if(numbits > HUFFMAN_MAX_BITS) {
+            ret = 2;
+            continue;
+        }
+        lengths[symbol] = numbits;
+        for(int i=0; i<numbits; i++)
+            codes[symbol] |= (uint32_t) get_bit(bytes, i) << i;
+    }
+    return ret;
+}
+
+// bit-by-bit decoding down the code tree, for codes too long for the tables
+static int huffman_decode_tree(
     const unsigned char *encoded_buf,
     unsigned int        encoded_buf_len,
     unsigned char       **decoded_buf,
@@ -23,10 +451,6 @@ int huffman_decode(
     unsigned char *buf;
     unsigned int bufcur = 0;
 
-    /* Ensure the arguments are valid. */
-    if(!decoded_buf || !decoded_buf_len)
-        return 1;
-
     /* Read the Huffman code table. */
     root = build_huffman_tree(encoded_buf, encoded_buf_len, &i, &data_count);
     if(!root)
@@ -36,7 +460,7 @@ int huffman_decode(
 
     /* Decode the memory. */
     p = root;
-    for(; i < encoded_buf_len && data_count > 0; ++i) 
+    for(; i < encoded_buf_len && data_count > 0; ++i)
     {
         unsigned char byte = encoded_buf[i];
         unsigned char mask = 1;
@@ -58,4 +482,41 @@ int huffman_decode(
     *decoded_buf= buf;
     *decoded_buf_len = bufcur;
     return 0;
-}
\ No newline at end of file
+}
+
+int huffman_decode(
+    const unsigned char *encoded_buf,
+    unsigned int        encoded_buf_len,
+    unsigned char       **decoded_buf,
+    unsigned int        *decoded_buf_len
+) {
+    unsigned char lengths[MAX_SYMBOLS];
+    uint32_t codes[MAX_SYMBOLS];
+    huffman_table table;
+    unsigned int data_count;
+    unsigned int i = 0;
+    unsigned char *buf;
+
+    /* Ensure the arguments are valid. */
+    if(!decoded_buf || !decoded_buf_len)
+        return 1;
+
+    /* Read the Huffman code table. */
+    table.sub = NULL;
+    int ret = read_code_table(encoded_buf, encoded_buf_len, &i, &data_count, lengths, codes);
+    if(ret == 2)
+        return huffman_decode_tree(encoded_buf, encoded_buf_len, decoded_buf, decoded_buf_len);
+    if(ret || huffman_table_build(&table, lengths, codes)) {
+        huffman_table_free(&table);
+        return 1;
+    }
+
+    buf = (unsigned char*)malloc(data_count);
+
+    /* Decode the memory. */
+    size_t bitpos = (size_t) i*8;
+    *decoded_buf_len = huffman_table_decode(&table, encoded_buf, encoded_buf_len, &bitpos, buf, data_count);
+    *decoded_buf = buf;
+    huffman_table_free(&table);
+    return 0;
+}
@@ -12,12 +12,23 @@
 #ifndef HUFFMAN_H
 #define HUFFMAN_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifndef NULL
 #define NULL ( (void *) 0)
 #endif
 
 #define MAX_SYMBOLS 256
 
+/* Bits resolved by one lookup in the root table of a huffman_table. */
+#ifndef HUFFMAN_LUT_BITS
+#define HUFFMAN_LUT_BITS 11
+#endif
+
+/* Longest code a huffman_table can decode. */
+#define HUFFMAN_MAX_BITS 24
+
 static unsigned int ntohl(
 	unsigned int netlong
 ) {
@@ -269,4 +280,49 @@ int huffman_decode(
     unsigned int        *decoded_buf_len
 );
 
+/*
+ * Lookup tables of a prefix code, for huffman_table_decode. The next
+ * HUFFMAN_LUT_BITS bits of the stream index the root table, which resolves
+ * all the codes within them at once; codes that are longer continue into the
+ * second-level table of their root prefix.
+ */
+typedef struct huffman_table_tag {
+	uint64_t lut[1 << HUFFMAN_LUT_BITS];
+	uint64_t *sub;
+	int max_bits;
+} huffman_table;
+
+int huffman_table_init(
+    huffman_table       *table,
+    const unsigned char lengths[MAX_SYMBOLS]
+);
+
+void huffman_table_free(
+    huffman_table *table
+);
+
+size_t huffman_table_decode(
+    const huffman_table *table,
+    const unsigned char *encoded_buf,
+    size_t              encoded_buf_len,
+    size_t              *bitpos,
+    unsigned char       *decoded_buf,
+    size_t              decoded_len
+);
+
+int huffman_lengths(
+    const unsigned long freq[MAX_SYMBOLS],
+    unsigned char       lengths[MAX_SYMBOLS],
+    int                 max_bits
+);
+
+int huffman_encode(
+    const unsigned char lengths[MAX_SYMBOLS],
+    const unsigned char *buf,
+    size_t              buf_len,
+    unsigned char       *encoded_buf,
+    size_t              encoded_buf_len,
+    size_t              *bitpos
+);
+
 #endif
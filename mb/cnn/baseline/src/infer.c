@@ -0,0 +1,797 @@
+/*
+ * infer.c
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * Runs the CIFAR-10 test set through the network of mb/gd/baseline/cifar10.py
+ * with the fixed-point CConvNet layers, and reports throughput and accuracy. The
+ * network is described by a table of nodes; the executor infers the shape of
+ * every node from its predecessor, creates the layers once, and chains them
+ * through two ping-pong activation buffers, so no memory is allocated per
+ * image.
+ *
+ * The parameters are read from the float32 file written by tf-export.py and
+ * converted to data_t with the chosen number of fractional bits (qf):
+ *   - convolution weights [fs][fs][nif][nof] become W[nof][nif][fs][fs] with
+ *     flipped taps, since TensorFlow correlates where linalg_2dconv convolves;
+ *   - dense weights [nin][non] are kept, but rows following a convolutional
+ *     node are reordered from TensorFlow's (h,w,c) to the layers' (c,h,w).
+ * Convolutions are "SAME": the executor copies their input into the interior
+ * of a buffer with a zero border of fs/2 pixels.
+ *
+ * The tile sizes of the layers are those of the node table or, with -t,
+ * planned for the local memory of -m (by default a share of the caches), by
+ * the model of planner.c or by timing its best candidates. The layers round
+ * the partial sums of every input tile, so a plan that splits the inputs
+ * differently may change the last bits of the results; -k checks that it
+ * changes no more than that against a run with the table's tiles.
+ *
+ * With -w 8 or 4, the parameter file holds the weights as codes with a scale
+ * per output channel (tf-export.py -b); they stay packed in memory (quant.c),
+ * the convolutions unpack them tile by tile and the dense layers multiply the
+ * codes directly.
+ *
+ * With -z, the dense weights stay Huffman-coded in memory and every tile is
+ * decoded as it is fetched.
+ *
+ * With -b, the images go through the network in batches: every buffer holds
+ * the batch one image after the other, and each layer applies a weight tile
+ * to all of its images before fetching the next one.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <math.h>
+#include <omp.h>
+#include "linalg.h"
+#include "tiling.h"
+#include "ConvLayer.h"
+#include "PoolLayer.h"
+#include "DenseLayer.h"
+#include "pipeline.h"
+#include "planner.h"
+#include "quant.h"
+#include "oprecomp.h"
+
+#define NODE_CONV  0
+#define NODE_POOL  1
+#define NODE_DENSE 2
+
+#define IMAGE_SIZE 24
+#define IMAGE_DEPTH 3
+#define NUM_CLASSES 10
+
+#define TILING_TABLE  0
+#define TILING_PLAN   1
+#define TILING_SEARCH 2
+#define NUM_PLANS     8 ///< tilings timed per layer by TILING_SEARCH.
+
+/**
+ *  A node of the network graph. The input shape is that of the previous
+ *  node's output, or of the image for the first node.
+ */
+typedef struct {
+    const char *name;
+    int type;
+    int n_out;      ///< output feature maps or neurons (conv, dense).
+    int size;       ///< filter or pooling window size.
+    int stride;     ///< pooling stride.
+    int activation; ///< activation type.
+    int tile_out;   ///< output maps or neurons per tile, at most 255.
+    int tile_in;    ///< input maps or neurons per tile, at most 255.
+} Node;
+
+static const Node cifar10_net[] = {
+    // name     type        n_out size stride activation       tile_out tile_in
+    { "conv1", NODE_CONV,     64,   5,   1,   ACTIVATION_RELU,   16,      3 },
+    { "pool2", NODE_POOL,      0,   3,   2,   ACTIVATION_NONE,    0,      0 },
+    { "conv3", NODE_CONV,     64,   5,   1,   ACTIVATION_RELU,   16,     64 },
+    { "pool4", NODE_POOL,      0,   3,   2,   ACTIVATION_NONE,    0,      0 },
+    { "fc5",   NODE_DENSE,   384,   0,   0,   ACTIVATION_RELU,  192,    192 },
+    { "fc6",   NODE_DENSE,   192,   0,   0,   ACTIVATION_RELU,  192,    192 },
+    { "fc7",   NODE_DENSE,    10,   0,   0,   ACTIVATION_RELU,   10,    192 },
+};
+#define NUM_NODES ((int) (sizeof(cifar10_net)/sizeof(cifar10_net[0])))
+
+/**
+ *  A node instantiated by the executor: its layer, fixed-point parameters and
+ *  local buffers.
+ */
+typedef struct {
+    const Node *node;
+    int nif, h, w;  ///< input shape.
+    int nof, oh, ow; ///< output shape.
+    void *layer;
+    ccn_plan_t tile; ///< tile sizes of the layer.
+    data_t *weights;
+    quant_weights *wq; ///< quantised weights instead, with -w 8 or 4.
+    data_t *bias;
+    data_t *x_pad;  ///< zero-bordered input of a convolution.
+    data_t *y;      ///< output activations.
+    data_t *loc[6]; ///< local buffers not released by *_delete().
+    double time;    ///< accumulated execution time.
+} Stage;
+
+static unsigned long saturated = 0;
+
+static void *xmalloc(size_t size) {
+    void *p = calloc(1, size);
+    if(p == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static data_t float2fixed(float v, unsigned qf) {
+    float s = rintf(v * (float) (1 << qf));
+    if(s > 32767.0f) {
+        saturated++;
+        return 32767;
+    }
+    if(s < -32768.0f) {
+        saturated++;
+        return -32768;
+    }
+    return (data_t) s;
+}
+
+/**
+ *  Updates the shape (nif maps of h*w pixels) from the input to the output of
+ *  a node.
+ */
+static void node_shape(const Node *nd, int *nif, int *h, int *w) {
+    if(nd->type == NODE_POOL) {
+        *h = (*h+nd->stride-1)/nd->stride;
+        *w = (*w+nd->stride-1)/nd->stride;
+    }
+    else if(nd->type == NODE_DENSE) {
+        *nif = nd->n_out;
+        *h = 1;
+        *w = 1;
+    }
+    else {
+        *nif = nd->n_out;
+    }
+}
+
+/**
+ *  Allocates the len weights of a stage, those of the file at params+*used
+ *  (of nparams floats): float32 ones, returned in *w, or with wbits 8 or 4
+ *  the scales of the output channels followed by the codes, padded to a
+ *  float, returned in *q. Moves *used past them.
+ */
+static void stage_weights(Stage *s, const float *params, size_t nparams, size_t *used, size_t len, int wbits, unsigned qf, const float **w, const unsigned char **q) {
+    size_t need = (wbits == 32) ? len : s->nof + (quant_bytes(wbits, len)+3)/4;
+    if(*used + need + s->nof > nparams) {
+        fprintf(stderr, "%s: too few parameters for %d-bit weights\n", s->node->name, wbits);
+        exit(1);
+    }
+    *w = NULL;
+    *q = NULL;
+    if(wbits == 32) {
+        s->weights = xmalloc(sizeof(data_t)*len);
+        *w = params + *used;
+    }
+    else {
+        s->wq = xmalloc(sizeof(quant_weights));
+        if(quant_weights_init(s->wq, wbits, len, s->nof, params + *used, qf)) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        *q = (const unsigned char *) (params + *used + s->nof);
+    }
+    *used += need;
+}
+
+// weight src of the file, from stage_weights, becomes weight dst of the stage
+static void stage_set_weight(Stage *s, size_t dst, const float *w, const unsigned char *q, size_t src, unsigned qf) {
+    if(s->wq != NULL)
+        quant_set(s->wq, dst, quant_get(q, s->wq->bits, src));
+    else
+        s->weights[dst] = float2fixed(w[src], qf);
+}
+
+/**
+ *  Prepares the n nodes of net for batches of up to nb inputs of nif maps of
+ *  h*w pixels, converting their parameters from the nparams floats of params,
+ *  with weights of wbits bits; act[2] are the ping-pong activation buffers,
+ *  node k writes act[k%2]. The tile sizes are those of the table;
+ *  stage_new() creates the layers. Returns the number of floats consumed
+ *  from params.
+ */
+static size_t net_build(Stage *stage, const Node *net, int n, int nif, int h, int w, int nb, const float *params, size_t nparams, int wbits, unsigned qf, data_t *act[2]) {
+    size_t used = 0;
+    for(int k=0; k<n; k++) {
+        Stage *s = &stage[k];
+        const Node *nd = &net[k];
+        int fs = nd->size;
+        s->node = nd;
+        s->nif = nif;
+        s->h = h;
+        s->w = w;
+        s->time = 0.0;
+        s->nof = nif;
+        s->oh = h;
+        s->ow = w;
+        s->y = act[k%2];
+        node_shape(nd, &s->nof, &s->oh, &s->ow);
+        if(nd->tile_out > 255 || nd->tile_in > 255) {
+            fprintf(stderr, "%s: tiles are limited to 255 maps or neurons\n", nd->name);
+            exit(1);
+        }
+        s->tile.nof = nd->tile_out;
+        s->tile.nif = nd->tile_in;
+        s->tile.height = 1;
+        s->tile.width = 1;
+
+        if(nd->type == NODE_CONV) {
+            int ph = h+fs-1, pw = w+fs-1;
+            const float *pw_f;
+            const unsigned char *pw_q;
+            stage_weights(s, params, nparams, &used, (size_t) fs*fs*nif*s->nof, wbits, qf, &pw_f, &pw_q);
+            s->bias = xmalloc(sizeof(data_t)*s->nof);
+            for(int a=0; a<s->nof; a++) {
+                for(int b=0; b<nif; b++) {
+                    for(int u=0; u<fs; u++) {
+                        for(int v=0; v<fs; v++) {
+                            stage_set_weight(s, ((a*nif+b)*fs+(fs-1-u))*fs+(fs-1-v), pw_f, pw_q, ((u*fs+v)*nif+b)*s->nof+a, qf);
+                        }
+                    }
+                }
+            }
+            for(int a=0; a<s->nof; a++) {
+                s->bias[a] = float2fixed(params[used+a], qf);
+            }
+            used += s->nof;
+            s->x_pad = xmalloc(sizeof(data_t)*nb*nif*ph*pw);
+            s->tile.height = ph;
+            s->tile.width = pw;
+        }
+        else if(nd->type == NODE_DENSE) {
+            int nin = nif*h*w;
+            const float *pw_f;
+            const unsigned char *pw_q;
+            stage_weights(s, params, nparams, &used, (size_t) nin*s->nof, wbits, qf, &pw_f, &pw_q);
+            s->bias = xmalloc(sizeof(data_t)*s->nof);
+            for(int c=0; c<nif; c++) {
+                for(int i=0; i<h; i++) {
+                    for(int j=0; j<w; j++) {
+                        int m = (c*h+i)*w+j;
+                        int m_tf = (i*w+j)*nif+c;
+                        for(int o=0; o<s->nof; o++) {
+                            stage_set_weight(s, (size_t) m*s->nof+o, pw_f, pw_q, (size_t) m_tf*s->nof+o, qf);
+                        }
+                    }
+                }
+            }
+            for(int o=0; o<s->nof; o++) {
+                s->bias[o] = float2fixed(params[used+o], qf);
+            }
+            used += s->nof;
+        }
+
+        node_shape(nd, &nif, &h, &w);
+    }
+    return used;
+}
+
+/**
+ *  Creates the layer of a stage with the tile sizes s->tile, and its local
+ *  buffers for batches of up to nb inputs; conv_algo overrides the
+ *  convolution backend if not negative.
+ */
+static void stage_new(Stage *s, int nb, unsigned qf, int conv_algo) {
+    const Node *nd = s->node;
+    int fs = nd->size;
+    int nif = s->nif, h = s->h, w = s->w;
+
+    if(nd->type == NODE_CONV) {
+        int ph = h+fs-1, pw = w+fs-1;
+        int tof = s->tile.nof, tif = s->tile.nif;
+        int th = s->tile.height, tw = s->tile.width;
+        s->loc[0] = xmalloc(sizeof(data_t)*nb*tif*th*tw);
+        s->loc[1] = xmalloc(sizeof(data_t)*nb*tif*th*tw);
+        s->loc[2] = xmalloc(sizeof(data_t)*nb*tof*(th-fs+1)*(tw-fs+1));
+        s->loc[3] = xmalloc(sizeof(data_t)*nb*tof*(th-fs+1)*(tw-fs+1));
+        s->loc[4] = xmalloc(sizeof(data_t)*nb*tof*(th-fs+1)*(tw-fs+1));
+        s->layer = ConvLayer_new(
+            nd->name, s->weights, s->bias, s->x_pad, s->y,
+            s->loc[0], s->loc[1], s->loc[2], s->loc[3], s->loc[4],
+            xmalloc(sizeof(data_t)*tof*tif*MULTIPLE4(fs*fs)),
+            xmalloc(sizeof(data_t)*tof*tif*MULTIPLE4(fs*fs)),
+            s->nof, nif, ph, pw, fs, nd->activation, PARALLEL_AUTO,
+            tof, tif, th, tw, qf
+        );
+        if(conv_algo >= 0 && FastConv_supports(conv_algo, fs))
+            ((ConvLayer *) s->layer)->conv_algo = conv_algo;
+        ((ConvLayer *) s->layer)->w_quant = s->wq;
+    }
+    else if(nd->type == NODE_POOL) {
+        s->loc[0] = xmalloc(sizeof(data_t)*nif*h*w);
+        s->loc[1] = xmalloc(sizeof(data_t)*nif*s->oh*s->ow);
+        s->layer = PoolLayer_new(
+            NULL, s->y, s->loc[0], NULL, s->loc[1], NULL,
+            nif, fs, nd->stride, h, w,
+            nif, h, w, PARALLEL_FEAT
+        );
+    }
+    else {
+        int ton = s->tile.nof, tin = s->tile.nif;
+        s->loc[0] = xmalloc(sizeof(data_t)*nb*tin);
+        s->loc[1] = xmalloc(sizeof(data_t)*nb*tin);
+        s->loc[2] = xmalloc(sizeof(data_t)*nb*ton);
+        s->loc[3] = xmalloc(sizeof(data_t)*nb*ton);
+        s->loc[4] = xmalloc(sizeof(data_t)*nb*ton);
+        s->layer = DenseLayer_new(
+            nd->name, s->weights, s->bias, NULL, s->y,
+            s->loc[0], s->loc[1], s->loc[2], s->loc[3], s->loc[4],
+            xmalloc(sizeof(data_t)*tin*ton),
+            xmalloc(sizeof(data_t)*tin*ton),
+            xmalloc(sizeof(data_t)*ton),
+            s->nof, nif*h*w, nd->activation, ton, tin, qf
+        );
+        ((DenseLayer *) s->layer)->w_quant = s->wq;
+    }
+}
+
+static void stage_free(Stage *s) {
+    if(s->node->type == NODE_CONV) {
+        ConvLayer_delete(s->layer);
+    }
+    else if(s->node->type == NODE_POOL) {
+        PoolLayer_delete(s->layer);
+    }
+    else {
+        DenseLayer_delete(s->layer);
+    }
+    s->layer = NULL;
+    for(int i=0; i<6; i++) {
+        free(s->loc[i]);
+        s->loc[i] = NULL;
+    }
+}
+
+/**
+ *  Runs a batch of nb consecutive inputs from src through a stage.
+ */
+static void stage_exec(Stage *s, data_t *src, int nb) {
+    if(s->node->type == NODE_CONV) {
+        int p = s->node->size/2;
+        int pw = s->w+s->node->size-1;
+        int ph = s->h+s->node->size-1;
+        for(int b=0; b<nb; b++) {
+            data_t *x_pad = s->x_pad + b*s->nif*ph*pw;
+            data_t *x = src + b*s->nif*s->h*s->w;
+            for(int c=0; c<s->nif; c++) {
+                for(int i=0; i<s->h; i++) {
+                    memcpy(x_pad + (c*ph+i+p)*pw+p, x + (c*s->h+i)*s->w, sizeof(data_t)*s->w);
+                }
+            }
+        }
+        ((ConvLayer *) s->layer)->batch = nb;
+        ConvLayer_exec(s->layer);
+    }
+    else if(s->node->type == NODE_POOL) {
+        ((PoolLayer *) s->layer)->x = src;
+        ((PoolLayer *) s->layer)->batch = nb;
+        PoolLayer_exec(s->layer);
+    }
+    else {
+        ((DenseLayer *) s->layer)->x = src;
+        ((DenseLayer *) s->layer)->batch = nb;
+        DenseLayer_exec(s->layer);
+    }
+}
+
+typedef struct {
+    Stage *s;
+    data_t *x;      ///< input of the timed runs.
+    int nb;
+    unsigned qf;
+    int conv_algo;
+} PlanRun;
+
+// seconds per batch of a stage built with the given tiles, best of three runs
+// after one that also prepares the weights of the tiles
+static double stage_time(const ccn_plan_t *plan, void *arg) {
+    PlanRun *r = arg;
+    double best = 0.0;
+    r->s->tile = *plan;
+    stage_new(r->s, r->nb, r->qf, r->conv_algo);
+    stage_exec(r->s, r->x, r->nb);
+    for(int i=0; i<3; i++) {
+        double t0 = omp_get_wtime();
+        stage_exec(r->s, r->x, r->nb);
+        t0 = omp_get_wtime()-t0;
+        if(i == 0 || t0 < best)
+            best = t0;
+    }
+    stage_free(r->s);
+    return best;
+}
+
+/**
+ *  Chooses the tile sizes of a conv or dense stage whose local buffers fit
+ *  budget bytes: the best by the planner's model or, with search, the
+ *  fastest of its NUM_PLANS best on the input x.
+ */
+static void stage_plan(Stage *s, int nb, size_t budget, int search, unsigned qf, int conv_algo, data_t *x) {
+    ccn_plan_t plan[NUM_PLANS];
+    int fs = s->node->size;
+    int n, best = 0;
+    if(s->node->type == NODE_CONV)
+        n = ccn_plan_conv(s->nof, s->nif, s->h+fs-1, s->w+fs-1, fs, 1, nb, CCN_PIPE_NBUF_X, budget, plan, NUM_PLANS);
+    else if(s->node->type == NODE_DENSE)
+        n = ccn_plan_dense(s->nof, s->nif*s->h*s->w, nb, CCN_PIPE_NBUF_X, budget, plan, NUM_PLANS);
+    else
+        return;
+    if(n == 0) {
+        fprintf(stderr, "%s: no tiling fits in %zu bytes, keeping the table's\n", s->node->name, budget);
+        return;
+    }
+    if(search && n > 1) {
+        PlanRun r = { s, x, nb, qf, conv_algo };
+        best = ccn_plan_search(plan, n, stage_time, &r);
+    }
+    s->tile = plan[best];
+}
+
+/**
+ *  Runs a batch of nb consecutive inputs through the n stages; returns the
+ *  outputs of the last one, also one after the other.
+ */
+static data_t *net_exec(Stage *stage, int n, data_t *input, int nb, data_t *act[2]) {
+    data_t *src = input;
+    for(int k=0; k<n; k++) {
+        Stage *s = &stage[k];
+        double t0 = omp_get_wtime();
+        stage_exec(s, src, nb);
+        s->time += omp_get_wtime()-t0;
+        src = act[k%2];
+    }
+    return src;
+}
+
+/**
+ *  Runs the n images of input through the stages in batches of up to nb, and
+ *  copies the logits to y.
+ */
+static void net_logits(Stage *stage, data_t *input, int n, int image_len, int nb, data_t *act[2], data_t *y) {
+    for(int n0=0; n0<n; n0+=nb) {
+        int b = (n-n0 < nb) ? n-n0 : nb;
+        memcpy(y + (size_t) n0*NUM_CLASSES, net_exec(stage, NUM_NODES, input + (size_t) n0*image_len, b, act), sizeof(data_t)*b*NUM_CLASSES);
+    }
+}
+
+static void net_delete(Stage *stage, int n) {
+    for(int k=0; k<n; k++) {
+        Stage *s = &stage[k];
+        stage_free(s);
+        free(s->x_pad);
+        free(s->weights);
+        if(s->wq != NULL)
+            quant_weights_free(s->wq);
+        free(s->wq);
+        free(s->bias);
+    }
+}
+
+static void *read_file(const char *name, size_t *size) {
+    FILE *f = fopen(name, "rb");
+    if(f == NULL || fseek(f, 0, SEEK_END) != 0) {
+        perror(name);
+        exit(1);
+    }
+    *size = ftell(f);
+    rewind(f);
+    void *p = xmalloc(*size+1);
+    if(fread(p, 1, *size, f) != *size) {
+        perror(name);
+        exit(1);
+    }
+    fclose(f);
+    return p;
+}
+
+/**
+ *  Reads the per-image results of tf-infer.py (infer.dat) into correct[] and,
+ *  if present, class[] (-1 otherwise). Returns the number of images.
+ */
+static int read_reference(const char *name, int n, int *correct, int *class) {
+    FILE *f = fopen(name, "r");
+    char line[256];
+    int count = 0;
+    if(f == NULL) {
+        perror(name);
+        exit(1);
+    }
+    while(count < n && fgets(line, sizeof(line), f) != NULL) {
+        int sample, label, c, cls = -1;
+        float loss;
+        if(line[0] == '#')
+            continue;
+        if(sscanf(line, "%d %d %g %d %d", &sample, &label, &loss, &c, &cls) < 4 || sample != count) {
+            fprintf(stderr, "%s: malformed line %d\n", name, count);
+            exit(1);
+        }
+        correct[count] = c;
+        class[count] = cls;
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static const char *conv_algo_names[] = { "direct", "gemm", "winograd", "winograd4" };
+static const char *parallel_names[] = { "pixel", "feat", "hwce" };
+static const char *tiling_names[] = { "table", "plan", "search" };
+#define NUM_TILINGS ((int) (sizeof(tiling_names)/sizeof(tiling_names[0])))
+#define NUM_CONV_ALGOS ((int) (sizeof(conv_algo_names)/sizeof(conv_algo_names[0])))
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-q qf] [-n images] [-b batch] [-c conv] [-t tiles] [-m bytes] [-w bits] [-z] [-k lsb] [-r infer.dat] [weights [images labels]]\n", argv0);
+    fprintf(stderr, "  -q qf        fractional bits of the fixed-point data (default %d)\n", QF);
+    fprintf(stderr, "  -n images    number of test images to classify (default all)\n");
+    fprintf(stderr, "  -b batch     images per pass through the network (default 1)\n");
+    fprintf(stderr, "  -c conv      convolution backend: direct, gemm, winograd or winograd4\n");
+    fprintf(stderr, "               (default chosen per layer; layers whose filter size it does\n");
+    fprintf(stderr, "               not support keep their own)\n");
+    fprintf(stderr, "  -t tiles     tile sizes: table (default), plan for the local memory,\n");
+    fprintf(stderr, "               or search, i.e. time the best planned ones\n");
+    fprintf(stderr, "  -m bytes     local memory per layer for -t (default from the caches)\n");
+    fprintf(stderr, "  -k lsb       with -t, fail if a logit differs by more than lsb from\n");
+    fprintf(stderr, "               those of the table's tiles\n");
+    fprintf(stderr, "  -w bits      bits per weight in the parameter file: 32 (float, default),\n");
+    fprintf(stderr, "               8 or 4 (from tf-export.py -b), kept packed in memory\n");
+    fprintf(stderr, "  -z           keep the dense weights Huffman-coded, decode them per tile\n");
+    fprintf(stderr, "  -r infer.dat compare with the results of tf-infer.py\n");
+}
+
+int main(int argc, char **argv) {
+    const char *weights_file = "data/prepared/mb/cnn/model.bin";
+    const char *images_file = "data/prepared/mb/gd/cifar-10-test.data.bin";
+    const char *labels_file = "data/prepared/mb/gd/cifar-10-test.labels.bin";
+    const char *reference_file = NULL;
+    unsigned qf = QF;
+    int max_images = 0;
+    int batch = 1;
+    int compress = 0;
+    int wbits = 32;
+    int conv_algo = -1;
+    int tiling = TILING_TABLE;
+    size_t budget = 0;
+    int check = -1;
+    int opt;
+
+    while((opt = getopt(argc, argv, "q:n:b:c:t:m:w:zk:r:h")) != -1) {
+        switch(opt) {
+            case 'q': qf = atoi(optarg); break;
+            case 'n': max_images = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'c':
+                for(conv_algo=NUM_CONV_ALGOS-1; conv_algo>=0; conv_algo--) {
+                    if(strcmp(optarg, conv_algo_names[conv_algo]) == 0)
+                        break;
+                }
+                if(conv_algo < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                for(tiling=NUM_TILINGS-1; tiling>=0; tiling--) {
+                    if(strcmp(optarg, tiling_names[tiling]) == 0)
+                        break;
+                }
+                if(tiling < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm': budget = strtoul(optarg, NULL, 0); break;
+            case 'w': wbits = atoi(optarg); break;
+            case 'z': compress = 1; break;
+            case 'k': check = atoi(optarg); break;
+            case 'r': reference_file = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if(optind < argc)
+        weights_file = argv[optind++];
+    if(optind+1 < argc) {
+        images_file = argv[optind++];
+        labels_file = argv[optind++];
+    }
+    if(optind != argc || qf > 15 || batch < 1 || (wbits != 32 && wbits != QUANT_INT8 && wbits != QUANT_INT4) || (compress && wbits != 32)) {
+        usage(argv[0]);
+        return 1;
+    }
+    for(int k=0; k<NUM_NODES && conv_algo>=0; k++) {
+        if(cifar10_net[k].type == NODE_CONV && !FastConv_supports(conv_algo, cifar10_net[k].size))
+            fprintf(stderr, "%s: no %s for %dx%d filters, keeping the layer's backend\n", cifar10_net[k].name, conv_algo_names[conv_algo], cifar10_net[k].size, cifar10_net[k].size);
+    }
+
+    // test set: float32 [n][24][24][3] images, uint8 labels
+    size_t images_size, labels_size, params_size;
+    float *images = read_file(images_file, &images_size);
+    unsigned char *labels = read_file(labels_file, &labels_size);
+    int image_len = IMAGE_DEPTH*IMAGE_SIZE*IMAGE_SIZE;
+    int num_images = labels_size;
+    if(images_size != (size_t) num_images*image_len*sizeof(float)) {
+        fprintf(stderr, "%s: expected %d images\n", images_file, num_images);
+        return 1;
+    }
+    if(max_images > 0 && max_images < num_images)
+        num_images = max_images;
+
+    // build the network
+    data_t *act[2];
+    int max_act = 0;
+    for(int k=0, nif=IMAGE_DEPTH, h=IMAGE_SIZE, w=IMAGE_SIZE; k<NUM_NODES; k++) {
+        node_shape(&cifar10_net[k], &nif, &h, &w);
+        if(nif*h*w > max_act)
+            max_act = nif*h*w;
+    }
+    act[0] = xmalloc(sizeof(data_t)*batch*max_act);
+    act[1] = xmalloc(sizeof(data_t)*batch*max_act);
+
+    Stage stage[NUM_NODES];
+    memset(stage, 0, sizeof(stage));
+    float *params = read_file(weights_file, &params_size);
+    size_t used = net_build(stage, cifar10_net, NUM_NODES, IMAGE_DEPTH, IMAGE_SIZE, IMAGE_SIZE, batch, params, params_size/sizeof(float), wbits, qf, act);
+    if(used*sizeof(float) != params_size) {
+        fprintf(stderr, "%s: expected %zu parameters, found %zu\n", weights_file, used, params_size/sizeof(float));
+        return 1;
+    }
+    free(params);
+    unsigned long saturated_params = saturated;
+
+    // the images as (c,h,w) fixed-point maps
+    data_t *input = xmalloc(sizeof(data_t)*num_images*image_len);
+    saturated = 0;
+    for(int n=0; n<num_images; n++) {
+        for(int c=0; c<IMAGE_DEPTH; c++) {
+            for(int i=0; i<IMAGE_SIZE; i++) {
+                for(int j=0; j<IMAGE_SIZE; j++) {
+                    input[((size_t) n*IMAGE_DEPTH+c)*IMAGE_SIZE*IMAGE_SIZE+i*IMAGE_SIZE+j] =
+                        float2fixed(images[(((size_t) n*IMAGE_SIZE+i)*IMAGE_SIZE+j)*IMAGE_DEPTH+c], qf);
+                }
+            }
+        }
+    }
+    free(images);
+
+    if(budget == 0)
+        budget = ccn_plan_budget();
+    data_t *table_y = NULL;
+    if(check >= 0 && tiling != TILING_TABLE) {
+        // the logits with the table's tiles, for -k
+        table_y = xmalloc(sizeof(data_t)*num_images*NUM_CLASSES);
+        for(int k=0; k<NUM_NODES; k++)
+            stage_new(&stage[k], batch, qf, conv_algo);
+        net_logits(stage, input, num_images, image_len, batch, act, table_y);
+        for(int k=0; k<NUM_NODES; k++) {
+            stage_free(&stage[k]);
+            stage[k].time = 0.0;
+        }
+    }
+    for(int k=0; k<NUM_NODES; k++) {
+        if(tiling != TILING_TABLE)
+            stage_plan(&stage[k], batch, budget, tiling == TILING_SEARCH, qf, conv_algo, act[(k+1)%2]);
+        stage_new(&stage[k], batch, qf, conv_algo);
+    }
+    for(int k=0; compress && k<NUM_NODES; k++) {
+        if(cifar10_net[k].type == NODE_DENSE && DenseLayer_compress(stage[k].layer)) {
+            fprintf(stderr, "%s: cannot compress the weights\n", cifar10_net[k].name);
+            return 1;
+        }
+    }
+
+    printf("# qf: %u\n", qf);
+    printf("# images: %d\n", num_images);
+    printf("# batch: %d\n", batch);
+    printf("# num_threads: %d\n", omp_get_max_threads());
+    printf("# saturated_params: %lu\n", saturated_params);
+    size_t weight_bytes = 0;
+    for(int k=0; k<NUM_NODES; k++) {
+        Stage *s = &stage[k];
+        int fs = s->node->size;
+        if(s->wq != NULL)
+            weight_bytes += quant_bytes(s->wq->bits, s->wq->len);
+        else if(s->node->type == NODE_CONV)
+            weight_bytes += sizeof(data_t)*s->nof*s->nif*fs*fs;
+        else if(s->node->type == NODE_DENSE)
+            weight_bytes += sizeof(data_t)*s->nof*s->nif*s->h*s->w;
+    }
+    printf("# weight_bits: %d\n", wbits == 32 ? (int) (8*sizeof(data_t)) : wbits);
+    printf("# weight_bytes: %zu\n", weight_bytes);
+    printf("# saturated_pixels: %lu\n", saturated);
+    printf("# tiling: %s\n", tiling_names[tiling]);
+    if(tiling != TILING_TABLE)
+        printf("# plan_budget: %zu\n", budget);
+    for(int k=0; k<NUM_NODES; k++) {
+        const ccn_plan_t *t = &stage[k].tile;
+        if(cifar10_net[k].type == NODE_CONV) {
+            ConvLayer *layer = stage[k].layer;
+            printf("# conv_%s: %s\n", cifar10_net[k].name, conv_algo_names[layer->conv_algo]);
+            printf("# parallel_%s: %s\n", cifar10_net[k].name, parallel_names[layer->parallel_type]);
+            printf("# tiles_%s: %d %d %d %d\n", cifar10_net[k].name, t->nof, t->nif, t->height, t->width);
+        }
+        else if(cifar10_net[k].type == NODE_DENSE) {
+            DenseLayer *layer = stage[k].layer;
+            printf("# tiles_%s: %d %d\n", cifar10_net[k].name, t->nof, t->nif);
+            if(compress)
+                printf("# wbits_%s: %f\n", cifar10_net[k].name, 8.0*layer->w_bits_len/(layer->n_in_neurons*layer->n_out_neurons));
+        }
+    }
+
+    // classify; the logits are ranked like tf.argmax, the first maximum wins
+    int *class = xmalloc(sizeof(int)*num_images);
+    int correct = 0, diff = 0;
+    double runs = 0, time = omp_get_wtime();
+    oprecomp_start();
+    do {
+        correct = 0;
+        for(int n0=0; n0<num_images; n0+=batch) {
+            int nb = (num_images-n0 < batch) ? num_images-n0 : batch;
+            data_t *y = net_exec(stage, NUM_NODES, input + (size_t) n0*image_len, nb, act);
+            for(int n=n0; n<n0+nb; n++, y+=NUM_CLASSES) {
+                int best = 0;
+                for(int c=1; c<NUM_CLASSES; c++) {
+                    if(y[c] > y[best])
+                        best = c;
+                }
+                class[n] = best;
+                correct += best == labels[n];
+                for(int c=0; table_y != NULL && c<NUM_CLASSES; c++) {
+                    int d = abs(y[c] - table_y[(size_t) n*NUM_CLASSES+c]);
+                    if(d > diff)
+                        diff = d;
+                }
+            }
+        }
+        runs += num_images;
+    } while(oprecomp_iterate());
+    oprecomp_stop();
+    time = omp_get_wtime()-time;
+
+    printf("# images_per_s: %f\n", runs/time);
+    for(int k=0; k<NUM_NODES; k++) {
+        printf("# time_%s_us: %f\n", stage[k].node->name, 1e6*stage[k].time/runs);
+    }
+    printf("# accuracy: %g\n", (double) correct/num_images);
+    if(table_y != NULL)
+        printf("# table_max_diff: %d\n", diff);
+
+    if(reference_file != NULL) {
+        int *tf_correct = xmalloc(sizeof(int)*num_images);
+        int *tf_class = xmalloc(sizeof(int)*num_images);
+        int n = read_reference(reference_file, num_images, tf_correct, tf_class);
+        int tf_right = 0, agree = 0, both = 0;
+        for(int i=0; i<n; i++) {
+            tf_right += tf_correct[i];
+            agree += tf_class[i] == class[i];
+            both += tf_correct[i] && class[i] == labels[i];
+        }
+        printf("# tf_images: %d\n", n);
+        printf("# tf_accuracy: %g\n", n ? (double) tf_right/n : 0.0);
+        printf("# tf_both_correct: %g\n", n ? (double) both/n : 0.0);
+        if(n > 0 && tf_class[0] >= 0)
+            printf("# tf_agreement: %g\n", (double) agree/n);
+        free(tf_correct);
+        free(tf_class);
+    }
+
+    net_delete(stage, NUM_NODES);
+    free(table_y);
+    free(class);
+    free(input);
+    free(labels);
+    free(act[0]);
+    free(act[1]);
+    if(diff > check && table_y != NULL) {
+        fprintf(stderr, "%s: logits differ by up to %d from those of the table's tiles\n", tiling_names[tiling], diff);
+        return 1;
+    }
+    return 0;
+}
@@ -10,6 +10,9 @@
  */
 
 #include "linalg.h"
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
 #ifdef IPC_CONV16
   #include "perf_monitor.h"
 #elif IPC_CONV16_INNER
@@ -195,15 +198,17 @@ static inline int32_t conv16_unrolled_ptr_loopbody(
 
 }
 
+// rows i0..i1-1 of the output; the threads of linalg_2dconv_nof own
+// disjoint output maps or rows, so y is accumulated without locking
 static inline void conv16_unrolled_ptr(
    int16_t *__restrict__ W_base,
    int16_t *__restrict__ x_base,
    int16_t *__restrict__ y_ptr,
    int w,
-   int oh,
+   int i0,
+   int i1,
    int ow,
    int fs,
-   int parallel_type,
    unsigned qf
 ) {
    register int i;
@@ -222,64 +227,41 @@ static inline void conv16_unrolled_ptr(
    unsigned int cc=0, sc=0, ic=0, dc=0;
 #endif
 
-   if(parallel_type == PARALLEL_PIXEL) {
-#ifndef SUPERDETAILED_DEBUG
-      // #pragma omp for nowait
-#else
-      #pragma omp master
-#endif /* ~SUPERDETAILED_DEBUG */
-      for (i=0; i<oh; i++) {
-         for (j=0; j<ow; j++) {
+   for (i=i0; i<i1; i++) {
+      for (j=0; j<ow; j++) {
 
-            conv = conv16_unrolled_ptr_loopbody(W_base, x_base, y_ptr, w, ow, fs, i, j, qf);
+         conv = conv16_unrolled_ptr_loopbody(W_base, x_base, y_ptr, w, ow, fs, i, j, qf);
 
 #ifdef SUPERDETAILED_DEBUG
-            printf("(%d,%d): %08x = %08x + %08x\n", i, j, (*(y_ptr + i*ow+j)+conv), (*(y_ptr + i*ow+j)), bigconv);
+         printf("(%d,%d): %08x = %08x + %08x\n", i, j, (*(y_ptr + i*ow+j)+conv), (*(y_ptr + i*ow+j)), bigconv);
 #endif /* SUPERDETAILED_DEBUG */
 
 
 #ifdef FULL_PRECISION
 #ifndef DONT_SATURATE
-            // SAT-
-            conv += *(y_ptr + i*ow+j);
-            if(conv > +32767) {
+         // SAT-
+         conv += *(y_ptr + i*ow+j);
+         if(conv > +32767) {
 #ifdef SUPERDETAILED_DEBUG
-               printf("SAT+! conv=%08x\n", conv);
+            printf("SAT+! conv=%08x\n", conv);
 #endif /* SUPERDETAILED_DEBUG */
-               conv = 0x00007fff;
-            }
-            // SAT+
-            else if(conv < -32768) {
+            conv = 0x00007fff;
+         }
+         // SAT+
+         else if(conv < -32768) {
 #ifdef SUPERDETAILED_DEBUG
-               printf("SAT-! conv=%08x\n", conv);
+            printf("SAT-! conv=%08x\n", conv);
 #endif /* SUPERDETAILED_DEBUG */
-               conv = 0xffff8000;
-            }
-            *(y_ptr + i*ow+j) = conv;
+            conv = 0xffff8000;
+         }
+         *(y_ptr + i*ow+j) = conv;
 #else /* DONT_SATURATE */
-            *(y_ptr + i*ow+j) += conv;
+         *(y_ptr + i*ow+j) += conv;
 #endif /* DONT_SATURATE */
 #else /* ~FULL_PRECISION */
-            *(y_ptr + i*ow+j) += conv;
+         *(y_ptr + i*ow+j) += conv;
 #endif /* ~FULL_PRECISION */
 
-         }
-      }
-   }
-   else {
-      for (i=0; i<oh; i++) {
-         for (j=0; j<ow; j++) {
-
-            conv16_unrolled_ptr_loopbody(W_base, x_base, y_ptr, w, ow, fs, i, j, qf);
-
-#ifdef SUPERDETAILED_DEBUG
-            printf("(%d,%d): %08x = %08x + %08x\n", i, j, (*(y_ptr + i*ow+j)+conv), (*(y_ptr + i*ow+j)), bigconv);
-#endif /* SUPERDETAILED_DEBUG */
-
-            #pragma omp critical
-            *(y_ptr + i*ow+j) += conv;
-
-         }
       }
    }
 
@@ -486,6 +468,254 @@ static inline void conv16_gold(int16_t *__restrict__ W, int16_t *__restrict__ x,
    }
 }
 
+#if defined(CCN_X86) && (defined(__x86_64__) || defined(__i386__)) && !defined(CONV_APPROX)
+#define CONV16_SIMD
+#include <stdio.h>
+#include <immintrin.h>
+
+/**
+ *  @brief SIMD 2d convolution of a block of output feature maps (x86).
+ *
+ *  Computes CONV16_NP neighbouring output pixels of CONV16_NA output feature
+ *  maps per register block: every pair of horizontally adjacent taps of an
+ *  input pixel is broadcast to all lanes and multiplied with the weights of
+ *  the CONV16_NA maps by one vpmaddwd, which sums the two 16x16-bit products
+ *  into 32 bits. The sum over the filter of each input feature map is then
+ *  shifted by qf and added to the output (saturated with FULL_PRECISION), so
+ *  the result is bit-exact with conv16_unrolled_ptr.
+ *
+ *  The weights are repacked by conv16_pack to Wp[a/NA][b][u][v/2][a%NA][2],
+ *  with flipped taps: out(i,j) = sum Wp[u][v] * x[i+u][j+v]. The last tap of
+ *  an odd filter is paired with a zero weight. The packed weights belong to
+ *  the caller, which releases them with _mm_free.
+ */
+#define CONV16_NP 6
+
+static int16_t *conv16_pack(
+   int16_t *__restrict__ W,
+   int fs,
+   int nof,
+   int nif,
+   int na
+) {
+   int nvp = (fs+1)/2;
+   int nblk = (nof+na-1)/na;
+   size_t size = (size_t) nblk*nif*fs*nvp*na*2;
+   // 64-byte aligned for the AVX-512 loads
+   int16_t *Wp0 = _mm_malloc(size*sizeof(int16_t), 64);
+   if(Wp0 == NULL) {
+      printf("Out of memory in conv16_pack\n");
+      exit(1);
+   }
+   int16_t *Wp = Wp0;
+   for(int blk=0; blk<nblk; blk++) {
+      for(int b=0; b<nif; b++) {
+         for(int u=0; u<fs; u++) {
+            for(int vp=0; vp<nvp; vp++) {
+               for(int c=0; c<na; c++) {
+                  int a = blk*na+c;
+                  for(int t=0; t<2; t++) {
+                     int v = 2*vp+t;
+                     *Wp++ = (a < nof && v < fs) ? W[(((a*nif)+b)*fs+(fs-1-u))*fs+(fs-1-v)] : 0;
+                  }
+               }
+            }
+         }
+      }
+   }
+   return Wp0;
+}
+
+// the 32-bit pair of taps x[0], x[1] (x[1] = 0 if last), in every lane
+static inline int32_t conv16_pair(const int16_t *x, int last) {
+   int32_t p;
+   if(last)
+      return (uint16_t) x[0];
+   memcpy(&p, x, sizeof(p));
+   return p;
+}
+
+// gathers / scatters the outputs of a register block, y[a][i][j+p] <-> yb[p][a]
+static inline void conv16_load_y(int16_t *__restrict__ y, int32_t *__restrict__ yb, int ohw, int ow, int i, int j, int np, int na, int nav) {
+   for(int p=0; p<np; p++)
+      for(int c=0; c<na; c++)
+         yb[p*na+c] = c < nav ? y[c*ohw+i*ow+j+p] : 0;
+}
+
+static inline void conv16_store_y(int16_t *__restrict__ y, int32_t *__restrict__ yb, int ohw, int ow, int i, int j, int np, int na, int nav) {
+   for(int p=0; p<np; p++)
+      for(int c=0; c<nav; c++)
+         y[c*ohw+i*ow+j+p] = (int16_t) yb[p*na+c];
+}
+
+#define CONV16_AVX2_NA 16
+
+__attribute__((target("avx2"), always_inline))
+static inline void conv16_block_avx2(
+   const int16_t *__restrict__ Wp,
+   const int16_t *__restrict__ x,
+   int32_t *__restrict__ yb,
+   int h,
+   int w,
+   int fs,
+   int nif,
+   int i,
+   int j,
+   const int np,
+   unsigned qf
+) {
+   int nvp = (fs+1)/2;
+   __m128i sh = _mm_cvtsi32_si128(qf);
+   __m256i y0[CONV16_NP], y1[CONV16_NP];
+   for(int p=0; p<np; p++) {
+      y0[p] = _mm256_load_si256((__m256i *) (yb + p*CONV16_AVX2_NA));
+      y1[p] = _mm256_load_si256((__m256i *) (yb + p*CONV16_AVX2_NA + 8));
+   }
+   for(int b=0; b<nif; b++) {
+      __m256i s0[CONV16_NP], s1[CONV16_NP];
+      for(int p=0; p<np; p++) {
+         s0[p] = _mm256_setzero_si256();
+         s1[p] = _mm256_setzero_si256();
+      }
+      for(int u=0; u<fs; u++) {
+         const int16_t *xr = x + (b*h+i+u)*w + j;
+         const int16_t *wr = Wp + (b*fs+u)*nvp*2*CONV16_AVX2_NA;
+         for(int vp=0; vp<nvp; vp++) {
+            __m256i w0 = _mm256_load_si256((__m256i *) (wr + vp*2*CONV16_AVX2_NA));
+            __m256i w1 = _mm256_load_si256((__m256i *) (wr + vp*2*CONV16_AVX2_NA + 16));
+            int last = 2*vp+1 == fs;
+            for(int p=0; p<np; p++) {
+               __m256i xv = _mm256_set1_epi32(conv16_pair(xr + p + 2*vp, last));
+               s0[p] = _mm256_add_epi32(s0[p], _mm256_madd_epi16(xv, w0));
+               s1[p] = _mm256_add_epi32(s1[p], _mm256_madd_epi16(xv, w1));
+            }
+         }
+      }
+      for(int p=0; p<np; p++) {
+         y0[p] = _mm256_add_epi32(y0[p], _mm256_sra_epi32(s0[p], sh));
+         y1[p] = _mm256_add_epi32(y1[p], _mm256_sra_epi32(s1[p], sh));
+#if defined(FULL_PRECISION) && !defined(DONT_SATURATE)
+         y0[p] = _mm256_min_epi32(_mm256_max_epi32(y0[p], _mm256_set1_epi32(-32768)), _mm256_set1_epi32(32767));
+         y1[p] = _mm256_min_epi32(_mm256_max_epi32(y1[p], _mm256_set1_epi32(-32768)), _mm256_set1_epi32(32767));
+#endif /* FULL_PRECISION && ~DONT_SATURATE */
+      }
+   }
+   for(int p=0; p<np; p++) {
+      _mm256_store_si256((__m256i *) (yb + p*CONV16_AVX2_NA), y0[p]);
+      _mm256_store_si256((__m256i *) (yb + p*CONV16_AVX2_NA + 8), y1[p]);
+   }
+}
+
+__attribute__((target("avx2")))
+static void conv16_simd_avx2(const int16_t *__restrict__ Wp, int16_t *__restrict__ x, int16_t *__restrict__ y, int h, int w, int fs, int nif, int a0, int a1, int i0, int i1, unsigned qf) {
+   int oh = h-fs+1;
+   int ow = w-fs+1;
+   int32_t yb[CONV16_NP*CONV16_AVX2_NA] __attribute__((aligned(32)));
+   for(int a=a0; a<a1; a+=CONV16_AVX2_NA) {
+      int nav = a1-a < CONV16_AVX2_NA ? a1-a : CONV16_AVX2_NA;
+      const int16_t *Wa = Wp + (size_t) (a/CONV16_AVX2_NA)*nif*fs*((fs+1)/2)*2*CONV16_AVX2_NA;
+      int16_t *ya = y + a*oh*ow;
+      for(int i=i0; i<i1; i++) {
+         int j = 0;
+         for(; j+CONV16_NP<=ow; j+=CONV16_NP) {
+            conv16_load_y(ya, yb, oh*ow, ow, i, j, CONV16_NP, CONV16_AVX2_NA, nav);
+            conv16_block_avx2(Wa, x, yb, h, w, fs, nif, i, j, CONV16_NP, qf);
+            conv16_store_y(ya, yb, oh*ow, ow, i, j, CONV16_NP, CONV16_AVX2_NA, nav);
+         }
+         for(; j<ow; j++) {
+            conv16_load_y(ya, yb, oh*ow, ow, i, j, 1, CONV16_AVX2_NA, nav);
+            conv16_block_avx2(Wa, x, yb, h, w, fs, nif, i, j, 1, qf);
+            conv16_store_y(ya, yb, oh*ow, ow, i, j, 1, CONV16_AVX2_NA, nav);
+         }
+      }
+   }
+}
+
+#define CONV16_AVX512_NA 32
+
+__attribute__((target("avx512f,avx512bw"), always_inline))
+static inline void conv16_block_avx512(
+   const int16_t *__restrict__ Wp,
+   const int16_t *__restrict__ x,
+   int32_t *__restrict__ yb,
+   int h,
+   int w,
+   int fs,
+   int nif,
+   int i,
+   int j,
+   const int np,
+   unsigned qf
+) {
+   int nvp = (fs+1)/2;
+   __m128i sh = _mm_cvtsi32_si128(qf);
+   __m512i y0[CONV16_NP], y1[CONV16_NP];
+   for(int p=0; p<np; p++) {
+      y0[p] = _mm512_load_si512(yb + p*CONV16_AVX512_NA);
+      y1[p] = _mm512_load_si512(yb + p*CONV16_AVX512_NA + 16);
+   }
+   for(int b=0; b<nif; b++) {
+      __m512i s0[CONV16_NP], s1[CONV16_NP];
+      for(int p=0; p<np; p++) {
+         s0[p] = _mm512_setzero_si512();
+         s1[p] = _mm512_setzero_si512();
+      }
+      for(int u=0; u<fs; u++) {
+         const int16_t *xr = x + (b*h+i+u)*w + j;
+         const int16_t *wr = Wp + (b*fs+u)*nvp*2*CONV16_AVX512_NA;
+         for(int vp=0; vp<nvp; vp++) {
+            __m512i w0 = _mm512_load_si512(wr + vp*2*CONV16_AVX512_NA);
+            __m512i w1 = _mm512_load_si512(wr + vp*2*CONV16_AVX512_NA + 32);
+            int last = 2*vp+1 == fs;
+            for(int p=0; p<np; p++) {
+               __m512i xv = _mm512_set1_epi32(conv16_pair(xr + p + 2*vp, last));
+               s0[p] = _mm512_add_epi32(s0[p], _mm512_madd_epi16(xv, w0));
+               s1[p] = _mm512_add_epi32(s1[p], _mm512_madd_epi16(xv, w1));
+            }
+         }
+      }
+      for(int p=0; p<np; p++) {
+         y0[p] = _mm512_add_epi32(y0[p], _mm512_sra_epi32(s0[p], sh));
+         y1[p] = _mm512_add_epi32(y1[p], _mm512_sra_epi32(s1[p], sh));
+#if defined(FULL_PRECISION) && !defined(DONT_SATURATE)
+         y0[p] = _mm512_min_epi32(_mm512_max_epi32(y0[p], _mm512_set1_epi32(-32768)), _mm512_set1_epi32(32767));
+         y1[p] = _mm512_min_epi32(_mm512_max_epi32(y1[p], _mm512_set1_epi32(-32768)), _mm512_set1_epi32(32767));
+#endif /* FULL_PRECISION && ~DONT_SATURATE */
+      }
+   }
+   for(int p=0; p<np; p++) {
+      _mm512_store_si512(yb + p*CONV16_AVX512_NA, y0[p]);
+      _mm512_store_si512(yb + p*CONV16_AVX512_NA + 16, y1[p]);
+   }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void conv16_simd_avx512(const int16_t *__restrict__ Wp, int16_t *__restrict__ x, int16_t *__restrict__ y, int h, int w, int fs, int nif, int a0, int a1, int i0, int i1, unsigned qf) {
+   int oh = h-fs+1;
+   int ow = w-fs+1;
+   int32_t yb[CONV16_NP*CONV16_AVX512_NA] __attribute__((aligned(64)));
+   for(int a=a0; a<a1; a+=CONV16_AVX512_NA) {
+      int nav = a1-a < CONV16_AVX512_NA ? a1-a : CONV16_AVX512_NA;
+      const int16_t *Wa = Wp + (size_t) (a/CONV16_AVX512_NA)*nif*fs*((fs+1)/2)*2*CONV16_AVX512_NA;
+      int16_t *ya = y + a*oh*ow;
+      for(int i=i0; i<i1; i++) {
+         int j = 0;
+         for(; j+CONV16_NP<=ow; j+=CONV16_NP) {
+            conv16_load_y(ya, yb, oh*ow, ow, i, j, CONV16_NP, CONV16_AVX512_NA, nav);
+            conv16_block_avx512(Wa, x, yb, h, w, fs, nif, i, j, CONV16_NP, qf);
+            conv16_store_y(ya, yb, oh*ow, ow, i, j, CONV16_NP, CONV16_AVX512_NA, nav);
+         }
+         for(; j<ow; j++) {
+            conv16_load_y(ya, yb, oh*ow, ow, i, j, 1, CONV16_AVX512_NA, nav);
+            conv16_block_avx512(Wa, x, yb, h, w, fs, nif, i, j, 1, qf);
+            conv16_store_y(ya, yb, oh*ow, ow, i, j, 1, CONV16_AVX512_NA, nav);
+         }
+      }
+   }
+}
+
+#endif /* CCN_X86 && ~CONV_APPROX */
+
 /**
  *  @brief Computes the 2d convolution over all feature maps.
  *
@@ -570,7 +800,8 @@ void linalg_2dconv_hwce(
 }
 #endif /* CCN_HWCE_ACCEL */
 
-void linalg_2dconv(
+// output rows i0..i1-1 of the output feature map a
+static void conv16_rows(
    data_t *__restrict__ W,
    data_t *__restrict__ x,
    data_t *__restrict__ y,
@@ -579,51 +810,179 @@ void linalg_2dconv(
    int fs,
    int a,
    int nif,
+   int i0,
+   int i1,
    int parallel_type,
    unsigned qf
 ) {
    int oh = h-fs+1;
    int ow = w-fs+1;
-   int b,ri;
-   // #pragma omp parallel
-   {
-   if(parallel_type==PARALLEL_FEAT) {
-      // #pragma omp for nowait
-      for (b=0; b<nif; b++) {
-         int16_t *y_ptr = y + a*oh*ow;
-         int16_t *x_base = x + b*h*w + (fs-1)*w + (fs-1);
+   int b;
+   for (b=0; b<nif; b++) {
+      int16_t *y_ptr = y + a*oh*ow;
+      int16_t *x_base = x + b*h*w + (fs-1)*w + (fs-1);
 #if PULP_CHIP == CHIP_MIA || PULP_CHIP == CHIP_PULP3 || PULP_CHIP == CHIP_FULMINE || PULP_CHIP == CHIP_HONEY
-         int16_t *W_base = W + a*nif*MULTIPLE4(fs*fs) + b*MULTIPLE4(fs*fs);
+      int16_t *W_base = W + a*nif*MULTIPLE4(fs*fs) + b*MULTIPLE4(fs*fs);
 #else /* ~CHIP_MIA && ~CHIP_PULP3 */
-         int16_t *W_base = W + a*nif*fs*fs + b*fs*fs;
+      int16_t *W_base = W + a*nif*fs*fs + b*fs*fs;
 #endif /* ~CHIP_MIA && ~CHIP_PULP3 */
 #ifdef CONV_APPROX
-         conv16_approx(W_base, x_base, y_ptr, w, oh, ow, fs, parallel_type);
+      conv16_approx(W_base, x_base, y_ptr, w, oh, ow, fs, parallel_type);
 #else
-         conv16_unrolled_ptr(W_base, x_base, y_ptr, w, oh, ow, fs, parallel_type, qf);
+      conv16_unrolled_ptr(W_base, x_base, y_ptr, w, i0, i1, ow, fs, qf);
 #endif
-      }
    }
-   else {
-      // #pragma omp parallel
-      for (b=0; b<nif; b++) {
-         int16_t *y_ptr = y + a*oh*ow;
-         int16_t *x_base = x + b*h*w + (fs-1)*w + (fs-1);
-#if PULP_CHIP == CHIP_MIA || PULP_CHIP == CHIP_PULP3 || PULP_CHIP == CHIP_FULMINE || PULP_CHIP == CHIP_HONEY
-         int16_t *W_base = W + a*nif*MULTIPLE4(fs*fs) + b*MULTIPLE4(fs*fs);
-#else /* ~CHIP_MIA && ~CHIP_PULP3 */
-         int16_t *W_base = W + a*nif*fs*fs + b*fs*fs;
-#endif /* ~CHIP_MIA && ~CHIP_PULP3 */
-#ifdef CONV_APPROX
-         conv16_approx(W_base, x_base, y_ptr, w, oh, ow, fs, parallel_type);
-#else
-         conv16_unrolled_ptr(W_base, x_base, y_ptr, w, oh, ow, fs, parallel_type, qf);
-#endif
+}
+
+void linalg_2dconv(
+   data_t *__restrict__ W,
+   data_t *__restrict__ x,
+   data_t *__restrict__ y,
+   int h,
+   int w,
+   int fs,
+   int a,
+   int nif,
+   int parallel_type,
+   unsigned qf
+) {
+   conv16_rows(W, x, y, h, w, fs, a, nif, 0, h-fs+1, parallel_type, qf);
+}
+
+/**
+ *  @brief Returns the SIMD extension used by the kernels: 0 for none (or not
+ *  x86), 1 for AVX2, 2 for AVX-512BW. Define CONV16_ISA to force one.
+ */
+int linalg_simd_isa() {
+#ifdef CONV16_SIMD
+#ifdef CONV16_ISA
+   return CONV16_ISA;
+#else /* ~CONV16_ISA */
+   static int isa = -1;
+   if(isa < 0)
+      isa = __builtin_cpu_supports("avx512bw") ? 2 : __builtin_cpu_supports("avx2") ? 1 : 0;
+   return isa;
+#endif /* ~CONV16_ISA */
+#else /* ~CONV16_SIMD */
+   return 0;
+#endif /* ~CONV16_SIMD */
+}
+
+// output feature maps per block of the convolution kernels
+static int conv16_nof_block() {
+#ifdef CONV16_SIMD
+   int isa = linalg_simd_isa();
+   return isa == 2 ? CONV16_AVX512_NA : isa == 1 ? CONV16_AVX2_NA : 1;
+#else /* ~CONV16_SIMD */
+   return 1;
+#endif /* ~CONV16_SIMD */
+}
+
+/**
+ *  @brief Returns the share [*lo,*hi) of n work units of the calling thread
+ *  of an OpenMP team: contiguous, and at most one unit apart in size.
+ */
+void linalg_thread_range(int n, int *lo, int *hi) {
+#ifdef _OPENMP
+   int nt = omp_get_num_threads();
+   int t = omp_get_thread_num();
+#else /* ~_OPENMP */
+   int nt = 1;
+   int t = 0;
+#endif /* ~_OPENMP */
+   *lo = (int) ((long) n*t/nt);
+   *hi = (int) ((long) n*(t+1)/nt);
+}
+
+/**
+ *  @brief Picks how linalg_2dconv_nof and FastConv_exec share a tile of nof
+ *  output feature maps of oh rows among the threads.
+ *
+ *  PARALLEL_FEAT gives every thread whole blocks of output maps, as many as
+ *  the SIMD kernel computes at once, PARALLEL_PIXEL whole rows of all the
+ *  maps; either way the threads write disjoint outputs. Returns the one that
+ *  keeps the threads busiest, PARALLEL_FEAT on a tie since every thread then
+ *  reads only its own weights.
+ */
+int linalg_parallel_choose(int nof, int oh) {
+#ifdef _OPENMP
+   long nt = omp_get_max_threads();
+#else /* ~_OPENMP */
+   long nt = 1;
+#endif /* ~_OPENMP */
+   int na = conv16_nof_block();
+   long nblk = (nof+na-1)/na;
+   // nblk/(ceil(nblk/nt)*nt) >= oh/(ceil(oh/nt)*nt)
+   if(nblk*((oh+nt-1)/nt) >= oh*((nblk+nt-1)/nt))
+      return PARALLEL_FEAT;
+   return PARALLEL_PIXEL;
+}
+
+/**
+ *  @brief Computes the 2d convolution of all output feature maps.
+ *
+ *  Same as calling linalg_2dconv for every output feature map a < nof, with
+ *  bit-identical results. On x86 the SIMD kernels are used if the CPU supports
+ *  them (see linalg_simd_isa). The OpenMP threads split the output feature
+ *  maps (PARALLEL_FEAT) or rows (PARALLEL_PIXEL) among them, see
+ *  linalg_parallel_choose.
+ *
+ *  @param nof
+ *      the number of output feature maps.
+ *
+ *  The other parameters are those of linalg_2dconv.
+ */
+void linalg_2dconv_nof(
+   data_t *__restrict__ W,
+   data_t *__restrict__ x,
+   data_t *__restrict__ y,
+   int h,
+   int w,
+   int fs,
+   int nof,
+   int nif,
+   int parallel_type,
+   unsigned qf
+) {
+   int oh = h-fs+1;
+   int na = conv16_nof_block();
+   int nunit = parallel_type == PARALLEL_FEAT ? (nof+na-1)/na : oh;
+#ifdef CONV16_SIMD
+   int isa = linalg_simd_isa();
+   // packed once, by the calling thread
+   int16_t *Wp = isa ? conv16_pack(W, fs, nof, nif, na) : NULL;
+#endif /* CONV16_SIMD */
+   #pragma omp parallel if(nunit > 1)
+   {
+      int lo, hi;
+      int a0 = 0, a1 = nof, i0 = 0, i1 = oh;
+      if(parallel_type == PARALLEL_FEAT) {
+         linalg_thread_range(nunit, &lo, &hi);
+         a0 = lo*na;
+         a1 = hi*na < nof ? hi*na : nof;
+      }
+      else {
+         linalg_thread_range(nunit, &i0, &i1);
+      }
+#ifdef CONV16_SIMD
+      if(isa == 2)
+         conv16_simd_avx512(Wp, x, y, h, w, fs, nif, a0, a1, i0, i1, qf);
+      else if(isa == 1)
+         conv16_simd_avx2(Wp, x, y, h, w, fs, nif, a0, a1, i0, i1, qf);
+      else
+#endif /* CONV16_SIMD */
+      for(int a=a0; a<a1; a++) {
+         conv16_rows(W, x, y, h, w, fs, a, nif, i0, i1, parallel_type, qf);
       }
    }
-   }
+#ifdef CONV16_SIMD
+   _mm_free(Wp);
+#endif /* CONV16_SIMD */
 }
 
+#define LINALG_MVPROD_NB 64    ///< outputs per block of linalg_mmprod.
+#define LINALG_MMPROD_NB 16    ///< vectors per block of linalg_mmprod.
+
 /*
     void linalg_mvprod:
         computes the matrix by vector product. Unused because eigen_mvprod is
@@ -661,25 +1020,7 @@ void linalg_2dconv(
         output feature maps, the height of an output feature map and its width.
 */
 void linalg_mvprod(data_t *__restrict__ A, data_t *__restrict b, data_t *__restrict__ x, data_t *__restrict__ y, int M, int N, unsigned qf) {
-    #pragma omp parallel for
-    for(int n=0; n<N; n++) {
-        int accum = y[n] << qf;
-        for(int m=0; m<M; m++) {
-            accum += A[m*N+n] * x[m];
-        }
-#ifndef DONT_SATURATE
-        // SAT-
-        accum >>= qf;
-        if(accum > +32767) {
-           accum = 0x00007fff;
-        }
-        // SAT+
-        else if(accum < -32768) {
-           accum = 0xffff8000;
-        }
-#endif /* DONT_SATURATE */
-        y[n] = accum;
-    }
+    linalg_mmprod(A, x, y, M, N, 1, qf);
       // data_t *yp = malloc(sizeof(data_t)*N);
       // memset(yp, 0, sizeof(data_t)*N);
       // plp_matmul_i16_norm(A, x, yp, N, M, 1, PLPLIB_NORM_SHIFT(qf));
@@ -690,3 +1031,371 @@ void linalg_mvprod(data_t *__restrict__ A, data_t *__restrict b, data_t *__restr
       // free(yp);
 
 }
+
+/**
+ *  @brief Computes the matrix by matrix product y[k] += A^T x[k] for the nb
+ *  vectors x[k] of a batch, i.e. linalg_mvprod on every one of them, with
+ *  bit-identical results.
+ *
+ *  Every block of LINALG_MVPROD_NB outputs is computed for LINALG_MMPROD_NB
+ *  vectors at a time, so that a row of A is read once for all of them; the
+ *  threads take blocks of outputs (PARALLEL_FEAT).
+ *
+ *  @param *A
+ *      the A[M][N] weight matrix, as in linalg_mvprod.
+ *  @param *x
+ *      the x[nb][M] input vectors.
+ *  @param *y
+ *      the y[nb][N] output vectors, holding their biases.
+ *  @param M
+ *      the number of inputs.
+ *  @param N
+ *      the number of outputs.
+ *  @param nb
+ *      the number of vectors.
+ */
+void linalg_mmprod(data_t *__restrict__ A, data_t *__restrict__ x, data_t *__restrict__ y, int M, int N, int nb, unsigned qf) {
+    int nblk = (N+LINALG_MVPROD_NB-1)/LINALG_MVPROD_NB;
+    #pragma omp parallel for if(nblk > 1)
+    for(int blk=0; blk<nblk; blk++) {
+        int n0 = blk*LINALG_MVPROD_NB;
+        int nn = N-n0 < LINALG_MVPROD_NB ? N-n0 : LINALG_MVPROD_NB;
+        for(int k0=0; k0<nb; k0+=LINALG_MMPROD_NB) {
+            int kn = nb-k0 < LINALG_MMPROD_NB ? nb-k0 : LINALG_MMPROD_NB;
+            int accum[LINALG_MMPROD_NB][LINALG_MVPROD_NB];
+            for(int k=0; k<kn; k++) {
+                for(int n=0; n<nn; n++) {
+                    accum[k][n] = y[(k0+k)*N+n0+n] << qf;
+                }
+            }
+            for(int m=0; m<M; m++) {
+                data_t *A_ptr = A + (size_t) m*N + n0;
+                for(int k=0; k<kn; k++) {
+                    int x_loc = x[(k0+k)*M+m];
+                    for(int n=0; n<nn; n++) {
+                        accum[k][n] += A_ptr[n] * x_loc;
+                    }
+                }
+            }
+            for(int k=0; k<kn; k++) {
+                for(int n=0; n<nn; n++) {
+#ifndef DONT_SATURATE
+                    // SAT-
+                    accum[k][n] >>= qf;
+                    if(accum[k][n] > +32767) {
+                       accum[k][n] = 0x00007fff;
+                    }
+                    // SAT+
+                    else if(accum[k][n] < -32768) {
+                       accum[k][n] = 0xffff8000;
+                    }
+#endif /* DONT_SATURATE */
+                    y[(k0+k)*N+n0+n] = accum[k][n];
+                }
+            }
+        }
+    }
+}
+
+// one block of nn <= LINALG_MVPROD_NB outputs of linalg_mmprod_q, for all the
+// vectors; inlined into a copy per instruction set, which the compiler
+// vectorises on its own (sign extension of the codes, 32-bit multiply-add)
+__attribute__((always_inline))
+static inline void mmprod_q_block(
+   const unsigned char *__restrict__ A,
+   int bits,
+   int lda,
+   const int16_t *__restrict__ mult,
+   int shift,
+   data_t *__restrict__ x,
+   data_t *__restrict__ y,
+   int M,
+   int N,
+   int nb,
+   unsigned qf,
+   int n0,
+   int nn
+) {
+   int8_t row[LINALG_MVPROD_NB];
+   for(int k0=0; k0<nb; k0+=LINALG_MMPROD_NB) {
+      int kn = nb-k0 < LINALG_MMPROD_NB ? nb-k0 : LINALG_MMPROD_NB;
+      int32_t accum[LINALG_MMPROD_NB][LINALG_MVPROD_NB];
+      for(int k=0; k<kn; k++) {
+         for(int n=0; n<nn; n++) {
+            accum[k][n] = 0;
+         }
+      }
+      for(int m=0; m<M; m++) {
+         const int8_t *q;
+         if(bits == 4) {
+            // n0 is even, the codes of the block start on a byte
+            const unsigned char *a = A + (size_t) m*lda + n0/2;
+            for(int i=0; i<(nn+1)/2; i++) {
+               row[2*i]   = (int8_t) (a[i] << 4) >> 4;
+               row[2*i+1] = (int8_t) a[i] >> 4;
+            }
+            q = row;
+         }
+         else {
+            q = (const int8_t *) A + (size_t) m*lda + n0;
+         }
+         for(int k=0; k<kn; k++) {
+            int x_loc = x[(k0+k)*M+m];
+            for(int n=0; n<nn; n++) {
+               accum[k][n] += q[n] * x_loc;
+            }
+         }
+      }
+      for(int k=0; k<kn; k++) {
+         for(int n=0; n<nn; n++) {
+            int64_t v = ((int64_t) y[(k0+k)*N+n0+n] << (qf+shift)) + (int64_t) accum[k][n]*mult[n0+n];
+            v >>= qf+shift;
+#ifndef DONT_SATURATE
+            if(v > +32767)
+               v = 32767;
+            else if(v < -32768)
+               v = -32768;
+#endif /* DONT_SATURATE */
+            y[(k0+k)*N+n0+n] = (data_t) v;
+         }
+      }
+   }
+}
+
+typedef void (*mmprod_q_fn)(const unsigned char *, int, int, const int16_t *, int, data_t *, data_t *, int, int, int, unsigned, int, int);
+
+static void mmprod_q_ref(const unsigned char *A, int bits, int lda, const int16_t *mult, int shift, data_t *x, data_t *y, int M, int N, int nb, unsigned qf, int n0, int nn) {
+   mmprod_q_block(A, bits, lda, mult, shift, x, y, M, N, nb, qf, n0, nn);
+}
+
+#ifdef CONV16_SIMD
+__attribute__((target("avx2")))
+static void mmprod_q_avx2(const unsigned char *A, int bits, int lda, const int16_t *mult, int shift, data_t *x, data_t *y, int M, int N, int nb, unsigned qf, int n0, int nn) {
+   mmprod_q_block(A, bits, lda, mult, shift, x, y, M, N, nb, qf, n0, nn);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void mmprod_q_avx512(const unsigned char *A, int bits, int lda, const int16_t *mult, int shift, data_t *x, data_t *y, int M, int N, int nb, unsigned qf, int n0, int nn) {
+   mmprod_q_block(A, bits, lda, mult, shift, x, y, M, N, nb, qf, n0, nn);
+}
+#endif /* CONV16_SIMD */
+
+/**
+ *  @brief Computes y[k] += A^T x[k] like linalg_mmprod, for a matrix of 8-bit
+ *  or 4-bit codes with a scale per column.
+ *
+ *  A[m][n] stands for the weight (q*mult[n]) / 2^shift with qf fractional
+ *  bits (see quant.h). The codes are multiplied with the inputs as they are,
+ *  and the scale is applied once to every output, before the shift by qf and
+ *  the saturation: the weights are read in a half or a quarter of the bytes,
+ *  and never rounded to data_t.
+ *
+ *  @param *A
+ *      the A[M][N] codes, rows of lda bytes; 4-bit codes two per byte, the
+ *      first in the low nibble.
+ *  @param bits
+ *      the bits per code, 8 or 4.
+ *  @param *mult
+ *      the multipliers of the N columns.
+ *  @param shift
+ *      the fractional bits of the multipliers.
+ *
+ *  The other parameters are those of linalg_mmprod.
+ */
+void linalg_mmprod_q(const unsigned char *__restrict__ A, int bits, int lda, const int16_t *__restrict__ mult, int shift, data_t *__restrict__ x, data_t *__restrict__ y, int M, int N, int nb, unsigned qf) {
+   int nblk = (N+LINALG_MVPROD_NB-1)/LINALG_MVPROD_NB;
+   mmprod_q_fn fn = mmprod_q_ref;
+#ifdef CONV16_SIMD
+   int isa = linalg_simd_isa();
+   if(isa == 2)
+      fn = mmprod_q_avx512;
+   else if(isa == 1)
+      fn = mmprod_q_avx2;
+#endif /* CONV16_SIMD */
+   #pragma omp parallel for if(nblk > 1)
+   for(int blk=0; blk<nblk; blk++) {
+      int n0 = blk*LINALG_MVPROD_NB;
+      int nn = N-n0 < LINALG_MVPROD_NB ? N-n0 : LINALG_MVPROD_NB;
+      fn(A, bits, lda, mult, shift, x, y, M, N, nb, qf, n0, nn);
+   }
+}
+
+/*
+ * Fixed-point activations with the qf of the layer (at most 15), for whole
+ * tiles: the compiler vectorises the loops below into one copy per
+ * instruction set, as for linalg_mmprod_q.
+ *  - tanh interpolates linearly in a table of tanh(k/32), k = 0..192, in
+ *    Q15, and is +-tanh(6) beyond (one gather per element from AVX2 on);
+ *  - exp(x) = 2^(x log2 e) is 2^n times a cubic in the fraction of the
+ *    exponent, within 1e-4 of 2^f on [0,1), saturated to data_t.
+ */
+#define ACT_TANH_STEP 10          // log2 of the table step, in Q15
+#define ACT_TANH_N    192         // table entries up to 6
+#define ACT_LOG2E     23638       // log2(e) in Q14
+#define ACT_EXP_C1    22778       // 2^f ~ 1 + f (c1 + f (c2 + f c3)), in Q15
+#define ACT_EXP_C2    7460
+#define ACT_EXP_C3    2525
+
+static const int32_t act_tanh_lut[ACT_TANH_N+2] = {
+       0,  1024,  2045,  3063,  4075,  5079,  6073,  7056,  8025,  8980,
+    9919, 10840, 11743, 12625, 13486, 14326, 15143, 15936, 16706, 17452,
+   18173, 18870, 19542, 20189, 20813, 21411, 21986, 22538, 23066, 23571,
+   24054, 24516, 24956, 25376, 25776, 26157, 26519, 26864, 27191, 27502,
+   27797, 28076, 28341, 28592, 28830, 29055, 29268, 29470, 29660, 29840,
+   30010, 30170, 30322, 30465, 30600, 30727, 30847, 30960, 31067, 31167,
+   31262, 31351, 31435, 31515, 31589, 31659, 31726, 31788, 31846, 31901,
+   31953, 32002, 32048, 32091, 32132, 32170, 32206, 32240, 32271, 32301,
+   32329, 32356, 32381, 32404, 32426, 32447, 32466, 32484, 32501, 32517,
+   32532, 32547, 32560, 32573, 32584, 32596, 32606, 32616, 32625, 32634,
+   32642, 32649, 32657, 32663, 32670, 32676, 32681, 32686, 32691, 32696,
+   32700, 32704, 32708, 32712, 32715, 32718, 32721, 32724, 32727, 32729,
+   32732, 32734, 32736, 32738, 32740, 32741, 32743, 32745, 32746, 32747,
+   32749, 32750, 32751, 32752, 32753, 32754, 32755, 32755, 32756, 32757,
+   32758, 32758, 32759, 32759, 32760, 32760, 32761, 32761, 32762, 32762,
+   32762, 32763, 32763, 32763, 32764, 32764, 32764, 32764, 32765, 32765,
+   32765, 32765, 32765, 32766, 32766, 32766, 32766, 32766, 32766, 32766,
+   32766, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+   32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32768,
+   32768, 32768, 32768, 32768
+};
+
+__attribute__((always_inline))
+static inline int32_t act_tanh(int32_t x, unsigned qf) {
+   int32_t ax = x < 0 ? -x : x;
+   int32_t u = ax << (15-qf);
+   u = u > (ACT_TANH_N << ACT_TANH_STEP) ? (ACT_TANH_N << ACT_TANH_STEP) : u;
+   int32_t i = u >> ACT_TANH_STEP;
+   int32_t f = u & ((1 << ACT_TANH_STEP) - 1);
+   int32_t t0 = act_tanh_lut[i];
+   int32_t t = t0 + (((act_tanh_lut[i+1] - t0) * f) >> ACT_TANH_STEP);
+   t = (t + ((1 << (15-qf)) >> 1)) >> (15-qf);
+   return x < 0 ? -t : t;
+}
+
+// x can be below -1 << 15 (softmax subtracts the maximum)
+__attribute__((always_inline))
+static inline int32_t act_exp(int32_t x, unsigned qf) {
+   int32_t z = (x * ACT_LOG2E) >> 14;
+   int32_t n = z >> qf;
+   int32_t f = (z & ((1 << qf) - 1)) << (15-qf);
+   int32_t p = ACT_EXP_C3;
+   p = ACT_EXP_C2 + ((p * f) >> 15);
+   p = ACT_EXP_C1 + ((p * f) >> 15);
+   p = 32768 + ((p * f) >> 15);
+   // 2^n p in Q(qf) is p >> (15-qf-n)
+   int32_t s = 15 - (int32_t) qf - n;
+   int32_t sc = s < 1 ? 1 : (s > 30 ? 30 : s);
+   int32_t y = (p + (1 << (sc-1))) >> sc;
+   return s < 1 || y > 32767 ? 32767 : y;
+}
+
+__attribute__((always_inline))
+static inline void softmax_block(data_t *y, const data_t *x, int n, unsigned qf) {
+   int32_t max = -32768;
+   for(int i=0; i<n; i++) {
+      max = x[i] > max ? x[i] : max;
+   }
+   int32_t sum = 0;
+   for(int i=0; i<n; i++) {
+      int32_t e = act_exp(x[i] - max, qf);
+      y[i] = (data_t) e;
+      sum += e;
+   }
+   // the largest term is exp(0) = 1 << qf, so y[i]*r <= 1 << 30
+   int32_t r = (1 << 30) / sum;
+   for(int i=0; i<n; i++) {
+      int32_t v = (y[i] * r + (1 << (29-qf))) >> (30-qf);
+      y[i] = (data_t) (v > 32767 ? 32767 : v);
+   }
+}
+
+// m rows of n values, inlined into a copy per instruction set
+__attribute__((always_inline))
+static inline void activation_block(data_t *y, const data_t *x, int m, int n, int ldy, int ldx, int activation, unsigned qf) {
+   for(int r=0; r<m; r++, y+=ldy, x+=ldx) {
+      if(activation == ACTIVATION_TANH) {
+         for(int i=0; i<n; i++) {
+            y[i] = (data_t) act_tanh(x[i], qf);
+         }
+      }
+      else if(activation == ACTIVATION_RELU) {
+         for(int i=0; i<n; i++) {
+            y[i] = x[i] < 0 ? 0 : x[i];
+         }
+      }
+      else if(activation == ACTIVATION_SOFTMAX) {
+         softmax_block(y, x, n, qf);
+      }
+      else if(y != x) {
+         for(int i=0; i<n; i++) {
+            y[i] = x[i];
+         }
+      }
+   }
+}
+
+typedef void (*activation_fn)(data_t *, const data_t *, int, int, int, int, int, unsigned);
+
+static void activation_ref(data_t *y, const data_t *x, int m, int n, int ldy, int ldx, int activation, unsigned qf) {
+   activation_block(y, x, m, n, ldy, ldx, activation, qf);
+}
+
+#ifdef CONV16_SIMD
+__attribute__((target("avx2")))
+static void activation_avx2(data_t *y, const data_t *x, int m, int n, int ldy, int ldx, int activation, unsigned qf) {
+   activation_block(y, x, m, n, ldy, ldx, activation, qf);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void activation_avx512(data_t *y, const data_t *x, int m, int n, int ldy, int ldx, int activation, unsigned qf) {
+   activation_block(y, x, m, n, ldy, ldx, activation, qf);
+}
+#endif /* CONV16_SIMD */
+
+/**
+ *  @brief Applies an activation to the m rows of n values of x, with qf
+ *  fractional bits, into those of y; y can be x.
+ *
+ *  ACTIVATION_TANH and ACTIVATION_RELU act on every value,
+ *  ACTIVATION_SOFTMAX on every row as one vector (see linalg_softmax),
+ *  ACTIVATION_NONE copies them. The layers call it on their output tiles as
+ *  they write them back, in place of the copy.
+ *
+ *  @param ldy
+ *      the distance between the rows of y, in values.
+ *  @param ldx
+ *      the distance between the rows of x, in values.
+ */
+void linalg_activation_2d(data_t *y, const data_t *x, int m, int n, int ldy, int ldx, int activation, unsigned qf) {
+   if(m <= 0 || n <= 0)
+      return;
+   activation_fn fn = activation_ref;
+#ifdef CONV16_SIMD
+   int isa = linalg_simd_isa();
+   if(isa == 2)
+      fn = activation_avx512;
+   else if(isa == 1)
+      fn = activation_avx2;
+#endif /* CONV16_SIMD */
+   fn(y, x, m, n, ldy, ldx, activation, qf);
+}
+
+/**
+ *  @brief Applies an activation to the n values in x into y, see
+ *  linalg_activation_2d.
+ */
+void linalg_activation(data_t *y, const data_t *x, int n, int activation, unsigned qf) {
+   linalg_activation_2d(y, x, 1, n, n, n, activation, qf);
+}
+
+/**
+ *  @brief Computes the softmax of the n values in x, with qf fractional bits,
+ *  into y; y can be x.
+ *
+ *  The maximum is subtracted first, so that the exponentials are at most 1
+ *  and do not saturate, and the sum is inverted once: every output costs an
+ *  exponential and a multiplication.
+ */
+void linalg_softmax(data_t *y, const data_t *x, int n, unsigned qf) {
+   linalg_activation_2d(y, x, 1, n, n, n, ACTIVATION_SOFTMAX, qf);
+}
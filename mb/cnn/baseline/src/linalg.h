@@ -20,8 +20,22 @@
 typedef int16_t vect16_t __attribute__((vector_size(8)));
 typedef int32_t vect32_t __attribute__((vector_size(16)));
 
+// on x86 the layers convolve all output feature maps of a tile at once
+#if defined(CCN_X86) && !defined(CCN_CACHE) && !defined(CCN_PULP_HWCE)
+  #define LINALG_2DCONV_NOF
+#endif
+
+int  linalg_simd_isa();
+int  linalg_parallel_choose(int nof, int oh);
+void linalg_thread_range(int n, int *lo, int *hi);
 void linalg_mvprod(data_t *__restrict__ A, data_t *__restrict__ b, data_t *__restrict__ x, data_t *__restrict__ y, int M, int N, unsigned qf);
+void linalg_mmprod(data_t *__restrict__ A, data_t *__restrict__ x, data_t *__restrict__ y, int M, int N, int nb, unsigned qf);
+void linalg_mmprod_q(const unsigned char *__restrict__ A, int bits, int lda, const int16_t *__restrict__ mult, int shift, data_t *__restrict__ x, data_t *__restrict__ y, int M, int N, int nb, unsigned qf);
+void linalg_activation(data_t *y, const data_t *x, int n, int activation, unsigned qf);
+void linalg_activation_2d(data_t *y, const data_t *x, int m, int n, int ldy, int ldx, int activation, unsigned qf);
+void linalg_softmax(data_t *y, const data_t *x, int n, unsigned qf);
 void linalg_2dconv     (data_t *__restrict__ W, data_t *__restrict__ x, data_t *__restrict__ y, int h, int w, int fs, int a, int nif, int parallel_type, unsigned qf);
+void linalg_2dconv_nof (data_t *__restrict__ W, data_t *__restrict__ x, data_t *__restrict__ y, int h, int w, int fs, int nof, int nif, int parallel_type, unsigned qf);
 void linalg_2dconv_hwce(data_t *__restrict__ W, data_t *__restrict__ x, data_t *__restrict__ y, int h, int w, int fs, int a, int nif, int parallel_type, unsigned qf);
 
 #endif /* LINALG_H */
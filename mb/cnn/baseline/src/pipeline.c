@@ -0,0 +1,237 @@
+/*
+ * pipeline.c
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ *
+ * Runs the fetch, execute and write-back stages of the tiled layers on three
+ * persistent worker threads, instead of forking an OpenMP team for every
+ * tile. The workers are created by the first run; fe and wb are pinned to
+ * their own cores when there are enough of them. ex is not: the OpenMP team
+ * of the layer kernels it calls inherits its affinity, and needs all the
+ * cores of the process. Tiles are handed on through lock-free
+ * single-producer/single-consumer queues:
+ *
+ *   fe --(fetched tiles)--> ex --(computed tiles)--> wb
+ *
+ * A stage pops a tile only once it is done with it, so a queue holds exactly
+ * the tiles whose local buffers are still in use. Its capacity is therefore
+ * the number of those buffers: fe waits for a free x/w buffer, and ex for a
+ * free y buffer. There is no barrier per tile; the caller only sleeps until
+ * the last write-back.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "types.h"
+#include "pipeline.h"
+
+#define PIPE_SPIN 64        ///< polls of a queue before yielding the core.
+
+typedef struct {
+    unsigned head __attribute__((aligned(64)));    ///< tiles pushed, written by the producer.
+    unsigned tail __attribute__((aligned(64)));    ///< tiles popped, written by the consumer.
+    int size;
+    ccn_tile_t tile[CCN_PIPE_NBUF_Y];
+} pipe_queue_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start;   ///< a new run, or generation.
+    pthread_cond_t done;    ///< all workers through the run.
+    int state;              ///< 0 no workers yet, 1 running, -1 could not start them.
+    unsigned gen;
+    int finished;
+    void *layer;
+    ccn_stage_t stage[3];   ///< by THREAD_FE/EX/WB.
+    int ntile_a, ntile_i, ntile_j, ntile_b;
+    pipe_queue_t fe_ex;
+    pipe_queue_t ex_wb;
+} pipe = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static inline void pipe_relax(int *spin) {
+    if(++*spin < PIPE_SPIN) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    else {
+        // the other stages may share the core
+        sched_yield();
+    }
+}
+
+// waits until q has room for a tile, before the producer starts on it
+static void pipe_reserve(pipe_queue_t *q) {
+    int spin = 0;
+    while(q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) >= (unsigned) q->size)
+        pipe_relax(&spin);
+}
+
+static void pipe_push(pipe_queue_t *q, const ccn_tile_t *t) {
+    q->tile[q->head % q->size] = *t;
+    __atomic_store_n(&q->head, q->head+1, __ATOMIC_RELEASE);
+}
+
+// waits for the oldest tile of q, which stays queued until pipe_pop
+static const ccn_tile_t *pipe_peek(pipe_queue_t *q) {
+    int spin = 0;
+    while(__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == q->tail)
+        pipe_relax(&spin);
+    return &q->tile[q->tail % q->size];
+}
+
+static void pipe_pop(pipe_queue_t *q) {
+    __atomic_store_n(&q->tail, q->tail+1, __ATOMIC_RELEASE);
+}
+
+static void pipe_fe() {
+    ccn_tile_t t;
+    t.k = 0;
+    for(t.aa=0; t.aa<pipe.ntile_a; t.aa++) {
+        for(t.ii=0; t.ii<pipe.ntile_i; t.ii++) {
+            for(t.jj=0; t.jj<pipe.ntile_j; t.jj++) {
+                for(t.bb=0; t.bb<pipe.ntile_b; t.bb++) {
+                    pipe_reserve(&pipe.fe_ex);
+                    pipe.stage[THREAD_FE](pipe.layer, &t);
+                    pipe_push(&pipe.fe_ex, &t);
+                    t.k++;
+                }
+            }
+        }
+    }
+}
+
+static void pipe_ex(int ntile) {
+    for(int k=0; k<ntile; k++) {
+        const ccn_tile_t *t = pipe_peek(&pipe.fe_ex);
+        pipe_reserve(&pipe.ex_wb);
+        pipe.stage[THREAD_EX](pipe.layer, t);
+        pipe_push(&pipe.ex_wb, t);
+        pipe_pop(&pipe.fe_ex);
+    }
+}
+
+static void pipe_wb(int ntile) {
+    for(int k=0; k<ntile; k++) {
+        const ccn_tile_t *t = pipe_peek(&pipe.ex_wb);
+        pipe.stage[THREAD_WB](pipe.layer, t);
+        pipe_pop(&pipe.ex_wb);
+    }
+}
+
+// pins the calling worker to the id-th core it may run on, if there are more
+static void pipe_pin(int id) {
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set) != 0 || CPU_COUNT(&set) < 2)
+        return;
+    int n = id % CPU_COUNT(&set);
+    for(int c=0; c<CPU_SETSIZE; c++) {
+        if(CPU_ISSET(c, &set) && n-- == 0) {
+            CPU_ZERO(&set);
+            CPU_SET(c, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            return;
+        }
+    }
+}
+
+static void *pipe_worker(void *arg) {
+    int id = (int) (intptr_t) arg;
+    unsigned gen = 0;
+    // the team forked by ex must be free to spread over all cores
+    if(id != THREAD_EX)
+        pipe_pin(id);
+    for(;;) {
+        pthread_mutex_lock(&pipe.lock);
+        while(pipe.gen == gen)
+            pthread_cond_wait(&pipe.start, &pipe.lock);
+        gen = pipe.gen;
+        int ntile = pipe.ntile_a*pipe.ntile_i*pipe.ntile_j*pipe.ntile_b;
+        pthread_mutex_unlock(&pipe.lock);
+
+        if(id == THREAD_FE)
+            pipe_fe();
+        else if(id == THREAD_EX)
+            pipe_ex(ntile);
+        else
+            pipe_wb(ntile);
+
+        pthread_mutex_lock(&pipe.lock);
+        if(++pipe.finished == 3)
+            pthread_cond_signal(&pipe.done);
+        pthread_mutex_unlock(&pipe.lock);
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Runs the tiles (aa,ii,jj,bb) of a layer through its fe, ex and wb
+ *  stages, in this loop order, and returns when all are written back.
+ *
+ *  The stages of one tile run in order, and every stage sees the tiles in
+ *  order; tile k uses the local x/w buffers k%CCN_PIPE_NBUF_X, and the y
+ *  buffer (k/ntile_b)%CCN_PIPE_NBUF_Y of its output tile. The ex_wb queue
+ *  holds the last tiles only, so those belong to at most CCN_PIPE_NBUF_Y
+ *  output tiles. Layers run one at a time: this is not reentrant.
+ */
+void ccn_pipe_run(void *layer, ccn_stage_t fe, ccn_stage_t ex, ccn_stage_t wb, int ntile_a, int ntile_i, int ntile_j, int ntile_b) {
+    pthread_mutex_lock(&pipe.lock);
+    if(pipe.state == 0) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pipe.state = 1;
+        for(int id=0; id<3 && pipe.state>0; id++) {
+            if(pthread_create(&thread, &attr, pipe_worker, (void *) (intptr_t) id) != 0) {
+                printf("[pipeline] cannot start the worker threads, running the stages serially\n");
+                pipe.state = -1;
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+    if(pipe.state < 0) {
+        // at most the workers started before the failure are waiting; they
+        // never see a new generation
+        pthread_mutex_unlock(&pipe.lock);
+        ccn_tile_t t;
+        t.k = 0;
+        for(t.aa=0; t.aa<ntile_a; t.aa++) {
+            for(t.ii=0; t.ii<ntile_i; t.ii++) {
+                for(t.jj=0; t.jj<ntile_j; t.jj++) {
+                    for(t.bb=0; t.bb<ntile_b; t.bb++) {
+                        fe(layer, &t);
+                        ex(layer, &t);
+                        wb(layer, &t);
+                        t.k++;
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    pipe.layer = layer;
+    pipe.stage[THREAD_FE] = fe;
+    pipe.stage[THREAD_EX] = ex;
+    pipe.stage[THREAD_WB] = wb;
+    pipe.ntile_a = ntile_a;
+    pipe.ntile_i = ntile_i;
+    pipe.ntile_j = ntile_j;
+    pipe.ntile_b = ntile_b;
+    pipe.fe_ex.head = pipe.fe_ex.tail = 0;
+    pipe.fe_ex.size = CCN_PIPE_NBUF_X;
+    pipe.ex_wb.head = pipe.ex_wb.tail = 0;
+    pipe.ex_wb.size = CCN_PIPE_NBUF_Y;
+    pipe.finished = 0;
+    pipe.gen++;
+    pthread_cond_broadcast(&pipe.start);
+    while(pipe.finished < 3)
+        pthread_cond_wait(&pipe.done, &pipe.lock);
+    pthread_mutex_unlock(&pipe.lock);
+}
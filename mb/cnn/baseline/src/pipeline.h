@@ -0,0 +1,33 @@
+/*
+ * pipeline.h
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+/**
+ *  A tile in flight through the fetch (fe), execute (ex) and write-back (wb)
+ *  stages of a tiled layer.
+ */
+typedef struct {
+    int aa, bb, ii, jj; ///< tile indeces, as taken by the pipe_* stages.
+    int k;              ///< position in the tile sequence, selects the local buffers.
+} ccn_tile_t;
+
+typedef void (*ccn_stage_t)(void *layer, const ccn_tile_t *tile);
+
+/**
+ *  Local buffers per stage: a tile may be fetched while the previous one
+ *  executes (CCN_DOUBLEBUF: loc_x0/1, loc_w0/1), and execute while the two
+ *  output tiles before it are written back (loc_y0/1/2).
+ */
+#define CCN_PIPE_NBUF_X 2
+#define CCN_PIPE_NBUF_Y 3
+
+void ccn_pipe_run(void *layer, ccn_stage_t fe, ccn_stage_t ex, ccn_stage_t wb, int ntile_a, int ntile_i, int ntile_j, int ntile_b);
+
+#endif /* PIPELINE_H */
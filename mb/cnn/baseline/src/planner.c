@@ -0,0 +1,240 @@
+/*
+ * planner.c
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ *
+ * Chooses the tile sizes of the layers instead of taking them by hand. The
+ * local buffers of a layer (nbuf x and w tiles, nbuf+1 y tiles, as in the
+ * pipeline) must fit a memory budget: the scratchpad on a cluster, or a share
+ * of the data cache, read from sysfs, on a host. Among the tilings that fit,
+ * the model prefers the ones that move the fewest bytes in and out of the
+ * local buffers, in the loop order of the pipeline:
+ *   - a conv x tile is fetched once per tile of output maps, with its halo;
+ *   - a conv w tile once per spatial tile, a dense one once per batch;
+ *   - a y tile is accumulated locally and written back once;
+ *   - every tile also costs CCN_PLAN_TILE_BYTES of overhead.
+ * The model ignores how well the kernels run on a given tile shape, so
+ * ccn_plan_search can time the best few candidates instead.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "planner.h"
+
+#ifndef CCN_PLAN_TILE_BYTES
+#define CCN_PLAN_TILE_BYTES 512     ///< cost of a tile hand-off, in bytes moved.
+#endif
+#define CCN_PLAN_MAX_TILE   255     ///< tile grids are unsigned char.
+#define CCN_PLAN_STEP       8       ///< tiles of maps and neurons are multiples of this, or whole.
+#define CCN_PLAN_MAX_DIMS   64
+
+/**
+ *  @brief Size of the data (or unified) cache of the given level of the
+ *  first CPU, in bytes, as reported by sysfs; 0 if unknown.
+ */
+size_t ccn_cache_size(int level) {
+#ifdef __linux__
+    for(int i=0; i<16; i++) {
+        char name[96], type[32];
+        int lvl;
+        unsigned long size;
+        char unit = 0;
+        FILE *f;
+
+        snprintf(name, sizeof(name), "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        if((f = fopen(name, "r")) == NULL)
+            break;
+        int ok = fscanf(f, "%d", &lvl) == 1;
+        fclose(f);
+        if(!ok || lvl != level)
+            continue;
+
+        snprintf(name, sizeof(name), "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        if((f = fopen(name, "r")) == NULL)
+            continue;
+        ok = fscanf(f, "%31s", type) == 1;
+        fclose(f);
+        if(!ok || strcmp(type, "Instruction") == 0)
+            continue;
+
+        snprintf(name, sizeof(name), "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        if((f = fopen(name, "r")) == NULL)
+            continue;
+        ok = fscanf(f, "%lu%c", &size, &unit) >= 1;
+        fclose(f);
+        if(!ok)
+            continue;
+        if(unit == 'K')
+            size <<= 10;
+        else if(unit == 'M')
+            size <<= 20;
+        return size;
+    }
+#endif /* __linux__ */
+    return 0;
+}
+
+/**
+ *  @brief Local memory budget for the buffers of one layer, in bytes.
+ *
+ *  CCN_PLAN_BUDGET if defined (e.g. the scratchpad left to the layers), else
+ *  half of the L2 cache, leaving room for the backends' scratch and the data
+ *  streamed in and out; else half of the L1 data cache, else 64 KiB.
+ */
+size_t ccn_plan_budget(void) {
+#ifdef CCN_PLAN_BUDGET
+    return CCN_PLAN_BUDGET;
+#else /* ~CCN_PLAN_BUDGET */
+    size_t size = ccn_cache_size(2);
+    if(size == 0)
+        size = ccn_cache_size(1);
+    return size ? size/2 : 64*1024;
+#endif /* ~CCN_PLAN_BUDGET */
+}
+
+// n itself, and the multiples of CCN_PLAN_STEP below it, if at most 255
+static int plan_counts(int n, int *v) {
+    int nv = 0;
+    if(n <= CCN_PLAN_MAX_TILE)
+        v[nv++] = n;
+    for(int t=CCN_PLAN_STEP; t<n && t<=CCN_PLAN_MAX_TILE && nv<CCN_PLAN_MAX_DIMS; t+=CCN_PLAN_STEP)
+        v[nv++] = t;
+    return nv;
+}
+
+/*
+ * Input extents of the spatial tiles of a dimension of n pixels, including
+ * the filter halo. Tiles step by s = t-fs+1 output pixels, and the layers
+ * make the last one s + n%s pixels: it must fit the buffers and hold at
+ * least one output pixel, and with pooling every tile a whole number of
+ * pooling windows. tiles[] returns the number of tiles of each.
+ */
+static int plan_extents(int n, int fs, int pool, int *v, int *tiles) {
+    int nv = 0;
+    int out = n-fs+1;
+    if(n <= CCN_PLAN_MAX_TILE) {
+        tiles[nv] = 1;
+        v[nv++] = n;
+    }
+    for(int s=out-1; s>=1 && nv<CCN_PLAN_MAX_DIMS; s--) {
+        int r = n % s;
+        if(s > 16 && s % CCN_PLAN_STEP)
+            continue;
+        if(s+fs-1 > CCN_PLAN_MAX_TILE || r > fs-1 || r+s < fs)
+            continue;
+        if(s % pool || (s+r-fs+1) % pool)
+            continue;
+        tiles[nv] = 1 + (n-s-r)/s;
+        v[nv++] = s+fs-1;
+    }
+    return nv;
+}
+
+// keeps plan[0..*n) sorted by cost, then footprint, with at most nplan entries
+static void plan_insert(ccn_plan_t *plan, int nplan, int *n, const ccn_plan_t *p) {
+    int i = *n < nplan ? (*n)++ : nplan;
+    while(i > 0 && (plan[i-1].cost > p->cost || (plan[i-1].cost == p->cost && plan[i-1].footprint > p->footprint))) {
+        if(i < nplan)
+            plan[i] = plan[i-1];
+        i--;
+    }
+    if(i < nplan)
+        plan[i] = *p;
+}
+
+/**
+ *  @brief Plans the tiles of a ConvLayer (pool 1) or ConvPoolLayer.
+ *
+ *  Fills plan[] with up to nplan tilings whose local buffers, for batches of
+ *  batch images and nbuf-fold buffering, fit budget bytes, best first by the
+ *  model. height and width are those of the (padded) input, as taken by the
+ *  layer constructors. Returns the number of tilings, 0 if none fits.
+ */
+int ccn_plan_conv(int nof, int nif, int height, int width, int fs, int pool, int batch, int nbuf, size_t budget, ccn_plan_t *plan, int nplan) {
+    int vof[CCN_PLAN_MAX_DIMS], vif[CCN_PLAN_MAX_DIMS];
+    int vh[CCN_PLAN_MAX_DIMS], vw[CCN_PLAN_MAX_DIMS];
+    int th[CCN_PLAN_MAX_DIMS], tw[CCN_PLAN_MAX_DIMS];
+    int nvof = plan_counts(nof, vof);
+    int nvif = plan_counts(nif, vif);
+    int nvh = plan_extents(height, fs, pool, vh, th);
+    int nvw = plan_extents(width, fs, pool, vw, tw);
+    int n = 0;
+
+    for(int a=0; a<nvof; a++) {
+        for(int b=0; b<nvif; b++) {
+            for(int i=0; i<nvh; i++) {
+                for(int j=0; j<nvw; j++) {
+                    ccn_plan_t p;
+                    double ntof = (nof+vof[a]-1)/vof[a];
+                    double ntif = (nif+vif[b]-1)/vif[b];
+                    double x_tile = (double) batch*vif[b]*vh[i]*vw[j];
+                    double w_tile = (double) vof[a]*vif[b]*fs*fs;
+                    double y_tile = (double) batch*vof[a]*(vh[i]-fs+1)*(vw[j]-fs+1);
+                    p.nof = vof[a];
+                    p.nif = vif[b];
+                    p.height = vh[i];
+                    p.width = vw[j];
+                    p.footprint = sizeof(data_t)*(nbuf*(x_tile+w_tile) + (nbuf+1)*y_tile);
+                    if(p.footprint > budget)
+                        continue;
+                    double x = ntof*batch*nif*(height+(th[i]-1)*(fs-1))*(width+(tw[j]-1)*(fs-1));
+                    double w = (double) th[i]*tw[j]*nof*nif*fs*fs;
+                    double y = (double) batch*nof*(height-fs+1)*(width-fs+1)/(pool*pool);
+                    p.cost = sizeof(data_t)*(x+w+y) + CCN_PLAN_TILE_BYTES*ntof*ntif*th[i]*tw[j];
+                    plan_insert(plan, nplan, &n, &p);
+                }
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ *  @brief Plans the tiles of a DenseLayer, in plan[].nof (tiling_max_non)
+ *  and plan[].nif (tiling_max_nin); see ccn_plan_conv.
+ */
+int ccn_plan_dense(int non, int nin, int batch, int nbuf, size_t budget, ccn_plan_t *plan, int nplan) {
+    int von[CCN_PLAN_MAX_DIMS], vin[CCN_PLAN_MAX_DIMS];
+    int nvon = plan_counts(non, von);
+    int nvin = plan_counts(nin, vin);
+    int n = 0;
+
+    for(int a=0; a<nvon; a++) {
+        for(int b=0; b<nvin; b++) {
+            ccn_plan_t p;
+            double ntout = (non+von[a]-1)/von[a];
+            double ntin = (nin+vin[b]-1)/vin[b];
+            p.nof = von[a];
+            p.nif = vin[b];
+            p.height = 1;
+            p.width = 1;
+            p.footprint = sizeof(data_t)*(nbuf*((double) batch*vin[b] + (double) vin[b]*von[a]) + (nbuf+1)*(double) batch*von[a] + von[a]);
+            if(p.footprint > budget)
+                continue;
+            double x = ntout*batch*nin;
+            double w = (double) nin*non;
+            double y = (double) batch*non;
+            p.cost = sizeof(data_t)*(x+w+y) + CCN_PLAN_TILE_BYTES*ntout*ntin;
+            plan_insert(plan, nplan, &n, &p);
+        }
+    }
+    return n;
+}
+
+/**
+ *  @brief Times the nplan tilings with run(), which returns the seconds a
+ *  layer built with the given tiles takes, and stores them as their cost.
+ *  Returns the index of the fastest.
+ */
+int ccn_plan_search(ccn_plan_t *plan, int nplan, double (*run)(const ccn_plan_t *plan, void *arg), void *arg) {
+    int best = 0;
+    for(int i=0; i<nplan; i++) {
+        plan[i].cost = run(&plan[i], arg);
+        if(plan[i].cost < plan[best].cost)
+            best = i;
+    }
+    return best;
+}
@@ -0,0 +1,33 @@
+/*
+ * planner.h
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <stddef.h>
+
+/**
+ *  A choice of tile sizes for a layer, as taken by its constructor:
+ *  tiling_max_nof, tiling_max_nif, tiling_max_height and tiling_max_width of
+ *  a ConvLayer or ConvPoolLayer, or tiling_max_non and tiling_max_nin of a
+ *  DenseLayer (in nof and nif).
+ */
+typedef struct {
+    int nof, nif;       ///< feature maps or neurons per tile.
+    int height, width;  ///< input pixels per tile, including the filter halo.
+    size_t footprint;   ///< bytes of local buffers.
+    double cost;        ///< modelled bytes moved per batch, or measured seconds.
+} ccn_plan_t;
+
+size_t ccn_cache_size(int level);
+size_t ccn_plan_budget(void);
+int ccn_plan_conv(int nof, int nif, int height, int width, int fs, int pool, int batch, int nbuf, size_t budget, ccn_plan_t *plan, int nplan);
+int ccn_plan_dense(int non, int nin, int batch, int nbuf, size_t budget, ccn_plan_t *plan, int nplan);
+int ccn_plan_search(ccn_plan_t *plan, int nplan, double (*run)(const ccn_plan_t *plan, void *arg), void *arg);
+
+#endif /* PLANNER_H */
@@ -0,0 +1,165 @@
+/*
+ * quant.c
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ *
+ * Storage of the weights of a layer in 8 or 4 bits instead of data_t. The
+ * codes and their per-channel scales come from the quantised parameter file
+ * of tf-export.py; the layers fetch the codes, a half or a quarter of the
+ * bytes of the 16-bit weights, and either unpack them to data_t in their
+ * local buffers (ConvLayer) or multiply them directly (DenseLayer, see
+ * linalg_mmprod_q).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "quant.h"
+
+#define QUANT_MAX_SHIFT 24
+
+/**
+ *  @brief Allocates the codes and the channel multipliers of qw for len
+ *  codes of the given bits in nch channels, the codes all 0.
+ *
+ *  The multipliers are the real scales of the channels with qf fractional
+ *  bits, plus as many as fit in 16 bits for the largest one. A channel whose
+ *  largest code would overflow data_t has its multiplier clamped, which
+ *  saturates its weights as float-to-fixed conversion would.
+ *
+ *  @return 0 on success, 1 if out of memory.
+ */
+int quant_weights_init(quant_weights *qw, int bits, size_t len, int nch, const float *scale, unsigned qf) {
+    int qmax = (1 << (bits-1)) - 1;
+    double smax = 0.0;
+
+    qw->bits  = bits;
+    qw->nch   = nch;
+    qw->len   = len;
+    qw->mult  = malloc(sizeof(int16_t)*nch);
+    qw->q     = calloc(quant_bytes(bits, len), 1);
+    if(qw->mult == NULL || qw->q == NULL) {
+        quant_weights_free(qw);
+        return 1;
+    }
+
+    for(int c=0; c<nch; c++) {
+        double s = fabs(ldexp(scale[c], qf));
+        if(s > smax)
+            smax = s;
+    }
+    int shift = 0;
+    while(shift < QUANT_MAX_SHIFT && rint(ldexp(smax, shift+1)) <= 32767.0)
+        shift++;
+    qw->shift = shift;
+
+    // (qmax*mult + round) >> shift must stay within data_t
+    int64_t limit = ((int64_t) 32768 << shift) - (shift ? (int64_t) 1 << (shift-1) : 0);
+    limit = (limit - 1) / qmax;
+    if(limit > 32767)
+        limit = 32767;
+    for(int c=0; c<nch; c++) {
+        double m = rint(ldexp(scale[c], qf+shift));
+        if(m > limit)
+            m = limit;
+        else if(m < -limit)
+            m = -limit;
+        qw->mult[c] = (int16_t) m;
+    }
+    return 0;
+}
+
+void quant_weights_free(quant_weights *qw) {
+    free(qw->mult);
+    free(qw->q);
+    qw->mult = NULL;
+    qw->q = NULL;
+}
+
+/**
+ *  @brief Bytes taken by len codes of the given bits.
+ */
+size_t quant_bytes(int bits, size_t len) {
+    return bits == QUANT_INT4 ? (len+1)/2 : len;
+}
+
+/**
+ *  @brief Code i of the codes q of the given bits.
+ */
+int quant_get(const unsigned char *q, int bits, size_t i) {
+    if(bits == QUANT_INT4)
+        return (((q[i/2] >> (4*(i&1))) & 0xf) ^ 0x8) - 0x8;
+    return (int8_t) q[i];
+}
+
+/**
+ *  @brief Sets code i of qw, which must fit its bits.
+ */
+void quant_set(quant_weights *qw, size_t i, int code) {
+    if(qw->bits == QUANT_INT4) {
+        int sh = 4*(i&1);
+        qw->q[i/2] = (qw->q[i/2] & ~(0xf << sh)) | ((code & 0xf) << sh);
+    }
+    else {
+        qw->q[i] = (unsigned char) code;
+    }
+}
+
+/**
+ *  @brief Converts the n codes of qw from the first, all of channel ch, to
+ *  data_t weights in dst.
+ */
+void quant_unpack(const quant_weights *qw, size_t first, int n, int ch, data_t *dst) {
+    int32_t m = qw->mult[ch];
+    int sh = qw->shift;
+    int32_t r = sh ? 1 << (sh-1) : 0;
+    int i = 0;
+
+    if(qw->bits == QUANT_INT8) {
+        const int8_t *q = (const int8_t *) qw->q + first;
+        for(; i<n; i++) {
+            dst[i] = (data_t) ((q[i]*m + r) >> sh);
+        }
+        return;
+    }
+
+    const unsigned char *q = qw->q + first/2;
+    if((first & 1) && n > 0) {
+        dst[i++] = (data_t) ((((int8_t) *q >> 4)*m + r) >> sh);
+        q++;
+    }
+    // two codes per byte; the low nibble is sign-extended from bit 7
+    for(; i+1<n; i+=2, q++) {
+        int lo = (int8_t) (*q << 4) >> 4;
+        int hi = (int8_t) *q >> 4;
+        dst[i]   = (data_t) ((lo*m + r) >> sh);
+        dst[i+1] = (data_t) ((hi*m + r) >> sh);
+    }
+    if(i < n)
+        dst[i] = (data_t) ((((int8_t) (*q << 4) >> 4)*m + r) >> sh);
+}
+
+/**
+ *  @brief Copies the n codes of qw from the first to dst, from its first
+ *  byte (and low nibble) on, as a tile fetch would.
+ */
+void quant_copy(const quant_weights *qw, size_t first, int n, unsigned char *dst) {
+    if(qw->bits == QUANT_INT8) {
+        memcpy(dst, qw->q + first, n);
+        return;
+    }
+    const unsigned char *q = qw->q + first/2;
+    if(!(first & 1)) {
+        memcpy(dst, q, (n+1)/2);
+        return;
+    }
+    // odd start: every byte takes its nibbles from two source bytes
+    int j = 0;
+    for(; 2*j+1<n; j++) {
+        dst[j] = (q[j] >> 4) | (q[j+1] << 4);
+    }
+    if(2*j < n)
+        dst[j] = q[j] >> 4;
+}
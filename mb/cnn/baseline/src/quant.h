@@ -0,0 +1,42 @@
+/*
+ * quant.h
+ * Copyright (c) 2018 OPRECOMP Project
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef QUANT_H
+#define QUANT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+#define QUANT_INT8 8
+#define QUANT_INT4 4
+
+/**
+ *  Weights stored as 8-bit or 4-bit integer codes with a scale per channel
+ *  (output feature map or neuron). The weight of code q in channel c is the
+ *  data_t (q*mult[c]) >> shift, rounded to nearest: the real scale of the
+ *  channel in fixed point, with shift extra fractional bits.
+ */
+typedef struct quant_weights_tag {
+    int bits;           ///< bits per code, QUANT_INT8 or QUANT_INT4.
+    int nch;            ///< number of channels.
+    int shift;          ///< fractional bits of mult.
+    int16_t *mult;      ///< multiplier of every channel.
+    unsigned char *q;   ///< codes in two's complement; 4-bit ones two per byte, the first in the low nibble.
+    size_t len;         ///< number of codes.
+} quant_weights;
+
+int  quant_weights_init(quant_weights *qw, int bits, size_t len, int nch, const float *scale, unsigned qf);
+void quant_weights_free(quant_weights *qw);
+size_t quant_bytes(int bits, size_t len);
+int  quant_get(const unsigned char *q, int bits, size_t i);
+void quant_set(quant_weights *qw, size_t i, int code);
+void quant_unpack(const quant_weights *qw, size_t first, int n, int ch, data_t *dst);
+void quant_copy(const quant_weights *qw, size_t first, int n, unsigned char *dst);
+
+#endif /* QUANT_H */
@@ -12,8 +12,10 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <stdint.h>
 #ifdef CCN_X86
-  #include <stdint.h>
+  #include <stdlib.h>
+  #include <string.h>
 #endif
 
 extern unsigned int dmaId;
@@ -29,7 +31,14 @@ extern unsigned int dmaId;
    // #define CCN_CACHE
    #define FAKEDMA
    // #define CCN_TILING
-   // #define CCN_DOUBLEBUF
+   #ifdef CCN_TILING
+      // fe/ex/wb run concurrently on separate threads, so each stage needs its own buffers
+      #define CCN_DOUBLEBUF
+      #ifndef DISABLE_OPENMP
+         // ... persistent ones, see pipeline.c
+         #define CCN_PIPE_THREADS
+      #endif
+   #endif
 #endif
 
 #ifdef CCN_ARM
@@ -72,6 +81,12 @@ extern unsigned int dmaId;
    // #define CCN_TILING_LESSMEM
 #endif
 
+#if defined(CCN_TILING) && defined(FAKEDMA) && !defined(CCN_CACHE) && !defined(CCN_ENCRYPT)
+   // the tiles are copied out by the cores: apply the activation on the way
+   // (write-back stage) rather than in a pass of its own (execute stage)
+   #define CCN_WB_ACTIVATION
+#endif
+
 // activation types
 #define ACTIVATION_NONE 0
 #define ACTIVATION_TANH 1
@@ -82,6 +97,13 @@ extern unsigned int dmaId;
 #define PARALLEL_PIXEL 0
 #define PARALLEL_FEAT  1
 #define PARALLEL_HWCE  2
+#define PARALLEL_AUTO  3   // PIXEL or FEAT by the tile shape, see linalg_parallel_choose
+
+// convolution backends (see fastconv.h)
+#define CONV_DIRECT    0
+#define CONV_GEMM      1
+#define CONV_WINOGRAD  2
+#define CONV_WINOGRAD4 3
 
 // threads
 #define THREAD_FE 1
@@ -146,12 +168,16 @@ static inline void ccn_memcpy_async(void *dst, void *src, int size) {
 // #endif
 #ifndef NODMA
 #ifdef FAKEDMA
+#ifdef CCN_X86
+   memcpy(dst, src, size);
+#else /* ~CCN_X86 */
    for(i=0; i<size/4; i++) {
       ((unsigned *) dst) [i] = ((unsigned *) src) [i];
    }
    for(i=size-size%4; i<size; i++) {
       ((char *) dst) [i] = ((char *) src) [i];
    }
+#endif /* ~CCN_X86 */
 #else /* ~FAKEDMA */
 #if MCHAN_VERSION <= 3
    mchan_memcpy_async(dst, src, size);
@@ -216,8 +242,13 @@ static inline void ccn_memcpy_async_2d(
      }
 #else
    int cl=0, cr=0;
+   if(dst_stride_1 == size_0 && src_stride_1 == size_0) {
+      // contiguous rows, a single transfer
+      ccn_memcpy_async(dst, src, size_1*size_0);
+      return;
+   }
    for(cl=0,cr=0; cl<size_1*dst_stride_1; cl+=dst_stride_1,cr+=src_stride_1) {
-      ccn_memcpy_async(((unsigned) dst)+cl, ((unsigned) src)+cr, size_0);
+      ccn_memcpy_async((char *) dst + cl, (char *) src + cr, size_0);
    }
 #endif
 }
@@ -236,10 +267,10 @@ static inline void ccn_memcpy_async_3d(
    int bl=0, cl=0, br=0, cr=0;
    for(bl=0,br=0; bl<size_2*local_stride_2*local_stride_1; bl+=local_stride_2*local_stride_1,br+=remote_stride_2*remote_stride_1) {
 #if 1
-      ccn_memcpy_async_2d(((unsigned) dst) + bl, ((unsigned) src) + br, size_1, size_0, local_stride_1, remote_stride_1);
+      ccn_memcpy_async_2d((char *) dst + bl, (char *) src + br, size_1, size_0, local_stride_1, remote_stride_1);
 #else
       for(cl=0,cr=0; cl<size_1*local_stride_1; cl+=local_stride_1,cr+=remote_stride_1) {
-         ccn_memcpy_async(((unsigned) dst)+(bl+cl), ((unsigned) src)+(br+cr), size_0);
+         ccn_memcpy_async((char *) dst + (bl+cl), (char *) src + (br+cr), size_0);
       }
 #endif
    }
@@ -311,9 +342,13 @@ static void __attribute__((noinline)) ccn_memcpy(void *dst, void *src, int size)
    int i;
 #ifndef NODMA
 #ifdef FAKEDMA
+#ifdef CCN_X86
+   memcpy(dst, src, size);
+#else /* ~CCN_X86 */
    for(i=0; i<size; i++) {
       ((char *) dst) [i] = ((char *) src) [i];
    }
+#endif /* ~CCN_X86 */
 #else
 #if MCHAN_VERSION <= 3
    mchan_memcpy(dst, src, size);
@@ -326,9 +361,9 @@ static void __attribute__((noinline)) ccn_memcpy(void *dst, void *src, int size)
 #endif
 #ifdef CHECKDMA
    if(
-     (((unsigned)dst & 0x7) != ((unsigned)src & 0x7)) ||
-     (((unsigned)dst & 0x7)) || // && ((unsigned)dst >= L2_MEM_BASE_ADDR)) ||
-     (((unsigned)src & 0x7))  // && ((unsigned)src >= L2_MEM_BASE_ADDR)) 
+     (((uintptr_t)dst & 0x7) != ((uintptr_t)src & 0x7)) ||
+     (((uintptr_t)dst & 0x7)) || // && ((uintptr_t)dst >= L2_MEM_BASE_ADDR)) ||
+     (((uintptr_t)src & 0x7))  // && ((uintptr_t)src >= L2_MEM_BASE_ADDR)) 
    ) {
      printf("[memcpy] @%08x->@%08x misaligned transfer\n", src, dst);
    }
@@ -353,7 +388,6 @@ static inline void fake_memcpy(void *dst, void *src, int size) {
    for(i=0; i<size; i++) {
       ((char *) dst) [i] = ((char *) src) [i];
    }
-   unsigned *dst_int = ((unsigned)dst)-(((unsigned)dst)%8);
 #ifdef CHECKDMA
    int sumdst=0, sumsrc=0;
    volatile int j;
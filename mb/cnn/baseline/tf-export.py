@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 OPRECOMP Project
+#
+# Exports the parameters of the previously trained model for the fixed-point C
+# implementation (cnn-infer). The weights and biases of every layer are written
+# as raw float32 in the order of the network and in TensorFlow's layout; the
+# conversion to the layout of the C layers is done by cnn-infer.
+#
+# With -b 8 or -b 4, the weights are quantised to signed 8-bit or 4-bit codes
+# with a symmetric scale per output channel (the last axis in TensorFlow's
+# layout), or one per layer with --per-layer. Every weight tensor is then
+# written as its float32 scales followed by its codes, 4-bit ones two per
+# byte with the first in the low nibble, padded with zeros to a multiple of
+# four bytes; the biases stay float32. Read them with cnn-infer -w 8 or 4.
+
+import tensorflow as tf
+import numpy as np
+import sys
+import os
+import argparse
+
+
+MODEL_PATH = "data/source/mb/cnn/model.ckpt"
+OUTPUT_PATH = "data/prepared/mb/cnn/model.bin"
+LAYERS = ["conv1", "conv3", "fc5", "fc6", "fc7"]
+
+parser = argparse.ArgumentParser(description="Exports the trained CIFAR-10 model for cnn-infer.")
+parser.add_argument("-m", "--model", default=MODEL_PATH, help="checkpoint to read")
+parser.add_argument("-o", "--output", default=OUTPUT_PATH, help="parameter file to write")
+parser.add_argument("-b", "--bits", type=int, choices=[32, 8, 4], default=32, help="bits per weight (default 32, i.e. float32)")
+parser.add_argument("--per-layer", action="store_true", help="one scale per layer instead of per output channel")
+args = parser.parse_args()
+
+
+def quantize(w, bits, per_layer):
+	qmax = 2**(bits-1) - 1
+	axes = None if per_layer else tuple(range(w.ndim-1))
+	scale = np.abs(w).max(axis=axes) / qmax * np.ones(w.shape[-1])
+	scale = np.where(scale > 0, scale, 1.0).astype(np.float32)
+	codes = np.clip(np.rint(w / scale), -qmax, qmax).astype(np.int8)
+	return scale, codes
+
+
+def pack(codes, bits):
+	c = codes.reshape(-1).astype(np.uint8)
+	if bits == 4:
+		c = np.append(c & 0xf, np.zeros(len(c) % 2, np.uint8))
+		c = c[0::2] | (c[1::2] << 4)
+	return c.tobytes() + bytes(-len(c) % 4)
+
+
+reader = tf.train.NewCheckpointReader(args.model)
+os.makedirs(os.path.dirname(args.output) or ".", exist_ok=True)
+with open(args.output, "wb") as f:
+	for layer in LAYERS:
+		for var in ["weights", "biases"]:
+			t = reader.get_tensor(layer+"/"+var).astype(np.float32)
+			sys.stderr.write("%s/%s: shape=%s, range=[%g, %g]\n" % (layer, var, t.shape, t.min(), t.max()))
+			if var == "weights" and args.bits != 32:
+				scale, codes = quantize(t, args.bits, args.per_layer)
+				err = np.sqrt(np.mean((codes*scale - t)**2))
+				sys.stderr.write("%s/%s: %d-bit, scale=[%g, %g], rms error=%g\n" % (layer, var, args.bits, scale.min(), scale.max(), err))
+				scale.tofile(f)
+				f.write(pack(codes, args.bits))
+			else:
+				t.tofile(f)
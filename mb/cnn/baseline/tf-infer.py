@@ -41,6 +41,7 @@ y = cifar10.inference_graph(x)
 y_ = tf.placeholder(tf.int32, [None])
 all_losses = cifar10.losses(y, y_)
 all_accuracies = cifar10.accuracies(y, y_)
+all_classes = tf.argmax(y, 1)
 saver = tf.train.Saver()
 
 
@@ -67,13 +68,15 @@ if args.amester is not None:
 while True:
 	losses = list()
 	accuracies = list()
+	classes = list()
 	for i in range(NUM_TEST_SAMPLES // BATCH_SIZE):
-		last_losses, last_accuracies = sess.run([all_losses, all_accuracies], feed_dict={
+		last_losses, last_accuracies, last_classes = sess.run([all_losses, all_accuracies, all_classes], feed_dict={
 			x:  test_images[i*BATCH_SIZE:(i+1)*BATCH_SIZE],
 			y_: test_labels[i*BATCH_SIZE:(i+1)*BATCH_SIZE],
 		})
 		losses.extend(last_losses)
 		accuracies.extend(last_accuracies)
+		classes.extend(last_classes)
 
 	# Check with AMESTER whether we should continue iterating.
 	if args.amester is not None:
@@ -94,11 +97,12 @@ if args.amester is not None:
 sys.stderr.write("gathering statistics\n")
 losses = np.hstack(losses)
 accuracies = np.hstack(accuracies)
+classes = np.hstack(classes)
 
 with open("infer.dat", "w") as f:
-	f.write("# sample\tlabel\tloss\tcorrect\n")
-	for d in zip(np.arange(NUM_TEST_SAMPLES), test_labels, losses, accuracies):
-		f.write("%d\t%d\t%g\t%d\n" % d)
+	f.write("# sample\tlabel\tloss\tcorrect\tclass\n")
+	for d in zip(np.arange(NUM_TEST_SAMPLES), test_labels, losses, accuracies, classes):
+		f.write("%d\t%d\t%g\t%d\t%d\n" % d)
 
 with open("infer.stats", "w") as f:
 	f.write("loss\t%g\n" % np.mean(losses))
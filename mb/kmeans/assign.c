@@ -0,0 +1,141 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         assign.c                                                  */
+/*   Description:  Blocked assignment step: finds the nearest cluster center */
+/*                 of a range of objects, GEMM style. The centers are packed */
+/*                 transposed in panels of ASSIGN_PANEL together with their  */
+/*                 squared norms, so that                                    */
+/*                   |x-c|^2 = |x|^2 - 2 x.c + |c|^2                         */
+/*                 reduces to a dot product micro kernel over ASSIGN_ROWS    */
+/*                 objects x ASSIGN_PANEL centers on contiguous row major    */
+/*                 objects. |x|^2 does not change the argmin and is dropped. */
+/*                 Objects are tiled by ASSIGN_TILE and centers by           */
+/*                 ASSIGN_PANEL_TILE panels to stay in cache.                */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+
+#include "kmeans.h"
+
+#ifndef ASSIGN_PANEL
+#define ASSIGN_PANEL      8    /* centers per packed panel */
+#endif
+#ifndef ASSIGN_ROWS
+#define ASSIGN_ROWS       4    /* objects per micro kernel call */
+#endif
+#define ASSIGN_PANEL_TILE 16   /* panels per cache tile */
+
+#define NUM_PANELS(numClusters) (((numClusters)+ASSIGN_PANEL-1)/ASSIGN_PANEL)
+
+/*----< assign_packed_size() >-----------------------------------------------*/
+/* no. floats needed by assign_pack()                                        */
+int assign_packed_size(int numClusters,
+                       int numCoords)
+{
+    return NUM_PANELS(numClusters) * ASSIGN_PANEL * (numCoords + 1);
+}
+
+/*----< assign_pack() >------------------------------------------------------*/
+/* packed: [numPanels][numCoords][ASSIGN_PANEL] followed by the norms        */
+void assign_pack(int     numClusters,
+                 int     numCoords,
+                 float **clusters,  /* in: [numClusters][numCoords] */
+                 float  *packed)    /* out: assign_packed_size() floats */
+{
+    int    p, i, j, c, numPanels = NUM_PANELS(numClusters);
+    float *norms = packed + numPanels * ASSIGN_PANEL * numCoords;
+
+    for (p=0; p<numPanels; p++) {
+        for (c=0; c<ASSIGN_PANEL; c++) {
+            i = p * ASSIGN_PANEL + c;
+            /* padding centers are never the nearest */
+            norms[i] = (i < numClusters) ? 0.0 : FLT_MAX;
+            for (j=0; j<numCoords; j++) {
+                float v = (i < numClusters) ? clusters[i][j] : 0.0;
+                packed[(p * numCoords + j) * ASSIGN_PANEL + c] = v;
+                norms[i] += (i < numClusters) ? v * v : 0.0;
+            }
+        }
+    }
+}
+
+/*----< micro_kernel() >-----------------------------------------------------*/
+/* ASSIGN_ROWS objects against one panel, updates the running minimum        */
+__inline static
+void micro_kernel(int          numCoords,
+                  const float *x[ASSIGN_ROWS], /* object rows */
+                  int          rows,           /* valid rows <= ASSIGN_ROWS */
+                  const float *panel,          /* [numCoords][ASSIGN_PANEL] */
+                  const float *norms,          /* [ASSIGN_PANEL] */
+                  int          base,           /* index of 1st center */
+                  float       *best,           /* [rows] */
+                  int         *index)          /* [rows] */
+{
+    int   r, c, j;
+    float acc[ASSIGN_ROWS][ASSIGN_PANEL];
+
+    /* fully unrolled so that acc[][] lives in vector registers */
+    #pragma GCC unroll 16
+    for (r=0; r<ASSIGN_ROWS; r++)
+        #pragma GCC unroll 16
+        for (c=0; c<ASSIGN_PANEL; c++)
+            acc[r][c] = 0.0;
+
+    for (j=0; j<numCoords; j++) {
+        const float *w = panel + j * ASSIGN_PANEL;
+        #pragma GCC unroll 16
+        for (r=0; r<ASSIGN_ROWS; r++) {
+            float v = x[r][j];
+            #pragma GCC unroll 16
+            for (c=0; c<ASSIGN_PANEL; c++)
+                acc[r][c] += v * w[c];
+        }
+    }
+
+    for (r=0; r<rows; r++) {
+        for (c=0; c<ASSIGN_PANEL; c++) {
+            float dist = norms[c] - 2.0f * acc[r][c];
+            if (dist < best[r]) { /* strict: ties keep the lower index */
+                best[r]  = dist;
+                index[r] = base + c;
+            }
+        }
+    }
+}
+
+/*----< assign_nearest() >---------------------------------------------------*/
+/* nearest center of numObjs contiguous objects, at most ASSIGN_TILE         */
+void assign_nearest(int          numObjs,
+                    int          numCoords,
+                    int          numClusters,
+                    const float *objects,  /* in: [numObjs][numCoords] */
+                    const float *packed,   /* in: from assign_pack() */
+                    int         *index)    /* out: [numObjs] */
+{
+    int          i, r, p, p0, rows, numPanels = NUM_PANELS(numClusters);
+    const float *norms = packed + numPanels * ASSIGN_PANEL * numCoords;
+    const float *x[ASSIGN_ROWS];
+    float        best[ASSIGN_TILE];
+
+    assert(numObjs <= ASSIGN_TILE);
+    for (i=0; i<numObjs; i++) best[i] = FLT_MAX;
+    for (i=0; i<numObjs; i++) index[i] = 0;
+
+    for (p0=0; p0<numPanels; p0+=ASSIGN_PANEL_TILE) {
+        int p1 = (p0 + ASSIGN_PANEL_TILE < numPanels) ? p0 + ASSIGN_PANEL_TILE
+                                                      : numPanels;
+        for (i=0; i<numObjs; i+=ASSIGN_ROWS) {
+            rows = (numObjs - i < ASSIGN_ROWS) ? numObjs - i : ASSIGN_ROWS;
+            /* pad a short group by repeating its last object */
+            for (r=0; r<ASSIGN_ROWS; r++)
+                x[r] = objects + (i + (r < rows ? r : rows - 1)) * numCoords;
+            for (p=p0; p<p1; p++)
+                micro_kernel(numCoords, x, rows,
+                             packed + p * numCoords * ASSIGN_PANEL,
+                             norms + p * ASSIGN_PANEL, p * ASSIGN_PANEL,
+                             best + i, index + i);
+        }
+    }
+}
@@ -16,8 +16,29 @@
 
 #include <assert.h>
 
-int omp_kmeans(int, float**, int, int, int, float, int*, float**);
-int seq_kmeans(float**, int, int, int, float, int*, float**);
+int omp_kmeans(int, int, float**, int, int, int, float, int*, float**);
+int seq_kmeans(int, float**, int, int, int, float, int*, float**);
+int omp_hamerly_kmeans(float**, int, int, int, float, int*, float**);
+int omp_yinyang_kmeans(float**, int, int, int, float, int*, float**);
+int omp_stream_kmeans(char*, int, int, int, int, int, int, float, int*, float**);
+int stream_header(char*, int*, int*);
+
+/* reduced precision object storage (omp_lowp.c) */
+#define LOWP_HALF     0
+#define LOWP_BFLOAT16 1
+#define LOWP_INT8     2
+#define LOWP_FORMATS  3
+extern const char *lowp_name[LOWP_FORMATS];
+int omp_lowp_kmeans(int, float**, int, int, int, float, int*, float**);
+
+int seed_kmeanspp(float**, int, int, int, unsigned int, float**);
+int seed_kmeans_parallel(float**, int, int, int, unsigned int, float**);
+
+/* blocked assignment step (assign.c), objects are handed out in tiles */
+#define ASSIGN_TILE 256
+int  assign_packed_size(int, int);
+void assign_pack(int, int, float**, float*);
+void assign_nearest(int, int, int, const float*, const float*, int*);
 
 float** file_read(int, char*, int*, int*);
 int     file_write(char*, int, int, int, float**, int*, int);
@@ -25,6 +25,17 @@
 #include <omp.h>
 #include "kmeans.h"
 
+#define CACHE_LINE 64  /* bytes, per thread accumulators start on their own */
+
+/*----< padded() >-----------------------------------------------------------*/
+/* n elements of size bytes rounded up to whole cache lines, in elements     */
+static
+size_t padded(size_t n,
+              size_t size)
+{
+    return (n * size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE / size;
+}
+
 
 /*----< euclid_dist_2() >----------------------------------------------------*/
 /* square of Euclid distance between two multi-dimensional points            */
@@ -70,7 +81,9 @@ int find_nearest_cluster(int     numClusters, /* no. clusters */
 
 /*----< kmeans_clustering() >------------------------------------------------*/
 /* return an array of cluster centers of size [numClusters][numCoords]       */
+/* and the no. iterations                                                    */
 int omp_kmeans(int     is_perform_atomic, /* in: */
+               int     is_blocked,        /* in: use blocked assignment */
                float **objects,           /* in: [numObjs][numCoords] */
                int     numCoords,         /* no. coordinates */
                int     numObjs,           /* no. objects */
@@ -87,8 +100,13 @@ int omp_kmeans(int     is_perform_atomic, /* in: */
     double   timing;
 
     int      nthreads;             /* no. threads */
-    int    **local_newClusterSize; /* [nthreads][numClusters] */
-    float ***local_newClusters;    /* [nthreads][numClusters][numCoords] */
+    size_t   sizeStride, sumStride;/* per thread, padded to cache lines */
+    int     *local_newClusterSize; /* [nthreads][sizeStride] */
+    float   *local_newClusters;    /* [nthreads][sumStride], a thread's
+                                      [numClusters][numCoords] sums */
+
+    int     *nearest=NULL;  /* [numObjs]: blocked assignment result */
+    float   *packed=NULL;   /* packed cluster centers for assign_nearest() */
 
     nthreads = omp_get_max_threads();
 
@@ -108,47 +126,64 @@ int omp_kmeans(int     is_perform_atomic, /* in: */
 
     if (!is_perform_atomic) {
         /* each thread calculates new centers using a private space,
-           then thread 0 does an array reduction on them. This approach
-           should be faster */
-        local_newClusterSize    = (int**) malloc(nthreads * sizeof(int*));
-        assert(local_newClusterSize != NULL);
-        local_newClusterSize[0] = (int*)  calloc(nthreads*numClusters,
-                                                 sizeof(int));
-        assert(local_newClusterSize[0] != NULL);
-        for (i=1; i<nthreads; i++)
-            local_newClusterSize[i] = local_newClusterSize[i-1]+numClusters;
-
-        /* local_newClusters is a 3D array */
-        local_newClusters    =(float***)malloc(nthreads * sizeof(float**));
-        assert(local_newClusters != NULL);
-        local_newClusters[0] =(float**) malloc(nthreads * numClusters *
-                                               sizeof(float*));
-        assert(local_newClusters[0] != NULL);
-        for (i=1; i<nthreads; i++)
-            local_newClusters[i] = local_newClusters[i-1] + numClusters;
-        for (i=0; i<nthreads; i++) {
-            for (j=0; j<numClusters; j++) {
-                local_newClusters[i][j] = (float*)calloc(numCoords,
-                                                         sizeof(float));
-                assert(local_newClusters[i][j] != NULL);
-            }
+           then the threads add them up pairwise in a tree. A thread's
+           space starts on a cache line of its own, so no two threads
+           write to the same line, and is zeroed by the thread itself, so
+           the first touch places its pages on the thread's NUMA node */
+        sizeStride = padded(numClusters, sizeof(int));
+        sumStride  = padded((size_t)numClusters * numCoords, sizeof(float));
+        i = posix_memalign((void**)&local_newClusterSize, CACHE_LINE,
+                           nthreads * sizeStride * sizeof(int));
+        assert(i == 0);
+        i = posix_memalign((void**)&local_newClusters, CACHE_LINE,
+                           nthreads * sumStride * sizeof(float));
+        assert(i == 0);
+
+        #pragma omp parallel private(i)
+        {
+            int tid = omp_get_thread_num();
+            for (i=0; i<sizeStride; i++)
+                local_newClusterSize[tid*sizeStride + i] = 0;
+            for (i=0; i<sumStride; i++)
+                local_newClusters[tid*sumStride + i] = 0.0;
         }
     }
 
+    if (is_blocked) {
+        /* the blocked kernel reads objects[0] as one row major array */
+        nearest = (int*)   malloc(numObjs * sizeof(int));
+        assert(nearest != NULL);
+        packed  = (float*) malloc(assign_packed_size(numClusters, numCoords) *
+                                  sizeof(float));
+        assert(packed != NULL);
+    }
+
     if (_debug) timing = omp_get_wtime();
     do {
         delta = 0.0;
 
+        if (is_blocked) {
+            /* find the nearest cluster centers of all objects up front */
+            assign_pack(numClusters, numCoords, clusters, packed);
+            #pragma omp parallel for schedule(static)
+            for (i=0; i<numObjs; i+=ASSIGN_TILE)
+                assign_nearest((numObjs-i < ASSIGN_TILE) ? numObjs-i
+                                                         : ASSIGN_TILE,
+                               numCoords, numClusters, objects[i], packed,
+                               nearest+i);
+        }
+
         if (is_perform_atomic) {
             #pragma omp parallel for \
                     private(i,j,index) \
                     firstprivate(numObjs,numClusters,numCoords) \
-                    shared(objects,clusters,membership,newClusters,newClusterSize) \
+                    shared(objects,clusters,membership,newClusters,newClusterSize,nearest) \
                     schedule(static) \
                     reduction(+:delta)
             for (i=0; i<numObjs; i++) {
                 /* find the array index of nestest cluster center */
-                index = find_nearest_cluster(numClusters, numCoords, objects[i],
+                index = is_blocked ? nearest[i] :
+                        find_nearest_cluster(numClusters, numCoords, objects[i],
                                              clusters);
 
                 /* if membership changes, increase delta by 1 */
@@ -164,12 +199,27 @@ int omp_kmeans(int     is_perform_atomic, /* in: */
                     #pragma omp atomic
                     newClusters[index][j] += objects[i][j];
             }
+
+            /* average the sum and replace old cluster centers with newClusters */
+            for (i=0; i<numClusters; i++) {
+                for (j=0; j<numCoords; j++) {
+                    if (newClusterSize[i] > 1)
+                        clusters[i][j] = newClusters[i][j] / newClusterSize[i];
+                    newClusters[i][j] = 0.0;   /* set back to 0 */
+                }
+                newClusterSize[i] = 0;   /* set back to 0 */
+            }
         }
         else {
             #pragma omp parallel \
-                    shared(objects,clusters,membership,local_newClusters,local_newClusterSize)
+                    shared(objects,clusters,membership,local_newClusters,local_newClusterSize,nearest)
             {
-                int tid = omp_get_thread_num();
+                int    tid     = omp_get_thread_num();
+                int    nteam   = omp_get_num_threads();
+                int   *mySize  = local_newClusterSize + tid*sizeStride;
+                float *mySum   = local_newClusters    + tid*sumStride;
+                int    stride, l;
+
                 #pragma omp for \
                             private(i,j,index) \
                             firstprivate(numObjs,numClusters,numCoords) \
@@ -177,7 +227,8 @@ int omp_kmeans(int     is_perform_atomic, /* in: */
                             reduction(+:delta)
                 for (i=0; i<numObjs; i++) {
                     /* find the array index of nestest cluster center */
-                    index = find_nearest_cluster(numClusters, numCoords,
+                    index = is_blocked ? nearest[i] :
+                            find_nearest_cluster(numClusters, numCoords,
                                                  objects[i], clusters);
 
                     /* if membership changes, increase delta by 1 */
@@ -188,35 +239,45 @@ int omp_kmeans(int     is_perform_atomic, /* in: */
 
                     /* update new cluster centers : sum of all objects located
                        within (average will be performed later) */
-                    local_newClusterSize[tid][index]++;
+                    mySize[index]++;
                     for (j=0; j<numCoords; j++)
-                        local_newClusters[tid][index][j] += objects[i][j];
+                        mySum[index*numCoords + j] += objects[i][j];
+                }
+                /* implicit barrier: all partial sums are complete */
+
+                /* tree reduction: in round stride, thread tid adds the
+                   space of thread tid+stride to its own and zeroes it, so
+                   after log2(nteam) rounds thread 0 holds the sums */
+                for (stride=1; stride<nteam; stride*=2) {
+                    if (tid % (2*stride) == 0 && tid + stride < nteam) {
+                        int   *peerSize = mySize + stride*sizeStride;
+                        float *peerSum  = mySum  + stride*sumStride;
+                        for (l=0; l<numClusters; l++) {
+                            mySize[l]  += peerSize[l];
+                            peerSize[l] = 0;
+                        }
+                        for (l=0; l<numClusters*numCoords; l++) {
+                            mySum[l]  += peerSum[l];
+                            peerSum[l] = 0.0;
+                        }
+                    }
+                    #pragma omp barrier
                 }
-            } /* end of #pragma omp parallel */
 
-            /* let the main thread perform the array reduction */
-            for (i=0; i<numClusters; i++) {
-                for (j=0; j<nthreads; j++) {
-                    newClusterSize[i] += local_newClusterSize[j][i];
-                    local_newClusterSize[j][i] = 0.0;
-                    for (k=0; k<numCoords; k++) {
-                        newClusters[i][k] += local_newClusters[j][i][k];
-                        local_newClusters[j][i][k] = 0.0;
+                /* average the sums of thread 0 into the cluster centers */
+                #pragma omp for private(j) schedule(static)
+                for (k=0; k<numClusters; k++) {
+                    int   size = local_newClusterSize[k];
+                    float *sum = local_newClusters + k*numCoords;
+                    for (j=0; j<numCoords; j++) {
+                        if (size > 1) clusters[k][j] = sum[j] / size;
+                        sum[j] = 0.0;
                     }
+                    local_newClusterSize[k] = 0;
                 }
-            }
+            } /* end of #pragma omp parallel */
         }
 
-        /* average the sum and replace old cluster centers with newClusters */
-        for (i=0; i<numClusters; i++) {
-            for (j=0; j<numCoords; j++) {
-                if (newClusterSize[i] > 1)
-                    clusters[i][j] = newClusters[i][j] / newClusterSize[i];
-                newClusters[i][j] = 0.0;   /* set back to 0 */
-            }
-            newClusterSize[i] = 0;   /* set back to 0 */
-        }
-            
         delta /= numObjs;
     } while (delta > threshold && loop++ < 500);
 
@@ -226,19 +287,18 @@ int omp_kmeans(int     is_perform_atomic, /* in: */
     }
 
     if (!is_perform_atomic) {
-        free(local_newClusterSize[0]);
         free(local_newClusterSize);
-
-        for (i=0; i<nthreads; i++)
-            for (j=0; j<numClusters; j++)
-                free(local_newClusters[i][j]);
-        free(local_newClusters[0]);
         free(local_newClusters);
     }
+    if (is_blocked) {
+        free(nearest);
+        free(packed);
+    }
     free(newClusters[0]);
     free(newClusters);
     free(newClusterSize);
 
-    return 1;
+    /* loop was not incremented by the last test if delta fell below */
+    return (delta > threshold) ? loop : loop+1;
 }
 
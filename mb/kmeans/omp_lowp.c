@@ -0,0 +1,313 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         omp_lowp.c  (OpenMP version)                              */
+/*   Description:  k-means clustering on objects stored in reduced precision */
+/*                 1. LOWP_HALF:     IEEE binary16                           */
+/*                 2. LOWP_BFLOAT16: upper half of a binary32                */
+/*                 3. LOWP_INT8:     8-bit integers with a per coordinate    */
+/*                                   scale and offset over [min, max]        */
+/*                 The objects are converted once, with round to nearest     */
+/*                 even. Every iteration decodes tiles of ASSIGN_TILE        */
+/*                 objects back to float in branch free loops the compiler   */
+/*                 vectorizes, assigns them with the blocked kernel of       */
+/*                 assign.c and sums them into double precision centers.     */
+/*                 binary16 uses the F16C instructions of x86-64 CPUs that   */
+/*                 have them. The iteration is the one of omp_kmeans().      */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>       /* nearbyintf() */
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_F16C_DISPATCH
+#endif
+
+#include <omp.h>
+#include "kmeans.h"
+
+typedef union { unsigned int u; float f; } bits32;
+
+const char *lowp_name[LOWP_FORMATS] = { "half", "bfloat16", "int8" };
+
+/*----< float_to_half() >----------------------------------------------------*/
+static
+unsigned short float_to_half(float x)
+{
+    bits32       b;
+    unsigned int sign, u;
+
+    b.f  = x;
+    sign = (b.u >> 16) & 0x8000;
+    u    = b.u & 0x7fffffff;
+
+    if (u > 0x7f800000) return sign | 0x7e00;  /* NaN */
+    if (u >= 0x477ff000) return sign | 0x7c00; /* rounds to infinity */
+    if (u < 0x38800000) {
+        /* subnormal: an integer no. of 2^-24 */
+        b.u = u;
+        return sign | (unsigned short)nearbyintf(b.f * 0x1p24f);
+    }
+    /* rebias the exponent, round the mantissa from 23 to 10 bits */
+    u -= 112u << 23;
+    u += 0xfff + ((u >> 13) & 1);
+    return sign | (u >> 13);
+}
+
+/*----< float_to_bfloat16() >------------------------------------------------*/
+static
+unsigned short float_to_bfloat16(float x)
+{
+    bits32 b;
+
+    b.f = x;
+    if ((b.u & 0x7fffffff) > 0x7f800000) return (b.u >> 16) | 0x40; /* NaN */
+    b.u += 0x7fff + ((b.u >> 16) & 1);
+    return b.u >> 16;
+}
+
+/*----< half_to_float() >----------------------------------------------------*/
+__inline static
+float half_to_float(unsigned short h)
+{
+    bits32 b;
+
+    /* exponent and mantissa as a binary32 2^112 too small, the product also
+       covers the subnormals */
+    b.u  = (h & 0x7fff) << 13;
+    b.f *= 0x1p112f;
+    b.u |= ((h & 0x7c00) == 0x7c00) ? 0x7f800000 : 0;  /* Inf, NaN */
+    b.u |= (h & 0x8000) << 16;
+    return b.f;
+}
+
+/*----< bfloat16_to_float() >------------------------------------------------*/
+__inline static
+float bfloat16_to_float(unsigned short h)
+{
+    bits32 b;
+
+    b.u = (unsigned int)h << 16;
+    return b.f;
+}
+
+#ifdef HAVE_F16C_DISPATCH
+/*----< decode_half_f16c() >-------------------------------------------------*/
+/* the hardware conversion, when the CPU has it, for len multiple of 8       */
+__attribute__((target("f16c,avx")))
+static
+void decode_half_f16c(long                  len,
+                      const unsigned short *s,
+                      float                *tile)
+{
+    long i;
+
+    for (i=0; i<len; i+=8)
+        _mm256_storeu_ps(tile + i,
+                         _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(s + i))));
+}
+#endif
+
+/*----< decode_tile() >------------------------------------------------------*/
+/* objects [first, first+n) back to float. The fixed LOWP_VEC wide inner     */
+/* loops are what the vectorizer of -O2 accepts.                             */
+#define LOWP_VEC 8
+
+static
+void decode_tile(int                   format,
+                 int                   n,
+                 int                   numCoords,
+                 const void           *store,   /* [numObjs][numCoords] */
+                 long                  first,
+                 const float *restrict scale,   /* [numCoords], LOWP_INT8 */
+                 const float *restrict offset,  /* [numCoords], LOWP_INT8 */
+                 float       *restrict tile)    /* out: [n][numCoords] */
+{
+    long i, j, l, len = (long)n * numCoords;
+
+    if (format == LOWP_HALF) {
+        const unsigned short *s = (const unsigned short*)store + first*numCoords;
+#ifdef HAVE_F16C_DISPATCH
+        if (__builtin_cpu_supports("f16c")) {
+            i = len / 8 * 8;
+            decode_half_f16c(i, s, tile);
+        }
+        else
+#endif
+        for (i=0; i+LOWP_VEC<=len; i+=LOWP_VEC)
+            for (l=0; l<LOWP_VEC; l++)
+                tile[i+l] = half_to_float(s[i+l]);
+        for (; i<len; i++)
+            tile[i] = half_to_float(s[i]);
+    }
+    else if (format == LOWP_BFLOAT16) {
+        const unsigned short *s = (const unsigned short*)store + first*numCoords;
+        for (i=0; i+LOWP_VEC<=len; i+=LOWP_VEC)
+            for (l=0; l<LOWP_VEC; l++)
+                tile[i+l] = bfloat16_to_float(s[i+l]);
+        for (; i<len; i++)
+            tile[i] = bfloat16_to_float(s[i]);
+    }
+    else {
+        const signed char *s = (const signed char*)store + first*numCoords;
+        for (i=0; i<n; i++) {
+            const signed char *q = s + i*numCoords;
+            float *restrict    x = tile + i*numCoords;
+            for (j=0; j+LOWP_VEC<=numCoords; j+=LOWP_VEC)
+                for (l=0; l<LOWP_VEC; l++)
+                    x[j+l] = offset[j+l] + scale[j+l] * q[j+l];
+            for (; j<numCoords; j++)
+                x[j] = offset[j] + scale[j] * q[j];
+        }
+    }
+}
+
+/*----< omp_lowp_kmeans() >--------------------------------------------------*/
+/* return an array of cluster centers of size [numClusters][numCoords]       */
+/* and the no. iterations                                                    */
+int omp_lowp_kmeans(int     format,       /* LOWP_HALF, _BFLOAT16 or _INT8 */
+                    float **objects,      /* in: [numObjs][numCoords] */
+                    int     numCoords,    /* no. coordinates */
+                    int     numObjs,      /* no. objects */
+                    int     numClusters,  /* no. clusters */
+                    float   threshold,    /* % objects change membership */
+                    int    *membership,   /* out: [numObjs] */
+                    float **clusters)     /* out: [numClusters][numCoords] */
+{
+    int     i, j, k, t, loop=0, nthreads;
+    long    len = (long)numObjs * numCoords;
+    float   delta;         /* % of objects change their clusters */
+    void   *store;         /* [numObjs][numCoords] reduced precision */
+    float  *scale=NULL;    /* [numCoords]: LOWP_INT8 step */
+    float  *offset=NULL;   /* [numCoords]: LOWP_INT8 value of 0 */
+    float  *packed;        /* packed cluster centers for assign_nearest() */
+    int    *localSize;     /* [nthreads][numClusters] */
+    double *localSum;      /* [nthreads][numClusters][numCoords] */
+    double  timing;
+
+    nthreads = omp_get_max_threads();
+
+    /* convert the objects ---------------------------------------------------*/
+    if (format == LOWP_INT8) {
+        signed char *s = (signed char*) malloc(len);
+        assert(s != NULL);
+        scale  = (float*) malloc(numCoords * sizeof(float));
+        assert(scale != NULL);
+        offset = (float*) malloc(numCoords * sizeof(float));
+        assert(offset != NULL);
+        for (j=0; j<numCoords; j++) {
+            float min = objects[0][j], max = objects[0][j];
+            for (i=1; i<numObjs; i++) {
+                if (objects[i][j] < min) min = objects[i][j];
+                if (objects[i][j] > max) max = objects[i][j];
+            }
+            /* [min, max] onto [-128, 127] */
+            scale[j]  = (max - min) / 255;
+            offset[j] = min + 128 * scale[j];
+        }
+        #pragma omp parallel for private(j) schedule(static)
+        for (i=0; i<numObjs; i++) {
+            for (j=0; j<numCoords; j++) {
+                float q = (scale[j] > 0.0) ?
+                          nearbyintf((objects[i][j] - offset[j]) / scale[j]) : 0;
+                if (q < -128) q = -128;
+                if (q >  127) q =  127;
+                s[(long)i*numCoords + j] = (signed char)q;
+            }
+        }
+        store = s;
+    }
+    else {
+        unsigned short *s = (unsigned short*) malloc(len * sizeof(short));
+        assert(s != NULL);
+        #pragma omp parallel for private(j) schedule(static)
+        for (i=0; i<numObjs; i++)
+            for (j=0; j<numCoords; j++)
+                s[(long)i*numCoords + j] = (format == LOWP_HALF) ?
+                    float_to_half(objects[i][j]) :
+                    float_to_bfloat16(objects[i][j]);
+        store = s;
+    }
+
+    for (i=0; i<numObjs; i++) membership[i] = -1;
+
+    packed = (float*) malloc(assign_packed_size(numClusters, numCoords) *
+                             sizeof(float));
+    assert(packed != NULL);
+    localSize = (int*)    calloc(nthreads * numClusters, sizeof(int));
+    assert(localSize != NULL);
+    localSum  = (double*) calloc(nthreads * numClusters * numCoords,
+                                 sizeof(double));
+    assert(localSum != NULL);
+
+    if (_debug) timing = omp_get_wtime();
+    do {
+        delta = 0.0;
+
+        assign_pack(numClusters, numCoords, clusters, packed);
+
+        #pragma omp parallel private(j)
+        {
+            int    tid = omp_get_thread_num();
+            int    index[ASSIGN_TILE];
+            float *tile = (float*) malloc(ASSIGN_TILE * numCoords *
+                                          sizeof(float));
+            assert(tile != NULL);
+
+            #pragma omp for schedule(static) reduction(+:delta)
+            for (t=0; t<numObjs; t+=ASSIGN_TILE) {
+                int l, n = (numObjs-t < ASSIGN_TILE) ? numObjs-t : ASSIGN_TILE;
+
+                decode_tile(format, n, numCoords, store, t, scale, offset,
+                            tile);
+                assign_nearest(n, numCoords, numClusters, tile, packed, index);
+
+                for (l=0; l<n; l++) {
+                    double *sum = localSum + ((long)tid*numClusters +
+                                              index[l])*numCoords;
+                    if (membership[t+l] != index[l]) delta += 1.0;
+                    membership[t+l] = index[l];
+                    localSize[tid*numClusters + index[l]]++;
+                    for (j=0; j<numCoords; j++)
+                        sum[j] += tile[l*numCoords + j];
+                }
+            }
+            free(tile);
+        }
+
+        /* reduce and average, same rule as omp_kmeans() */
+        for (k=0; k<numClusters; k++) {
+            int size = 0;
+            for (t=0; t<nthreads; t++) {
+                size += localSize[t*numClusters + k];
+                localSize[t*numClusters + k] = 0;
+            }
+            for (j=0; j<numCoords; j++) {
+                double sum = 0.0;
+                for (t=0; t<nthreads; t++) {
+                    sum += localSum[((long)t*numClusters + k)*numCoords + j];
+                    localSum[((long)t*numClusters + k)*numCoords + j] = 0.0;
+                }
+                if (size > 1) clusters[k][j] = sum / size;
+            }
+        }
+
+        delta /= numObjs;
+    } while (delta > threshold && loop++ < 500);
+
+    if (_debug) {
+        timing = omp_get_wtime() - timing;
+        printf("nloops = %2d (T = %7.4f)",loop,timing);
+    }
+
+    free(localSum);
+    free(localSize);
+    free(packed);
+    free(offset);
+    free(scale);
+    free(store);
+
+    /* loop was not incremented by the last test if delta fell below */
+    return (delta > threshold) ? loop : loop+1;
+}
@@ -18,6 +18,7 @@
 /*                                                                           */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+#define _GNU_SOURCE     /* sched_setaffinity() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>     /* strtok() */
@@ -25,6 +26,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>     /* getopt() */
+#ifdef __linux__
+#include <sched.h>      /* sched_setaffinity() */
+#endif
 
 #include <omp.h>
 int      _debug;
@@ -39,6 +43,40 @@ int     pnetcdf_write(char*, int, int, int, int, float**, int*, int, MPI_Comm,
                       int verbose);
 #endif
 
+#define DEFAULT_BATCH_SIZE 16384
+#define DEFAULT_NUM_PASSES 10
+
+/*---< pin_threads() >------------------------------------------------------*/
+/* bind each OpenMP thread to one CPU of the affinity mask of the process:  */
+/* close puts thread t on the t-th CPU, spread spaces the threads evenly    */
+/* over all CPUs. The runtime keeps the threads for the later parallel      */
+/* regions of the same size. Returns 0 if binding is not supported.         */
+static int pin_threads(char *binding) {
+#ifdef __linux__
+    int        c, ncpus, ok=1;
+    static int cpus[CPU_SETSIZE];
+    cpu_set_t  mask;
+
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return 0;
+    for (ncpus=0, c=0; c<CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &mask)) cpus[ncpus++] = c;
+
+    #pragma omp parallel private(c, mask) reduction(&&:ok)
+    {
+        int tid = omp_get_thread_num();
+        int n   = omp_get_num_threads();
+        c = (strcmp(binding, "spread") == 0) ? (int)((long)tid * ncpus / n)
+                                             : tid % ncpus;
+        CPU_ZERO(&mask);
+        CPU_SET(cpus[c], &mask);
+        ok = (sched_setaffinity(0, sizeof(mask), &mask) == 0);
+    }
+    return ok;
+#else
+    return 0;
+#endif
+}
+
 /*---< usage() >------------------------------------------------------------*/
 static void usage(char *argv0, float threshold) {
     char *help =
@@ -49,14 +87,27 @@ static void usage(char *argv0, float threshold) {
         "       -n num_clusters: number of clusters (K must > 1)\n"
         "       -t threshold   : threshold value (default %.4f)\n"
         "       -p nproc       : number of threads (default system allocated)\n"
+        "       -x binding     : pin threads to CPUs, none, close or spread\n"
+        "                      : (default none, i.e. left to OMP_PROC_BIND)\n"
         "       -a             : perform atomic OpenMP pragma (default no)\n"
+        "       -g             : blocked GEMM style assignment step (default no)\n"
+        "       -m method      : lloyd, hamerly, yinyang or stream (default lloyd)\n"
+        "       -s batch_size  : objects per mini-batch of stream (default %d)\n"
+        "       -e num_passes  : max. passes over the file of stream (default %d)\n"
+        "       -f             : final assignment pass of stream (default no)\n"
+        "       -k seeding     : initial centers, first, kmeans++ or kmeans||\n"
+        "                      : (default first, ignored with -c centers)\n"
+        "       -r seed        : random seed of kmeans++ and kmeans|| (default 1)\n"
+        "       -l format      : store objects as half, bfloat16 or int8 and report\n"
+        "                      : the membership agreement with float (default float)\n"
         "       -o             : output timing results (default no)\n"
         "       -c var_name    : using PnetCDF for file input and output and var_name\n"
         "                      : is variable name in the netCDF file to be clustered\n"
         "       -q             : quiet mode\n"
         "       -d             : enable debug mode\n"
         "       -h             : print this help information\n";
-    fprintf(stderr, help, argv0, threshold);
+    fprintf(stderr, help, argv0, threshold, DEFAULT_BATCH_SIZE,
+            DEFAULT_NUM_PASSES);
     exit(-1);
 }
 
@@ -67,7 +118,15 @@ int main(int argc, char **argv) {
     extern int     optind;
            int     i, j, nthreads, verbose;
            int     isBinaryFile, is_perform_atomic, is_output_timing;
+           int     is_blocked;
+           char   *method;
+           int     is_stream, batchSize, numPasses, is_full_pass;
+           char   *seeding;
+           int     seed, ok, loops;
+           int     lowp;          /* LOWP_* format or -1 for float */
+           float **init_clusters; /* initial centers for the float reference */
            int     do_pnetcdf;
+           char   *binding;
 
            int     numClusters, numCoords, numObjs;
            int    *membership;    /* [numObjs] */
@@ -76,7 +135,7 @@ int main(int argc, char **argv) {
            float **objects;       /* [numObjs][numCoords] data objects */
            float **clusters;      /* [numClusters][numCoords] cluster center */
            float   threshold;
-           double  timing, io_timing, clustering_timing;
+           double  timing, io_timing, clustering_timing, seeding_timing;
 
 #ifdef _PNETCDF_BUILT
     MPI_Init(&argc, &argv);
@@ -92,12 +151,21 @@ int main(int argc, char **argv) {
     isBinaryFile      = 0;
     is_output_timing  = 0;
     is_perform_atomic = 0;
+    is_blocked        = 0;
+    method            = "lloyd";
+    batchSize         = DEFAULT_BATCH_SIZE;
+    numPasses         = DEFAULT_NUM_PASSES;
+    is_full_pass      = 0;
+    seeding           = "first";
+    seed              = 1;
+    lowp              = -1;
     filename          = NULL;
     do_pnetcdf        = 0;
     var_name          = NULL;
     center_filename   = NULL;
+    binding           = "none";
 
-    while ( (opt=getopt(argc,argv,"p:i:n:t:c:v:abdohq"))!= EOF) {
+    while ( (opt=getopt(argc,argv,"p:i:n:t:c:v:m:s:e:k:r:l:x:abdfghoq"))!= EOF) {
         switch (opt) {
             case 'i': filename=optarg;
                       break;
@@ -111,8 +179,28 @@ int main(int argc, char **argv) {
                       break;
             case 'p': nthreads = atoi(optarg);
                       break;
+            case 'x': binding = optarg;
+                      break;
             case 'a': is_perform_atomic = 1;
                       break;
+            case 'g': is_blocked = 1;
+                      break;
+            case 'm': method = optarg;
+                      break;
+            case 's': batchSize = atoi(optarg);
+                      break;
+            case 'e': numPasses = atoi(optarg);
+                      break;
+            case 'f': is_full_pass = 1;
+                      break;
+            case 'k': seeding = optarg;
+                      break;
+            case 'r': seed = atoi(optarg);
+                      break;
+            case 'l': for (lowp=LOWP_FORMATS-1; lowp>=0; lowp--)
+                          if (strcmp(optarg, lowp_name[lowp]) == 0) break;
+                      if (lowp < 0) usage(argv[0], threshold);
+                      break;
             case 'o': is_output_timing = 1;
                       break;
             case 'q': verbose = 0;
@@ -132,6 +220,32 @@ int main(int argc, char **argv) {
 
     if (filename == 0 || numClusters <= 1) usage(argv[0], threshold);
 
+    if (strcmp(method, "lloyd") != 0 && strcmp(method, "hamerly") != 0 &&
+        strcmp(method, "yinyang") != 0 && strcmp(method, "stream") != 0)
+        usage(argv[0], threshold);
+    is_stream = (strcmp(method, "stream") == 0);
+    if (is_stream && (!isBinaryFile || do_pnetcdf)) {
+        printf("Error: the stream method reads binary files only (-b)\n");
+        exit(1);
+    }
+    if (batchSize <= 0 || numPasses <= 0) usage(argv[0], threshold);
+    if (strcmp(binding, "none") != 0 && strcmp(binding, "close") != 0 &&
+        strcmp(binding, "spread") != 0) usage(argv[0], threshold);
+    if (strcmp(seeding, "first") != 0 && strcmp(seeding, "kmeans++") != 0 &&
+        strcmp(seeding, "kmeans||") != 0) usage(argv[0], threshold);
+    if (lowp >= 0 && (strcmp(method, "lloyd") != 0 || is_perform_atomic)) {
+        printf("Error: -l applies to the lloyd method without -a only\n");
+        exit(1);
+    }
+    if (is_stream && strcmp(seeding, "first") != 0) {
+        printf("Error: the stream method only supports -k first\n");
+        exit(1);
+    }
+    if (strcmp(method, "lloyd") != 0 && (is_perform_atomic || is_blocked)) {
+        printf("Error: -a and -g apply to the lloyd method only\n");
+        exit(1);
+    }
+
 #ifndef _PNETCDF_BUILT
     if (do_pnetcdf) {
         printf("Error: PnetCDF feature is not built\n");
@@ -144,6 +258,13 @@ int main(int argc, char **argv) {
     if (nthreads > 0)
         omp_set_num_threads(nthreads);
 
+    /* pin before any parallel region, so that data zeroed or copied by a
+       thread stays on the thread's NUMA node */
+    if (strcmp(binding, "none") != 0 && !pin_threads(binding)) {
+        printf("Warning: thread binding is not supported, using none\n");
+        binding = "none";
+    }
+
     if (is_output_timing) io_timing = omp_get_wtime();
 
     /* read data points from file ------------------------------------------*/
@@ -155,13 +276,38 @@ int main(int argc, char **argv) {
                                MPI_COMM_WORLD);
     else
 #endif
+    if (is_stream) {
+        /* objects are read batch by batch during the clustering */
+        objects = NULL;
+        if (!stream_header(filename, &numObjs, &numCoords)) exit(1);
+    }
+    else
     objects = file_read(isBinaryFile, filename, &numObjs, &numCoords);
-    if (objects == NULL) exit(1);
+    if (objects == NULL && !is_stream) exit(1);
+
+    if (objects != NULL && strcmp(binding, "none") != 0) {
+        /* the objects were read by the main thread: copy them with the same
+           static schedule as the clustering loops, so each thread's share
+           is in its local memory */
+        float *local = (float*) malloc((size_t)numObjs * numCoords *
+                                       sizeof(float));
+        assert(local != NULL);
+        #pragma omp parallel for private(j) schedule(static)
+        for (i=0; i<numObjs; i++)
+            for (j=0; j<numCoords; j++)
+                local[(size_t)i*numCoords + j] = objects[i][j];
+        free(objects[0]);
+        objects[0] = local;
+        for (i=1; i<numObjs; i++)
+            objects[i] = objects[i-1] + numCoords;
+    }
 
     if (numObjs < numClusters) {
         printf("Error: number of clusters must be larger than the number of data points to be clustered.\n");
-        free(objects[0]);
-        free(objects);
+        if (objects != NULL) {
+            free(objects[0]);
+            free(objects);
+        }
         return 1;
     }
 
@@ -179,21 +325,60 @@ int main(int argc, char **argv) {
     assert(membership != NULL);
 
     printf("# num_threads: %d\n", nthreads);
+    printf("# binding: %s\n", binding);
     printf("# file: %s\n", filename);
     printf("# num_clusters: %d\n", numClusters);
     printf("# atomic: %d\n", is_perform_atomic);
+    printf("# blocked: %d\n", is_blocked);
+    printf("# method: %s\n", method);
+    if (is_stream) {
+        printf("# batch_size: %d\n", batchSize);
+        printf("# num_passes: %d\n", numPasses);
+        printf("# full_pass: %d\n", is_full_pass);
+    }
+    printf("# seeding: %s\n", (center_filename != filename) ? center_filename
+                                                           : seeding);
+    if (center_filename == filename && strcmp(seeding, "first") != 0)
+        printf("# seed: %d\n", seed);
+    printf("# storage: %s\n", (lowp >= 0) ? lowp_name[lowp] : "float");
+
+    if (lowp >= 0) {
+        init_clusters    = (float**) malloc(numClusters * sizeof(float*));
+        assert(init_clusters != NULL);
+        init_clusters[0] = (float*)  malloc(numClusters * numCoords *
+                                            sizeof(float));
+        assert(init_clusters[0] != NULL);
+        for (i=1; i<numClusters; i++)
+            init_clusters[i] = init_clusters[i-1] + numCoords;
+    }
     oprecomp_start();
     do {
 
     /* read the first numClusters elements from file center_filename as the
      * initial cluster centers*/
-    if (center_filename != filename) {
+    if (center_filename != filename || is_stream) {
         printf("reading initial %d centers from file %s\n", numClusters,
                center_filename);
         /* read the first numClusters data points from file */
         read_n_objects(isBinaryFile, center_filename, numClusters,
                        numCoords, clusters);
     }
+    else if (strcmp(seeding, "first") != 0) {
+        printf("selecting %d initial centers by %s\n", numClusters, seeding);
+        seeding_timing = omp_get_wtime();
+        if (strcmp(seeding, "kmeans++") == 0)
+            ok = seed_kmeanspp(objects, numCoords, numObjs, numClusters, seed,
+                               clusters);
+        else
+            ok = seed_kmeans_parallel(objects, numCoords, numObjs, numClusters,
+                                      seed, clusters);
+        seeding_timing = omp_get_wtime() - seeding_timing;
+        printf("# seeding_time: %.4f\n", seeding_timing);
+        if (!ok) {
+            printf("Error: less than %d distinct data points\n", numClusters);
+            return 1;
+        }
+    }
     else {
         printf("selecting the first %d elements as initial centers\n",
                numClusters);
@@ -227,20 +412,60 @@ int main(int argc, char **argv) {
 
     /* start the core computation -------------------------------------------*/
 
-    omp_kmeans(is_perform_atomic, objects, numCoords, numObjs,
-               numClusters, threshold, membership, clusters);
+    if (lowp >= 0) {
+        memcpy(init_clusters[0], clusters[0],
+               numClusters * numCoords * sizeof(float));
+        loops = omp_lowp_kmeans(lowp, objects, numCoords, numObjs, numClusters,
+                                threshold, membership, clusters);
+    }
+    else if (is_stream)
+        loops = omp_stream_kmeans(filename, numCoords, numObjs, numClusters,
+                                  batchSize, numPasses, is_full_pass,
+                                  threshold, membership, clusters);
+    else if (strcmp(method, "hamerly") == 0)
+        loops = omp_hamerly_kmeans(objects, numCoords, numObjs, numClusters,
+                                   threshold, membership, clusters);
+    else if (strcmp(method, "yinyang") == 0)
+        loops = omp_yinyang_kmeans(objects, numCoords, numObjs, numClusters,
+                                   threshold, membership, clusters);
+    else
+        loops = omp_kmeans(is_perform_atomic, is_blocked, objects, numCoords,
+                           numObjs, numClusters, threshold, membership,
+                           clusters);
+    printf("# kmeans_iterations: %d\n", loops);
 
     } while (oprecomp_iterate());
     oprecomp_stop();
 
-    free(objects[0]);
-    free(objects);
-
     if (is_output_timing) {
         timing            = omp_get_wtime();
         clustering_timing = timing - clustering_timing;
     }       
 
+    if (lowp >= 0) {
+        /* untimed float reference from the same initial centers, with the
+           blocked kernel omp_lowp_kmeans assigns with, so that only the
+           storage precision differs */
+        int *ref_membership = (int*) malloc(numObjs * sizeof(int));
+        assert(ref_membership != NULL);
+        loops = omp_kmeans(0, 1, objects, numCoords, numObjs,
+                           numClusters, threshold, ref_membership,
+                           init_clusters);
+        for (i=0, j=0; i<numObjs; i++)
+            if (membership[i] == ref_membership[i]) j++;
+        printf("# reference_iterations: %d\n", loops);
+        printf("# membership_agreement: %.6f\n", (double)j / numObjs);
+        free(ref_membership);
+        free(init_clusters[0]);
+        free(init_clusters);
+        if (is_output_timing) timing = omp_get_wtime();
+    }
+
+    if (objects != NULL) {
+        free(objects[0]);
+        free(objects);
+    }
+
     /* output: the coordinates of the cluster centres ----------------------*/
 #ifdef _PNETCDF_BUILT
     if (do_pnetcdf)
@@ -260,10 +485,14 @@ int main(int argc, char **argv) {
         io_timing += omp_get_wtime() - timing;
 
         printf("\nPerforming **** Regular Kmeans  (OpenMP) ----");
-        if (is_perform_atomic)
+        if (strcmp(method, "lloyd") != 0)
+            printf(" using %s bounds ******\n", method);
+        else if (is_perform_atomic)
             printf(" using atomic pragma ******\n");
         else
             printf(" using array reduction ******\n");
+        if (is_blocked)
+            printf("Using blocked assignment step\n");
 
         printf("Number of threads = %d\n", omp_get_max_threads());
         printf("Input file:     %s\n", filename);
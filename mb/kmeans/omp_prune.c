@@ -0,0 +1,505 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         omp_prune.c  (OpenMP version)                             */
+/*   Description:  k-means clustering with triangle inequality pruning.      */
+/*                 Same iteration as omp_kmeans(), but each object keeps an  */
+/*                 upper bound on the distance to its center and lower       */
+/*                 bounds on the distance to all other centers. The bounds   */
+/*                 are loosened by the drift of the centers after every      */
+/*                 update, and an object is only rescanned when they no      */
+/*                 longer prove that its membership cannot change.           */
+/*                 1. Hamerly: one lower bound for all other centers, plus   */
+/*                    half the distance to the closest other center          */
+/*                 2. Yinyang: the centers are grouped once by a k-means on  */
+/*                    the initial centers, one lower bound per group, only   */
+/*                    the groups whose bound fails are rescanned             */
+/*                 Distances here are true (square rooted) distances. The    */
+/*                 fraction of object-center distances skipped is printed    */
+/*                 for every iteration.                                      */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+
+#include <omp.h>
+#include "kmeans.h"
+
+#define YINYANG_GROUP_SIZE 10  /* about 10 centers per group */
+
+
+/*----< euclid_dist() >------------------------------------------------------*/
+/* Euclid distance between two multi-dimensional points                      */
+__inline static
+float euclid_dist(int    numdims,  /* no. dimensions */
+                  float *coord1,   /* [numdims] */
+                  float *coord2)   /* [numdims] */
+{
+    int i;
+    float ans=0.0;
+
+    for (i=0; i<numdims; i++)
+        ans += (coord1[i]-coord2[i]) * (coord1[i]-coord2[i]);
+
+    return(sqrtf(ans));
+}
+
+/*----< update_centers() >---------------------------------------------------*/
+/* reduce the per thread sums, replace the centers and return their drift    */
+static
+void update_centers(int     nthreads,
+                    int     numClusters,
+                    int     numCoords,
+                    int    *localSize,   /* [nthreads][numClusters] */
+                    float  *localSum,    /* [nthreads][numClusters][numCoords] */
+                    float **clusters,    /* in/out: [numClusters][numCoords] */
+                    float  *drift)       /* out: [numClusters] */
+{
+    int i, j, t;
+
+    #pragma omp parallel for private(j,t) schedule(static)
+    for (i=0; i<numClusters; i++) {
+        int   size = 0;
+        float moved = 0.0;
+        for (t=0; t<nthreads; t++) {
+            size += localSize[t*numClusters + i];
+            localSize[t*numClusters + i] = 0;
+        }
+        for (j=0; j<numCoords; j++) {
+            float sum = 0.0;
+            for (t=0; t<nthreads; t++) {
+                sum += localSum[(t*numClusters + i)*numCoords + j];
+                localSum[(t*numClusters + i)*numCoords + j] = 0.0;
+            }
+            /* same rule as omp_kmeans() */
+            if (size > 1) {
+                float c = sum / size;
+                moved += (c - clusters[i][j]) * (c - clusters[i][j]);
+                clusters[i][j] = c;
+            }
+        }
+        drift[i] = sqrtf(moved);
+    }
+}
+
+/*----< accumulate() >-------------------------------------------------------*/
+__inline static
+void accumulate(int    numClusters,
+                int    numCoords,
+                int    tid,
+                int    index,
+                float *object,     /* [numCoords] */
+                int   *localSize,  /* [nthreads][numClusters] */
+                float *localSum)   /* [nthreads][numClusters][numCoords] */
+{
+    int    j;
+    float *sum = localSum + (tid*numClusters + index)*numCoords;
+
+    localSize[tid*numClusters + index]++;
+    for (j=0; j<numCoords; j++)
+        sum[j] += object[j];
+}
+
+/*----< omp_hamerly_kmeans() >-----------------------------------------------*/
+/* return an array of cluster centers of size [numClusters][numCoords]       */
+/* and the no. iterations                                                    */
+int omp_hamerly_kmeans(float **objects,      /* in: [numObjs][numCoords] */
+                       int     numCoords,    /* no. coordinates */
+                       int     numObjs,      /* no. objects */
+                       int     numClusters,  /* no. clusters */
+                       float   threshold,    /* % objects change membership */
+                       int    *membership,   /* out: [numObjs] */
+                       float **clusters)     /* out: [numClusters][numCoords] */
+{
+    int     i, k, loop=0, nthreads, far1, far2;
+    float   delta;        /* % of objects change their clusters */
+    long    computed;     /* no. object-center distances evaluated */
+    double  skipped=0.0;  /* sum over iterations of the skipped fraction */
+    int     niters=0;     /* no. iterations */
+    float  *upper;        /* [numObjs]: distance to own center */
+    float  *lower;        /* [numObjs]: distance to any other center */
+    float  *half;         /* [numClusters]: half dist. to closest center */
+    float  *drift;        /* [numClusters] */
+    int    *localSize;    /* [nthreads][numClusters] */
+    float  *localSum;     /* [nthreads][numClusters][numCoords] */
+    double  timing;
+
+    nthreads = omp_get_max_threads();
+
+    for (i=0; i<numObjs; i++) membership[i] = -1;
+
+    upper = (float*) malloc(numObjs * sizeof(float));
+    assert(upper != NULL);
+    lower = (float*) malloc(numObjs * sizeof(float));
+    assert(lower != NULL);
+    half  = (float*) malloc(numClusters * sizeof(float));
+    assert(half != NULL);
+    drift = (float*) malloc(numClusters * sizeof(float));
+    assert(drift != NULL);
+    localSize = (int*)   calloc(nthreads * numClusters, sizeof(int));
+    assert(localSize != NULL);
+    localSum  = (float*) calloc(nthreads * numClusters * numCoords,
+                                sizeof(float));
+    assert(localSum != NULL);
+
+    if (_debug) timing = omp_get_wtime();
+    do {
+        delta    = 0.0;
+        computed = 0;
+
+        /* half the distance from each center to the closest other one */
+        #pragma omp parallel for private(k) schedule(static)
+        for (i=0; i<numClusters; i++) {
+            float min_dist = FLT_MAX;
+            for (k=0; k<numClusters; k++) {
+                float dist;
+                if (k == i) continue;
+                dist = euclid_dist(numCoords, clusters[i], clusters[k]);
+                if (dist < min_dist) min_dist = dist;
+            }
+            half[i] = 0.5 * min_dist;
+        }
+
+        #pragma omp parallel private(k)
+        {
+            int tid = omp_get_thread_num();
+            #pragma omp for schedule(static) reduction(+:delta,computed)
+            for (i=0; i<numObjs; i++) {
+                int   index = membership[i];
+                float bound = 0.0;
+
+                if (index >= 0) {
+                    bound = (half[index] > lower[i]) ? half[index] : lower[i];
+                    if (upper[i] > bound) {
+                        /* tighten the upper bound and try again */
+                        upper[i] = euclid_dist(numCoords, objects[i],
+                                               clusters[index]);
+                        computed++;
+                    }
+                }
+                if (index < 0 || upper[i] > bound) {
+                    /* full scan for the closest and second closest */
+                    float min1 = FLT_MAX, min2 = FLT_MAX;
+                    for (k=0; k<numClusters; k++) {
+                        float dist = euclid_dist(numCoords, objects[i],
+                                                 clusters[k]);
+                        if (dist < min1) {
+                            min2  = min1;
+                            min1  = dist;
+                            index = k;
+                        }
+                        else if (dist < min2)
+                            min2 = dist;
+                    }
+                    computed += numClusters;
+                    upper[i] = min1;
+                    lower[i] = min2;
+                }
+
+                if (membership[i] != index) delta += 1.0;
+                membership[i] = index;
+
+                accumulate(numClusters, numCoords, tid, index, objects[i],
+                           localSize, localSum);
+            }
+        }
+
+        update_centers(nthreads, numClusters, numCoords, localSize, localSum,
+                       clusters, drift);
+
+        /* the two largest drifts, the lower bound moves by the largest one
+           that is not the own center's */
+        far1 = 0;
+        far2 = -1;
+        for (k=1; k<numClusters; k++) {
+            if (drift[k] > drift[far1]) {
+                far2 = far1;
+                far1 = k;
+            }
+            else if (far2 < 0 || drift[k] > drift[far2])
+                far2 = k;
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (i=0; i<numObjs; i++) {
+            int index = membership[i];
+            upper[i] += drift[index];
+            lower[i] -= drift[(index == far1) ? far2 : far1];
+        }
+
+        printf("# skipped: %d %.4f\n", niters++,
+               1.0 - (double)computed / ((double)numObjs * numClusters));
+        skipped += 1.0 - (double)computed / ((double)numObjs * numClusters);
+
+        delta /= numObjs;
+    } while (delta > threshold && loop++ < 500);
+
+    printf("# skipped_mean: %.4f\n", skipped / niters);
+
+    if (_debug) {
+        timing = omp_get_wtime() - timing;
+        printf("nloops = %2d (T = %7.4f)",loop,timing);
+    }
+
+    free(localSum);
+    free(localSize);
+    free(drift);
+    free(half);
+    free(lower);
+    free(upper);
+
+    return niters;
+}
+
+/*----< group_centers() >----------------------------------------------------*/
+/* partition the centers into numGroups groups with a few Lloyd iterations   */
+/* on the centers themselves, return the members of each group contiguous    */
+static
+void group_centers(int     numClusters,
+                   int     numCoords,
+                   int     numGroups,
+                   float **clusters,     /* in: [numClusters][numCoords] */
+                   int    *groupStart,   /* out: [numGroups+1] */
+                   int    *groupMember,  /* out: [numClusters] */
+                   int    *groupOf)      /* out: [numClusters] */
+{
+    int    i, j, g, loop;
+    int   *size;
+    float *seed;  /* [numGroups][numCoords] */
+
+    size = (int*)   malloc(numGroups * sizeof(int));
+    assert(size != NULL);
+    seed = (float*) malloc(numGroups * numCoords * sizeof(float));
+    assert(seed != NULL);
+
+    /* seed with evenly spaced centers */
+    for (g=0; g<numGroups; g++)
+        for (j=0; j<numCoords; j++)
+            seed[g*numCoords + j] = clusters[g*numClusters/numGroups][j];
+
+    for (loop=0; loop<5; loop++) {
+        for (i=0; i<numClusters; i++) {
+            float min_dist = FLT_MAX;
+            for (g=0; g<numGroups; g++) {
+                float dist = euclid_dist(numCoords, clusters[i],
+                                         seed + g*numCoords);
+                if (dist < min_dist) {
+                    min_dist   = dist;
+                    groupOf[i] = g;
+                }
+            }
+        }
+        for (g=0; g<numGroups; g++) size[g] = 0;
+        for (i=0; i<numClusters; i++) size[groupOf[i]]++;
+        for (g=0; g<numGroups; g++)
+            if (size[g] > 0)
+                for (j=0; j<numCoords; j++)
+                    seed[g*numCoords + j] = 0.0;
+        for (i=0; i<numClusters; i++) {
+            g = groupOf[i];
+            for (j=0; j<numCoords; j++)
+                seed[g*numCoords + j] += clusters[i][j] / size[g];
+        }
+    }
+
+    /* counting sort of the centers by group, empty groups are harmless */
+    groupStart[0] = 0;
+    for (g=0; g<numGroups; g++) groupStart[g+1] = groupStart[g] + size[g];
+    for (g=0; g<numGroups; g++) size[g] = groupStart[g];
+    for (i=0; i<numClusters; i++) groupMember[size[groupOf[i]]++] = i;
+
+    free(seed);
+    free(size);
+}
+
+/*----< omp_yinyang_kmeans() >-----------------------------------------------*/
+/* return an array of cluster centers of size [numClusters][numCoords]       */
+/* and the no. iterations                                                    */
+int omp_yinyang_kmeans(float **objects,      /* in: [numObjs][numCoords] */
+                       int     numCoords,    /* no. coordinates */
+                       int     numObjs,      /* no. objects */
+                       int     numClusters,  /* no. clusters */
+                       float   threshold,    /* % objects change membership */
+                       int    *membership,   /* out: [numObjs] */
+                       float **clusters)     /* out: [numClusters][numCoords] */
+{
+    int     i, g, loop=0, nthreads, numGroups;
+    float   delta;        /* % of objects change their clusters */
+    long    computed;     /* no. object-center distances evaluated */
+    double  skipped=0.0;  /* sum over iterations of the skipped fraction */
+    int     niters=0;     /* no. iterations */
+    float  *upper;        /* [numObjs]: distance to own center */
+    float  *lower;        /* [numObjs][numGroups]: distance to any other
+                             center of the group */
+    float  *drift;        /* [numClusters] */
+    float  *groupDrift;   /* [numGroups]: max drift within the group */
+    int    *groupStart;   /* [numGroups+1] */
+    int    *groupMember;  /* [numClusters]: centers sorted by group */
+    int    *groupOf;      /* [numClusters] */
+    int    *localSize;    /* [nthreads][numClusters] */
+    float  *localSum;     /* [nthreads][numClusters][numCoords] */
+    double  timing;
+
+    nthreads  = omp_get_max_threads();
+    numGroups = (numClusters + YINYANG_GROUP_SIZE - 1) / YINYANG_GROUP_SIZE;
+
+    for (i=0; i<numObjs; i++) membership[i] = -1;
+
+    upper = (float*) malloc(numObjs * sizeof(float));
+    assert(upper != NULL);
+    lower = (float*) malloc((size_t)numObjs * numGroups * sizeof(float));
+    assert(lower != NULL);
+    drift = (float*) malloc(numClusters * sizeof(float));
+    assert(drift != NULL);
+    groupDrift  = (float*) malloc(numGroups * sizeof(float));
+    assert(groupDrift != NULL);
+    groupStart  = (int*)   malloc((numGroups+1) * sizeof(int));
+    assert(groupStart != NULL);
+    groupMember = (int*)   malloc(numClusters * sizeof(int));
+    assert(groupMember != NULL);
+    groupOf     = (int*)   malloc(numClusters * sizeof(int));
+    assert(groupOf != NULL);
+    localSize = (int*)   calloc(nthreads * numClusters, sizeof(int));
+    assert(localSize != NULL);
+    localSum  = (float*) calloc(nthreads * numClusters * numCoords,
+                                sizeof(float));
+    assert(localSum != NULL);
+
+    group_centers(numClusters, numCoords, numGroups, clusters, groupStart,
+                  groupMember, groupOf);
+    printf("# groups: %d\n", numGroups);
+
+    if (_debug) timing = omp_get_wtime();
+    do {
+        delta    = 0.0;
+        computed = 0;
+
+        #pragma omp parallel private(g)
+        {
+            int    k, l, tid = omp_get_thread_num();
+            /* per group scan results: closest, its index, second closest */
+            float *min1 = (float*) malloc(numGroups * sizeof(float));
+            float *min2 = (float*) malloc(numGroups * sizeof(float));
+            int   *arg1 = (int*)   malloc(numGroups * sizeof(int));
+            assert(min1 != NULL && min2 != NULL && arg1 != NULL);
+
+            #pragma omp for schedule(static) reduction(+:delta,computed)
+            for (i=0; i<numObjs; i++) {
+                float *lb    = lower + (size_t)i * numGroups;
+                int    index = membership[i];
+                int    old   = index;
+                float  bound = FLT_MAX, dist;
+
+                /* global filter: closer than any other group can be */
+                for (g=0; g<numGroups; g++)
+                    if (lb[g] < bound) bound = lb[g];
+                if (index >= 0 && upper[i] > bound) {
+                    upper[i] = euclid_dist(numCoords, objects[i],
+                                           clusters[index]);
+                    computed++;
+                }
+
+                if (index < 0 || upper[i] > bound) {
+                    /* group filter: rescan the groups whose bound fails
+                       against the best distance found so far */
+                    float best = (index < 0) ? FLT_MAX : upper[i];
+                    for (g=0; g<numGroups; g++) {
+                        if (index >= 0 && lb[g] >= best) {
+                            arg1[g] = -1;  /* not scanned */
+                            continue;
+                        }
+                        if (groupStart[g] == groupStart[g+1]) {
+                            arg1[g] = -1;  /* empty, no center to bound */
+                            lb[g]   = FLT_MAX;
+                            continue;
+                        }
+                        min1[g] = min2[g] = FLT_MAX;
+                        arg1[g] = groupMember[groupStart[g]];
+                        for (l=groupStart[g]; l<groupStart[g+1]; l++) {
+                            k = groupMember[l];
+                            if (k == old)
+                                dist = upper[i];
+                            else {
+                                dist = euclid_dist(numCoords, objects[i],
+                                                   clusters[k]);
+                                computed++;
+                            }
+                            if (dist < min1[g]) {
+                                min2[g] = min1[g];
+                                min1[g] = dist;
+                                arg1[g] = k;
+                            }
+                            else if (dist < min2[g])
+                                min2[g] = dist;
+                        }
+                        if (min1[g] < best) {
+                            best  = min1[g];
+                            index = arg1[g];
+                        }
+                    }
+
+                    /* new lower bounds exclude the new center only */
+                    for (g=0; g<numGroups; g++) {
+                        if (arg1[g] >= 0)
+                            lb[g] = (arg1[g] == index) ? min2[g] : min1[g];
+                        else if (old >= 0 && groupOf[old] == g &&
+                                 index != old && upper[i] < lb[g])
+                            lb[g] = upper[i];
+                    }
+                    upper[i] = best;
+                }
+
+                if (membership[i] != index) delta += 1.0;
+                membership[i] = index;
+
+                accumulate(numClusters, numCoords, tid, index, objects[i],
+                           localSize, localSum);
+            }
+            free(arg1);
+            free(min2);
+            free(min1);
+        }
+
+        update_centers(nthreads, numClusters, numCoords, localSize, localSum,
+                       clusters, drift);
+
+        for (g=0; g<numGroups; g++) groupDrift[g] = 0.0;
+        for (i=0; i<numClusters; i++)
+            if (drift[i] > groupDrift[groupOf[i]])
+                groupDrift[groupOf[i]] = drift[i];
+
+        #pragma omp parallel for private(g) schedule(static)
+        for (i=0; i<numObjs; i++) {
+            float *lb = lower + (size_t)i * numGroups;
+            upper[i] += drift[membership[i]];
+            for (g=0; g<numGroups; g++)
+                lb[g] -= groupDrift[g];
+        }
+
+        printf("# skipped: %d %.4f\n", niters++,
+               1.0 - (double)computed / ((double)numObjs * numClusters));
+        skipped += 1.0 - (double)computed / ((double)numObjs * numClusters);
+
+        delta /= numObjs;
+    } while (delta > threshold && loop++ < 500);
+
+    printf("# skipped_mean: %.4f\n", skipped / niters);
+
+    if (_debug) {
+        timing = omp_get_wtime() - timing;
+        printf("nloops = %2d (T = %7.4f)",loop,timing);
+    }
+
+    free(localSum);
+    free(localSize);
+    free(groupOf);
+    free(groupMember);
+    free(groupStart);
+    free(groupDrift);
+    free(drift);
+    free(lower);
+    free(upper);
+
+    return niters;
+}
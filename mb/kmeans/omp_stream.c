@@ -0,0 +1,301 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         omp_stream.c  (OpenMP version)                            */
+/*   Description:  Mini-batch k-means streamed from a binary input file.     */
+/*                 The objects are never held in memory at once: the file is */
+/*                 read in batches of batchSize objects, into two buffers,   */
+/*                 while a helper thread reads the next batch the current    */
+/*                 one is clustered. Each batch is assigned with the blocked */
+/*                 kernel of assign.c and moves every center towards the     */
+/*                 mean of its objects in the batch with learning rate       */
+/*                 (objects in batch) / (objects seen so far), as in         */
+/*                 Sculley, "Web-scale k-means clustering", WWW 2010.        */
+/*                 The file is streamed for up to numPasses passes, until    */
+/*                 the fraction of membership changes in a pass is below     */
+/*                 threshold. An optional last pass assigns all objects to   */
+/*                 the final centers and reports the sum of squared errors.  */
+/*                 Only membership[numObjs] scales with the input size.      */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* strerror() */
+#include <sys/types.h>  /* open() */
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>     /* pread(), close() */
+#include <errno.h>
+#include <pthread.h>
+
+#include <omp.h>
+#include "kmeans.h"
+
+/* binary file header: numObjs and numCoords as 4-byte integers */
+#define HEADER_SIZE (2 * sizeof(int))
+
+struct prefetch {
+    int    fd;
+    int    numCoords;
+    int    first;      /* index of first object */
+    int    count;      /* no. objects */
+    float *buf;        /* [count][numCoords] */
+    int    err;        /* errno of a failed read, or -1 for a short file */
+};
+
+/*----< read_objects() >-----------------------------------------------------*/
+/* read objects [first, first+count) of the binary file                      */
+static
+void *read_objects(void *arg)
+{
+    struct prefetch *p = (struct prefetch*) arg;
+    char  *buf  = (char*) p->buf;
+    size_t len  = (size_t)p->count * p->numCoords * sizeof(float);
+    off_t  off  = HEADER_SIZE + (off_t)p->first * p->numCoords * sizeof(float);
+
+    p->err = 0;
+    while (len > 0) {
+        ssize_t got = pread(p->fd, buf, len, off);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            p->err = (got < 0) ? errno : -1;
+            break;
+        }
+        buf += got;
+        off += got;
+        len -= got;
+    }
+    return NULL;
+}
+
+/*----< stream_header() >----------------------------------------------------*/
+/* read the numObjs and numCoords of a binary file without its objects       */
+int stream_header(char *filename,   /* input file name */
+                  int  *numObjs,    /* out: no. data objects */
+                  int  *numCoords)  /* out: no. coordinates */
+{
+    int infile, header[2];
+
+    if ((infile = open(filename, O_RDONLY)) == -1) {
+        fprintf(stderr, "Error: no such file (%s)\n", filename);
+        return 0;
+    }
+    if (read(infile, header, HEADER_SIZE) != HEADER_SIZE) {
+        fprintf(stderr, "Error: file %s is too short\n", filename);
+        close(infile);
+        return 0;
+    }
+    close(infile);
+    *numObjs   = header[0];
+    *numCoords = header[1];
+    return 1;
+}
+
+/*----< stream_pass() >------------------------------------------------------*/
+/* one pass over the file, batch by batch. With rate != NULL the centers are */
+/* updated after each batch (mini-batch step), otherwise the objects are     */
+/* only assigned. Returns the no. membership changes, *sse is the sum of     */
+/* squared distances to the centers at assignment time.                      */
+static
+int stream_pass(int      fd,
+                int      numCoords,
+                int      numObjs,
+                int      numClusters,
+                int      batchSize,
+                float   *buf[2],       /* [2][batchSize][numCoords] */
+                int     *index,        /* [batchSize] */
+                float   *packed,       /* for assign_nearest() */
+                int     *localSize,    /* [nthreads][numClusters] */
+                float   *localSum,     /* [nthreads][numClusters][numCoords] */
+                double  *rate,         /* [numClusters]: objects seen or NULL */
+                int     *membership,   /* in/out: [numObjs] */
+                float  **clusters,     /* in/out: [numClusters][numCoords] */
+                double  *sse)          /* out: */
+{
+    int             i, j, k, t, cur=0, first, changes=0, nthreads;
+    double          err=0.0;
+    struct prefetch next;
+    pthread_t       reader;
+
+    nthreads = omp_get_max_threads();
+
+    /* the first batch is read synchronously */
+    next.fd        = fd;
+    next.numCoords = numCoords;
+    next.first     = 0;
+    next.count     = (numObjs < batchSize) ? numObjs : batchSize;
+    next.buf       = buf[cur];
+    read_objects(&next);
+
+    for (first=0; first<numObjs; first+=batchSize) {
+        int    count = (numObjs-first < batchSize) ? numObjs-first : batchSize;
+        float *objs  = buf[cur];
+        int    prefetching = 0;
+
+        if (next.err != 0) {
+            fprintf(stderr, "Error: reading objects %d-%d (%s)\n", first,
+                    first+count-1, (next.err > 0) ? strerror(next.err)
+                                                  : "file too short");
+            exit(1);
+        }
+
+        /* start reading the next batch into the other buffer */
+        if (first + batchSize < numObjs) {
+            cur            = 1 - cur;
+            next.first     = first + batchSize;
+            next.count     = (numObjs-next.first < batchSize) ?
+                             numObjs-next.first : batchSize;
+            next.buf       = buf[cur];
+            prefetching    = (pthread_create(&reader, NULL, read_objects,
+                                             &next) == 0);
+            if (!prefetching) read_objects(&next);
+        }
+
+        assign_pack(numClusters, numCoords, clusters, packed);
+
+        #pragma omp parallel private(j)
+        {
+            int tid = omp_get_thread_num();
+
+            #pragma omp for schedule(static)
+            for (i=0; i<count; i+=ASSIGN_TILE)
+                assign_nearest((count-i < ASSIGN_TILE) ? count-i : ASSIGN_TILE,
+                               numCoords, numClusters, objs + i*numCoords,
+                               packed, index+i);
+
+            #pragma omp for schedule(static) reduction(+:changes,err)
+            for (i=0; i<count; i++) {
+                float *x   = objs + i*numCoords;
+                float *c   = clusters[index[i]];
+                float *sum = localSum + (tid*numClusters + index[i])*numCoords;
+
+                if (membership[first+i] != index[i]) changes++;
+                membership[first+i] = index[i];
+
+                for (j=0; j<numCoords; j++)
+                    err += (x[j]-c[j]) * (x[j]-c[j]);
+
+                if (rate != NULL) {
+                    localSize[tid*numClusters + index[i]]++;
+                    for (j=0; j<numCoords; j++)
+                        sum[j] += x[j];
+                }
+            }
+        }
+
+        if (rate != NULL) {
+            /* c += (sum - n c) / (objects seen), per center */
+            for (k=0; k<numClusters; k++) {
+                int size = 0;
+                for (t=0; t<nthreads; t++) {
+                    size += localSize[t*numClusters + k];
+                    localSize[t*numClusters + k] = 0;
+                }
+                if (size > 0) rate[k] += size;
+                for (j=0; j<numCoords; j++) {
+                    float sum = 0.0;
+                    for (t=0; t<nthreads; t++) {
+                        sum += localSum[(t*numClusters + k)*numCoords + j];
+                        localSum[(t*numClusters + k)*numCoords + j] = 0.0;
+                    }
+                    if (size > 0)
+                        clusters[k][j] += (sum - size*clusters[k][j]) / rate[k];
+                }
+            }
+        }
+
+        if (prefetching) pthread_join(reader, NULL);
+    }
+
+    *sse = err;
+    return changes;
+}
+
+/*----< omp_stream_kmeans() >------------------------------------------------*/
+/* cluster a binary file that need not fit in memory, return an array of     */
+/* cluster centers of size [numClusters][numCoords] and the no. passes      */
+int omp_stream_kmeans(char    *filename,     /* in: binary input file */
+                      int      numCoords,    /* no. coordinates */
+                      int      numObjs,      /* no. objects */
+                      int      numClusters,  /* no. clusters */
+                      int      batchSize,    /* no. objects per batch */
+                      int      numPasses,    /* max. no. passes over file */
+                      int      is_full_pass, /* in: final assignment pass */
+                      float    threshold,    /* % objects change membership */
+                      int     *membership,   /* out: [numObjs] */
+                      float  **clusters)     /* in/out: [numClusters][numCoords] */
+{
+    int     i, fd, pass, changes, nthreads;
+    float   delta;
+    float  *buf[2];        /* double buffer, [batchSize][numCoords] each */
+    float  *packed;
+    int    *index;         /* [batchSize] */
+    int    *localSize;     /* [nthreads][numClusters] */
+    float  *localSum;      /* [nthreads][numClusters][numCoords] */
+    double *rate;          /* [numClusters]: objects seen by each center */
+    double  sse, timing;
+
+    nthreads = omp_get_max_threads();
+
+    if ((fd = open(filename, O_RDONLY)) == -1) {
+        fprintf(stderr, "Error: open file %s (err=%s)\n", filename,
+                strerror(errno));
+        return 0;
+    }
+
+    for (i=0; i<numObjs; i++) membership[i] = -1;
+
+    buf[0] = (float*) malloc((size_t)batchSize * numCoords * sizeof(float));
+    assert(buf[0] != NULL);
+    buf[1] = (float*) malloc((size_t)batchSize * numCoords * sizeof(float));
+    assert(buf[1] != NULL);
+    index  = (int*)   malloc(batchSize * sizeof(int));
+    assert(index != NULL);
+    packed = (float*) malloc(assign_packed_size(numClusters, numCoords) *
+                             sizeof(float));
+    assert(packed != NULL);
+    localSize = (int*)    calloc(nthreads * numClusters, sizeof(int));
+    assert(localSize != NULL);
+    localSum  = (float*)  calloc(nthreads * numClusters * numCoords,
+                                 sizeof(float));
+    assert(localSum != NULL);
+    rate      = (double*) calloc(numClusters, sizeof(double));
+    assert(rate != NULL);
+
+    if (_debug) timing = omp_get_wtime();
+    for (pass=0; pass<numPasses; pass++) {
+        changes = stream_pass(fd, numCoords, numObjs, numClusters, batchSize,
+                              buf, index, packed, localSize, localSum, rate,
+                              membership, clusters, &sse);
+        delta = (float)changes / numObjs;
+        printf("# pass: %d delta %.4f sse %e\n", pass, delta, sse);
+        if (delta <= threshold) {
+            pass++;
+            break;
+        }
+    }
+
+    if (is_full_pass) {
+        /* membership and sse with respect to the final centers */
+        changes = stream_pass(fd, numCoords, numObjs, numClusters, batchSize,
+                              buf, index, packed, localSize, localSum, NULL,
+                              membership, clusters, &sse);
+        printf("# full_pass: delta %.4f sse %e\n", (float)changes / numObjs,
+               sse);
+    }
+
+    if (_debug) {
+        timing = omp_get_wtime() - timing;
+        printf("npasses = %2d (T = %7.4f)", pass, timing);
+    }
+
+    close(fd);
+    free(rate);
+    free(localSum);
+    free(localSize);
+    free(packed);
+    free(index);
+    free(buf[1]);
+    free(buf[0]);
+
+    return pass;
+}
@@ -0,0 +1,328 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         seed.c  (OpenMP version)                                  */
+/*   Description:  Initial cluster centers by D^2 sampling:                  */
+/*                 1. k-means++ (Arthur and Vassilvitskii, SODA 2007): the   */
+/*                    centers are picked one after the other, each object    */
+/*                    with probability proportional to its squared distance  */
+/*                    to the closest center picked so far                    */
+/*                 2. k-means|| (Bahmani et al., VLDB 2012): a few rounds    */
+/*                    sample about oversample*numClusters objects each, all  */
+/*                    at once, the candidates are weighted by the no. objects*/
+/*                    closest to them and reduced to numClusters centers by  */
+/*                    a weighted k-means++                                   */
+/*                 The random numbers are a hash of (seed, round, object),   */
+/*                 and all sums are taken over fixed blocks of objects, so   */
+/*                 the centers only depend on the seed, not on the no.      */
+/*                 threads.                                                  */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcpy() */
+#include <float.h>
+
+#include <omp.h>
+#include "kmeans.h"
+
+#define SEED_BLOCK   4096  /* objects per partial sum, multiple of ASSIGN_TILE */
+#define SEED_BLOCKED 8     /* min. new centers to use the blocked kernel */
+
+#define KMEANS_PAR_ROUNDS     5    /* sampling rounds of k-means|| */
+#define KMEANS_PAR_OVERSAMPLE 2.0  /* samples per round / numClusters */
+
+
+/*----< uniform() >----------------------------------------------------------*/
+/* uniform in [0,1), a splitmix64 hash of (seed, stream, i)                  */
+static
+double uniform(unsigned int seed,
+               int          stream,
+               long         i)
+{
+    unsigned long long z;
+
+    z  = ((unsigned long long)seed << 32 | (unsigned int)stream) *
+         0x9E3779B97F4A7C15ULL + (unsigned long long)i;
+    z  = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z  = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*----< euclid_dist_2() >----------------------------------------------------*/
+/* square of Euclid distance between two multi-dimensional points            */
+__inline static
+float euclid_dist_2(int    numdims,  /* no. dimensions */
+                    float *coord1,   /* [numdims] */
+                    float *coord2)   /* [numdims] */
+{
+    int i;
+    float ans=0.0;
+
+    for (i=0; i<numdims; i++)
+        ans += (coord1[i]-coord2[i]) * (coord1[i]-coord2[i]);
+
+    return(ans);
+}
+
+/*----< update_dist() >------------------------------------------------------*/
+/* lower dist[] to the new centers, centers[first, first+numNew), owner[]    */
+/* gets the closest one if not NULL. Returns the sum of dist[]. Many new     */
+/* centers, as in the rounds of k-means||, go through assign_nearest() on    */
+/* the contiguous objects[0].                                                */
+static
+double update_dist(int      numCoords,
+                   int      numObjs,
+                   float  **objects,   /* [numObjs][numCoords] */
+                   int      first,
+                   int      numNew,
+                   float  **centers,   /* [first+numNew][numCoords] */
+                   float   *dist,      /* in/out: [numObjs] */
+                   int     *owner,     /* in/out: [numObjs] or NULL */
+                   double  *blockSum)  /* out: [numBlocks] */
+{
+    int     b, k, numBlocks = (numObjs + SEED_BLOCK - 1) / SEED_BLOCK;
+    double  total = 0.0;
+    float **newCenters = NULL, *packed = NULL;
+
+    if (numNew >= SEED_BLOCKED) {
+        /* assign_pack() wants the new centers as an array of rows */
+        newCenters = (float**) malloc(numNew * sizeof(float*));
+        assert(newCenters != NULL);
+        for (k=0; k<numNew; k++) newCenters[k] = centers[first+k];
+        packed = (float*) malloc(assign_packed_size(numNew, numCoords) *
+                                 sizeof(float));
+        assert(packed != NULL);
+        assign_pack(numNew, numCoords, newCenters, packed);
+    }
+
+    #pragma omp parallel for private(k) schedule(static)
+    for (b=0; b<numBlocks; b++) {
+        int    i, t, n, end = (b+1)*SEED_BLOCK;
+        int    index[ASSIGN_TILE];
+        double sum = 0.0;
+        if (end > numObjs) end = numObjs;
+        for (t=b*SEED_BLOCK; t<end; t+=ASSIGN_TILE) {
+            n = (end-t < ASSIGN_TILE) ? end-t : ASSIGN_TILE;
+            if (packed != NULL)
+                assign_nearest(n, numCoords, numNew, objects[t], packed, index);
+            for (i=t; i<t+n; i++) {
+                /* only the nearest new center if the kernel found it */
+                int k0 = (packed != NULL) ? first + index[i-t] : first;
+                int k1 = (packed != NULL) ? k0 + 1 : first + numNew;
+                for (k=k0; k<k1; k++) {
+                    float d = euclid_dist_2(numCoords, objects[i], centers[k]);
+                    if (d < dist[i]) {
+                        dist[i] = d;
+                        if (owner != NULL) owner[i] = k;
+                    }
+                }
+                sum += dist[i];
+            }
+        }
+        blockSum[b] = sum;
+    }
+
+    if (packed != NULL) {
+        free(packed);
+        free(newCenters);
+    }
+
+    for (b=0; b<numBlocks; b++) total += blockSum[b];
+    return total;
+}
+
+/*----< pick() >-------------------------------------------------------------*/
+/* the object at which the running sum of dist[] passes target               */
+static
+int pick(int     numObjs,
+         float  *dist,      /* [numObjs] */
+         double *blockSum,  /* [numBlocks] */
+         double  target)
+{
+    int b, i, end, last = -1, numBlocks = (numObjs + SEED_BLOCK - 1) / SEED_BLOCK;
+
+    for (b=0; b<numBlocks-1 && target >= blockSum[b]; b++)
+        target -= blockSum[b];
+
+    end = ((b+1)*SEED_BLOCK < numObjs) ? (b+1)*SEED_BLOCK : numObjs;
+    for (i=b*SEED_BLOCK; i<end; i++) {
+        if (dist[i] > 0.0) {
+            if (target < dist[i]) return i;
+            last = i;
+        }
+        target -= dist[i];
+    }
+    /* rounding ran past the end of the block */
+    return last;
+}
+
+/*----< seed_kmeanspp() >----------------------------------------------------*/
+/* returns 1 on success, 0 if there are less than numClusters distinct       */
+/* objects                                                                   */
+int seed_kmeanspp(float      **objects,      /* in: [numObjs][numCoords] */
+                  int          numCoords,    /* no. coordinates */
+                  int          numObjs,      /* no. objects */
+                  int          numClusters,  /* no. clusters */
+                  unsigned int seed,         /* random seed */
+                  float      **clusters)     /* out: [numClusters][numCoords] */
+{
+    int     i, k;
+    float  *dist;
+    double *blockSum, total;
+
+    dist     = (float*)  malloc(numObjs * sizeof(float));
+    assert(dist != NULL);
+    blockSum = (double*) malloc(((numObjs + SEED_BLOCK - 1) / SEED_BLOCK) *
+                                sizeof(double));
+    assert(blockSum != NULL);
+    for (i=0; i<numObjs; i++) dist[i] = FLT_MAX;
+
+    i = (int)(uniform(seed, 0, 0) * numObjs);
+    memcpy(clusters[0], objects[i], numCoords * sizeof(float));
+    total = update_dist(numCoords, numObjs, objects, 0, 1, clusters, dist,
+                        NULL, blockSum);
+
+    for (k=1; k<numClusters; k++) {
+        if (total <= 0.0 || (i = pick(numObjs, dist, blockSum,
+                                      uniform(seed, 0, k) * total)) < 0)
+            break;
+        memcpy(clusters[k], objects[i], numCoords * sizeof(float));
+        total = update_dist(numCoords, numObjs, objects, k, 1, clusters, dist,
+                            NULL, blockSum);
+    }
+
+    free(blockSum);
+    free(dist);
+    return (k == numClusters);
+}
+
+/*----< seed_kmeans_parallel() >---------------------------------------------*/
+/* k-means||, returns 1 on success, 0 if there are less than numClusters     */
+/* distinct objects                                                          */
+int seed_kmeans_parallel(float      **objects,      /* in: [numObjs][numCoords] */
+                         int          numCoords,    /* no. coordinates */
+                         int          numObjs,      /* no. objects */
+                         int          numClusters,  /* no. clusters */
+                         unsigned int seed,         /* random seed */
+                         float      **clusters)     /* out: [numClusters][numCoords] */
+{
+    int     i, k, r, numCand, maxCand, numNew, ok;
+    int    *owner;     /* [numObjs]: closest candidate */
+    int    *threadNew; /* [numThreads+1]: start of each thread's samples */
+    float  *dist;      /* [numObjs] */
+    float **cand;      /* [maxCand][numCoords]: pointers into objects */
+    float  *weight;    /* [numCand] */
+    float  *cdist;     /* [numCand]: weighted D^2 of the candidates */
+    double *blockSum, total, rate;
+
+    dist     = (float*)  malloc(numObjs * sizeof(float));
+    assert(dist != NULL);
+    owner    = (int*)    malloc(numObjs * sizeof(int));
+    assert(owner != NULL);
+    blockSum = (double*) malloc(((numObjs + SEED_BLOCK - 1) / SEED_BLOCK) *
+                                sizeof(double));
+    assert(blockSum != NULL);
+    for (i=0; i<numObjs; i++) dist[i] = FLT_MAX;
+
+    maxCand = 1 + 2 * KMEANS_PAR_ROUNDS * KMEANS_PAR_OVERSAMPLE * numClusters;
+    cand    = (float**) malloc(maxCand * sizeof(float*));
+    assert(cand != NULL);
+    threadNew = (int*) malloc((omp_get_max_threads() + 1) * sizeof(int));
+    assert(threadNew != NULL);
+
+    /* one uniform center, then rounds of independent D^2 sampling */
+    cand[0] = objects[(int)(uniform(seed, 0, 0) * numObjs)];
+    numCand = 1;
+    total = update_dist(numCoords, numObjs, objects, 0, 1, cand, dist, owner,
+                        blockSum);
+
+    for (r=1; r<=KMEANS_PAR_ROUNDS && total > 0.0; r++) {
+        rate   = KMEANS_PAR_OVERSAMPLE * numClusters / total;
+        numNew = 0;
+        /* every thread samples its static chunk into a local list, the
+         * lists are appended in thread order, i.e. in object order */
+        #pragma omp parallel
+        {
+            int     j, t, tid = omp_get_thread_num();
+            int     numLocal = 0, maxLocal = 0;
+            float **local = NULL;
+
+            #pragma omp for schedule(static) nowait
+            for (j=0; j<numObjs; j++) {
+                if (dist[j] > 0.0 && uniform(seed, r, j) < rate * dist[j]) {
+                    if (numLocal == maxLocal) {
+                        maxLocal = (maxLocal > 0) ? 2 * maxLocal : 64;
+                        local = (float**) realloc(local, maxLocal * sizeof(float*));
+                        assert(local != NULL);
+                    }
+                    local[numLocal++] = objects[j];
+                }
+            }
+            threadNew[tid+1] = numLocal;
+            #pragma omp barrier
+
+            #pragma omp single
+            {
+                threadNew[0] = 0;
+                for (t=0; t<omp_get_num_threads(); t++)
+                    threadNew[t+1] += threadNew[t];
+                numNew = threadNew[omp_get_num_threads()];
+                if (numCand + numNew > maxCand) {
+                    while (numCand + numNew > maxCand) maxCand *= 2;
+                    cand = (float**) realloc(cand, maxCand * sizeof(float*));
+                    assert(cand != NULL);
+                }
+            }
+            if (numLocal > 0)
+                memcpy(cand + numCand + threadNew[tid], local,
+                       numLocal * sizeof(float*));
+            free(local);
+        }
+        total = update_dist(numCoords, numObjs, objects, numCand, numNew, cand,
+                            dist, owner, blockSum);
+        numCand += numNew;
+    }
+    printf("# seeding_candidates: %d\n", numCand);
+
+    /* weight of a candidate: no. objects closest to it */
+    weight = (float*) calloc(numCand, sizeof(float));
+    assert(weight != NULL);
+    for (i=0; i<numObjs; i++) weight[owner[i]] += 1.0;
+
+    /* weighted k-means++ over the candidates, small enough to be serial */
+    cdist = (float*) malloc(numCand * sizeof(float));
+    assert(cdist != NULL);
+    for (i=0; i<numCand; i++) cdist[i] = FLT_MAX;
+
+    total = 0.0;
+    for (i=0; i<numCand; i++) total += weight[i];
+    rate = uniform(seed, r, 0) * total;
+    for (i=0; i<numCand-1 && rate >= weight[i]; i++) rate -= weight[i];
+    memcpy(clusters[0], cand[i], numCoords * sizeof(float));
+
+    for (k=1; k<numClusters; k++) {
+        total = 0.0;
+        for (i=0; i<numCand; i++) {
+            float d = euclid_dist_2(numCoords, cand[i], clusters[k-1]);
+            if (d < cdist[i]) cdist[i] = d;
+            total += weight[i] * cdist[i];
+        }
+        if (total <= 0.0) break;
+        rate = uniform(seed, r, k) * total;
+        for (i=0; i<numCand-1 && rate >= weight[i] * cdist[i]; i++)
+            rate -= weight[i] * cdist[i];
+        while (cdist[i] == 0.0) i--;  /* rounding ran past the end */
+        memcpy(clusters[k], cand[i], numCoords * sizeof(float));
+    }
+    ok = (k == numClusters);
+
+    free(cdist);
+    free(weight);
+    free(threadNew);
+    free(cand);
+    free(blockSum);
+    free(owner);
+    free(dist);
+    return ok;
+}
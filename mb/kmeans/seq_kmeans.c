@@ -68,7 +68,8 @@ int find_nearest_cluster(int     numClusters, /* no. clusters */
 
 /*----< seq_kmeans() >-------------------------------------------------------*/
 /* return an array of cluster centers of size [numClusters][numCoords]       */
-int seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
+int seq_kmeans(int     is_blocked,   /* in: use blocked assignment */
+               float **objects,      /* in: [numObjs][numCoords] */
                int     numCoords,    /* no. features */
                int     numObjs,      /* no. objects */
                int     numClusters,  /* no. clusters */
@@ -82,6 +83,8 @@ int seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
                                 new cluster */
     float    delta;          /* % of objects change their clusters */
     float  **newClusters;    /* [numClusters][numCoords] */
+    int     *nearest=NULL;   /* [numObjs]: blocked assignment result */
+    float   *packed=NULL;    /* packed cluster centers for assign_nearest() */
 
     /* initialize membership[] */
     for (i=0; i<numObjs; i++) membership[i] = -1;
@@ -97,11 +100,29 @@ int seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
     for (i=1; i<numClusters; i++)
         newClusters[i] = newClusters[i-1] + numCoords;
 
+    if (is_blocked) {
+        /* the blocked kernel reads objects[0] as one row major array */
+        nearest = (int*)   malloc(numObjs * sizeof(int));
+        assert(nearest != NULL);
+        packed  = (float*) malloc(assign_packed_size(numClusters, numCoords) *
+                                  sizeof(float));
+        assert(packed != NULL);
+    }
+
     do {
         delta = 0.0;
+        if (is_blocked) {
+            assign_pack(numClusters, numCoords, clusters, packed);
+            for (i=0; i<numObjs; i+=ASSIGN_TILE)
+                assign_nearest((numObjs-i < ASSIGN_TILE) ? numObjs-i
+                                                         : ASSIGN_TILE,
+                               numCoords, numClusters, objects[i], packed,
+                               nearest+i);
+        }
         for (i=0; i<numObjs; i++) {
             /* find the array index of nestest cluster center */
-            index = find_nearest_cluster(numClusters, numCoords, objects[i],
+            index = is_blocked ? nearest[i] :
+                    find_nearest_cluster(numClusters, numCoords, objects[i],
                                          clusters);
 
             /* if membership changes, increase delta by 1 */
@@ -129,6 +150,10 @@ int seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
         delta /= numObjs;
     } while (delta > threshold && loop++ < 500);
 
+    if (is_blocked) {
+        free(nearest);
+        free(packed);
+    }
     free(newClusters[0]);
     free(newClusters);
     free(newClusterSize);
@@ -38,6 +38,7 @@ static void usage(char *argv0, float threshold) {
         "       -b             : input file is in binary format (default no)\n"
         "       -n num_clusters: number of clusters (K must > 1)\n"
         "       -t threshold   : threshold value (default %.4f)\n"
+        "       -g             : blocked GEMM style assignment step (default no)\n"
         "       -o             : output timing results (default no)\n"
         "       -q             : quiet mode\n"
         "       -d             : enable debug mode\n"
@@ -51,7 +52,7 @@ int main(int argc, char **argv) {
            int     opt;
     extern char   *optarg;
     extern int     optind;
-           int     i, j, isBinaryFile, is_output_timing, verbose;
+           int     i, j, isBinaryFile, is_output_timing, is_blocked, verbose;
 
            int     numClusters, numCoords, numObjs;
            int    *membership;    /* [numObjs] */
@@ -68,10 +69,11 @@ int main(int argc, char **argv) {
     numClusters      = 0;
     isBinaryFile     = 0;
     is_output_timing = 0;
+    is_blocked       = 0;
     filename         = NULL;
     center_filename  = NULL;
 
-    while ( (opt=getopt(argc,argv,"p:i:c:n:t:abdohq"))!= EOF) {
+    while ( (opt=getopt(argc,argv,"p:i:c:n:t:abdghoq"))!= EOF) {
         switch (opt) {
             case 'i': filename=optarg;
                       break;
@@ -83,6 +85,8 @@ int main(int argc, char **argv) {
                       break;
             case 'n': numClusters = atoi(optarg);
                       break;
+            case 'g': is_blocked = 1;
+                      break;
             case 'o': is_output_timing = 1;
                       break;
             case 'q': verbose = 0;
@@ -168,8 +172,8 @@ int main(int argc, char **argv) {
     membership = (int*) malloc(numObjs * sizeof(int));
     assert(membership != NULL);
 
-    seq_kmeans(objects, numCoords, numObjs, numClusters, threshold, membership,
-               clusters);
+    seq_kmeans(is_blocked, objects, numCoords, numObjs, numClusters, threshold,
+               membership, clusters);
 
     free(objects[0]);
     free(objects);
@@ -191,6 +195,8 @@ int main(int argc, char **argv) {
     if (is_output_timing) {
         io_timing += wtime() - timing;
         printf("\nPerforming **** Regular Kmeans (sequential version) ****\n");
+        if (is_blocked)
+            printf("Using blocked assignment step\n");
 
         printf("Input file:     %s\n", filename);
         printf("numObjs       = %d\n", numObjs);
@@ -0,0 +1,122 @@
+// Batched K nearest search: the queries are handled in tiles of QUERY_TILE,
+// each against the data set in tiles of ROW_TILE rows, like the blocks of a
+// matrix product. The data set is stored once, tile by tile, with the
+// coordinates of a tile transposed, so the distances of one query to all
+// rows of a tile are computed in a vectorized loop over the rows; the row
+// tile stays in cache while the queries of the tile use it, so the data set
+// is read once per query tile instead of once per query. Every query keeps
+// a bounded max-heap of its K nearest rows. Query tiles are distributed over
+// the OpenMP threads. The distances are summed in the same order as the
+// scalar loop, so the neighbours are exactly those of a full scan.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include "knn.h"
+
+#ifndef QUERY_TILE
+#define QUERY_TILE 16
+#endif
+#ifndef ROW_TILE
+#define ROW_TILE 256
+#endif
+#define ROW_VEC 8      // divides ROW_TILE
+
+struct tiles {
+    int rows, columns, ntiles;
+    double *t;         // [ntiles][columns][ROW_TILE]
+};
+
+struct tiles *tiles_build(double *data, int rows, int columns)
+{
+    struct tiles *t = malloc(sizeof(struct tiles));
+    if (t == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    t->rows = rows;
+    t->columns = columns;
+    t->ntiles = (rows + ROW_TILE - 1) / ROW_TILE;
+    t->t = malloc((size_t)t->ntiles * columns * ROW_TILE * sizeof(double));
+    if (t->t == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    // each thread transposes its own tiles, the first touch places them
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < t->ntiles; b++) {
+        double *tile = t->t + (size_t)b * columns * ROW_TILE;
+        for (int j = 0; j < columns; j++)
+            for (int r = 0; r < ROW_TILE; r++) {
+                int i = b * ROW_TILE + r;
+                // padding rows repeat the last row and are never pushed
+                tile[j * ROW_TILE + r] = data[(size_t)(i < rows ? i : rows - 1) * columns + j];
+            }
+    }
+    return t;
+}
+
+// The K nearest rows of each of the nq queries x[nq][columns] into
+// heaps[nq][K] and their number into found[nq]. Query q is row self0 + q of
+// the data set and excluded from its own neighbours, unless self0 < 0.
+void batch_nearest(const struct tiles *t, const double *x, int nq, int self0,
+                   int K, struct aux *heaps, int *found)
+{
+    int columns = t->columns;
+
+    #pragma omp parallel
+    {
+        double dist[QUERY_TILE][ROW_TILE];
+
+        #pragma omp for schedule(dynamic)
+        for (int q0 = 0; q0 < nq; q0 += QUERY_TILE) {
+            int nqt = nq - q0 < QUERY_TILE ? nq - q0 : QUERY_TILE;
+            for (int q = 0; q < nqt; q++) found[q0 + q] = 0;
+
+            for (int b = 0; b < t->ntiles; b++) {
+                const double *restrict tile = t->t + (size_t)b * columns * ROW_TILE;
+                int r0 = b * ROW_TILE;
+                int nr = t->rows - r0 < ROW_TILE ? t->rows - r0 : ROW_TILE;
+
+                for (int q = 0; q < nqt; q++) {
+                    const double *xq = x + (size_t)(q0 + q) * columns;
+                    // ROW_VEC rows at a time, their sums stay in registers
+                    for (int r = 0; r < ROW_TILE; r += ROW_VEC) {
+                        double a[ROW_VEC] = { 0.0 };
+                        for (int j = 0; j < columns; j++) {
+                            const double *restrict c = tile + j * ROW_TILE + r;
+                            double xj = xq[j];
+                            for (int l = 0; l < ROW_VEC; l++) {
+                                double d = c[l] - xj;
+                                a[l] += d * d;
+                            }
+                        }
+                        for (int l = 0; l < ROW_VEC; l++) dist[q][r + l] = a[l];
+                    }
+                }
+
+                for (int q = 0; q < nqt; q++) {
+                    struct aux *heap = heaps + (size_t)(q0 + q) * K;
+                    int self = self0 < 0 ? -1 : self0 + q0 + q;
+                    int n = found[q0 + q];
+                    // most rows are farther than the K-th nearest so far
+                    double worst = n == K ? heap[0].dist : HUGE_VAL;
+                    for (int r = 0; r < nr; r++)
+                        if (dist[q][r] <= worst && r0 + r != self) {
+                            heap_push(heap, &n, K, dist[q][r], r0 + r);
+                            if (n == K) worst = heap[0].dist;
+                        }
+                    found[q0 + q] = n;
+                }
+            }
+        }
+    }
+}
+
+void tiles_free(struct tiles *t)
+{
+    free(t->t);
+    free(t);
+}
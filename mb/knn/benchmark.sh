@@ -8,3 +8,27 @@ for num_threads in 1 ; do
     "$MEASURE" ./knn 10 data/prepared/mb/knn/adult.data 1000
 done
 
+# per query time of the K nearest search, see "# query_time_us:"; sort is
+# the original full qsort, the speedup of the others is relative to it
+for method in sort heap select kdtree; do
+    "$MEASURE" ./knn 10 data/prepared/mb/knn/adult.data 1000 $method
+done
+
+# batched queries, tiled against the data set, on 1 to 16 threads
+for num_threads in 1 2 4 8 16; do
+    OMP_NUM_THREADS=$num_threads "$MEASURE" ./knn 10 data/prepared/mb/knn/adult.data 1000 batch
+done
+
+# loading, see "# load_time:": text parsing against the mapped binary file,
+# and the accuracy with normalised coordinates
+./txt2bin data/prepared/mb/knn/adult.data data/prepared/mb/knn/adult.bin
+"$MEASURE" ./knn 10 data/prepared/mb/knn/adult.data 1000 batch
+"$MEASURE" ./knn 10 data/prepared/mb/knn/adult.bin 1000 batch
+"$MEASURE" ./knn -n 10 data/prepared/mb/knn/adult.bin 1000 batch
+
+# approximate search: accuracy (Sensitivity, Specificity, recall) against
+# query time for more lists searched, without and with product quantisation
+for nprobe in 1 2 4 8 16; do
+    "$MEASURE" ./knn -p $nprobe 10 data/prepared/mb/knn/adult.bin 1000 ivf
+    "$MEASURE" ./knn -p $nprobe -q 7 10 data/prepared/mb/knn/adult.bin 1000 ivf
+done
@@ -0,0 +1,221 @@
+// Loading of the KNN data sets.
+//
+// Text format (see convert.pl): a "rows columns" line, one line per column
+// with its no. categories and their names, then one comma separated line per
+// row. The last column is the class label.
+//
+// Binary format (written by txt2bin): a struct knn_header, the coordinates
+// [rows][columns] as float or double, row-major, then the labels [rows] as
+// 32-bit integers. Double files are mapped, not read, and used in place.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "knn.h"
+
+#define KNN_MAGIC "KNNB"
+#define KNN_VERSION 1
+
+struct knn_header {
+    char magic[4];
+    int version;
+    int rows;
+    int columns;       // coordinates, without the label
+    int size;          // bytes per coordinate, 4 or 8
+    int reserved[3];   // pads the coordinates to a multiple of 32 bytes
+};
+
+static void *xmalloc(size_t size)
+{
+    void *p = malloc(size);
+    if (p == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void load_text(const char *file, struct dataset *d)
+{
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        perror(file);
+        exit(1);
+    }
+
+    // the whole file at once, parsed in place
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0) {
+        perror(file);
+        exit(1);
+    }
+    char *buf = xmalloc(st.st_size + 1);
+    if (fread(buf, 1, st.st_size, f) != (size_t)st.st_size) {
+        perror(file);
+        exit(1);
+    }
+    buf[st.st_size] = '\0';
+    fclose(f);
+
+    // data size, the label is the last column
+    char *p = buf, *e;
+    int columns;
+    d->rows = strtol(p, &e, 10);
+    columns = strtol(e, &p, 10);
+    if (e == buf || p == e || d->rows <= 0 || columns < 2) {
+        fprintf(stderr, "Error reading header\n");
+        exit(1);
+    }
+    d->columns = columns - 1;
+
+    // the category names are not needed, skip their lines
+    for (int i = 0; i <= columns; i++) {
+        p = strchr(p, '\n');
+        if (p == NULL) {
+            fprintf(stderr, "Error reading categories\n");
+            exit(1);
+        }
+        p++;
+    }
+
+    d->x = xmalloc((size_t)d->rows * d->columns * sizeof(double));
+    d->label = xmalloc(d->rows * sizeof(int));
+    d->map = NULL;
+    for (int i = 0; i < d->rows; i++) {
+        for (int j = 0; j < columns; j++) {
+            double v = strtod(p, &e);
+            if (e == p || (j > 0 && p[-1] != ',')) {
+                fprintf(stderr, "Error reading data row %d column %d\n", i, j);
+                exit(1);
+            }
+            if (j < d->columns) d->x[(size_t)i * d->columns + j] = v;
+            else d->label[i] = v;
+            p = e + 1;
+        }
+    }
+    free(buf);
+}
+
+static void load_binary(const char *file, int fd, struct dataset *d)
+{
+    struct knn_header h;
+    struct stat st;
+
+    if (read(fd, &h, sizeof(h)) != sizeof(h) || fstat(fd, &st) != 0 ||
+            h.version != KNN_VERSION || (h.size != 4 && h.size != 8) ||
+            h.rows <= 0 || h.columns <= 0 ||
+            st.st_size < (off_t)sizeof(h) + (off_t)h.rows * h.columns * h.size
+                         + (off_t)h.rows * sizeof(int)) {
+        fprintf(stderr, "%s: not a valid binary data set\n", file);
+        exit(1);
+    }
+    d->rows = h.rows;
+    d->columns = h.columns;
+
+    // private and writable, so normalise() may work in place without
+    // touching the file
+    d->map_size = st.st_size;
+    d->map = mmap(NULL, d->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (d->map == MAP_FAILED) {
+        perror(file);
+        exit(1);
+    }
+    char *body = (char *)d->map + sizeof(h);
+    size_t n = (size_t)h.rows * h.columns;
+    d->label = (int *)(body + n * h.size);
+
+    if (h.size == 8) d->x = (double *)body;
+    else {
+        const float *s = (const float *)body;
+        d->x = xmalloc(n * sizeof(double));
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; i++) d->x[i] = s[i];
+    }
+}
+
+// Load a text or binary data set, told apart by the magic number.
+void load_data(const char *file, struct dataset *d)
+{
+    char magic[4];
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        perror(file);
+        exit(1);
+    }
+    if (read(fd, magic, 4) == 4 && memcmp(magic, KNN_MAGIC, 4) == 0) {
+        lseek(fd, 0, SEEK_SET);
+        load_binary(file, fd, d);
+    } else load_text(file, d);
+    close(fd);
+}
+
+// Write a data set in the binary format, with float coordinates if single.
+void save_binary(const char *file, const struct dataset *d, int single)
+{
+    struct knn_header h = { KNN_MAGIC, KNN_VERSION, d->rows, d->columns,
+                            single ? 4 : 8, { 0, 0, 0 } };
+    size_t n = (size_t)d->rows * d->columns;
+    FILE *f = fopen(file, "wb");
+    if (f == NULL) {
+        perror(file);
+        exit(1);
+    }
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (single) {
+        float *s = xmalloc(n * sizeof(float));
+        for (size_t i = 0; i < n; i++) s[i] = d->x[i];
+        ok = ok && fwrite(s, sizeof(float), n, f) == n;
+        free(s);
+    } else ok = ok && fwrite(d->x, sizeof(double), n, f) == n;
+    ok = ok && fwrite(d->label, sizeof(int), d->rows, f) == (size_t)d->rows;
+    if (fclose(f) != 0 || !ok) {
+        perror(file);
+        exit(1);
+    }
+}
+
+// Scale every coordinate to mean 0 and standard deviation 1, once, so that
+// no coordinate dominates the distance just by its unit.
+void normalise(struct dataset *d)
+{
+    int rows = d->rows, columns = d->columns;
+    double *mean = xmalloc(columns * sizeof(double));
+    double *scale = xmalloc(columns * sizeof(double));
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < columns; j++) {
+        double s = 0.0, s2 = 0.0;
+        for (int i = 0; i < rows; i++) s += d->x[(size_t)i * columns + j];
+        mean[j] = s / rows;
+        for (int i = 0; i < rows; i++) {
+            double v = d->x[(size_t)i * columns + j] - mean[j];
+            s2 += v * v;
+        }
+        scale[j] = s2 > 0.0 ? 1.0 / sqrt(s2 / rows) : 0.0;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < columns; j++)
+            d->x[(size_t)i * columns + j] =
+                (d->x[(size_t)i * columns + j] - mean[j]) * scale[j];
+
+    free(scale);
+    free(mean);
+}
+
+void free_data(struct dataset *d)
+{
+    if (d->map != NULL) {
+        if ((char *)d->x != (char *)d->map + sizeof(struct knn_header)) free(d->x);
+        munmap(d->map, d->map_size);
+    } else {
+        free(d->x);
+        free(d->label);
+    }
+}
@@ -0,0 +1,287 @@
+// Approximate K nearest search with an inverted file (IVF): the data set is
+// clustered into nlist lists by the k-means code of mb/kmeans (k-means++
+// seeding, blocked Lloyd iterations), every row is stored in the list of its
+// nearest centroid, and a query only scans the nprobe lists whose centroids
+// are nearest to it. With nprobe == nlist the search is exact.
+//
+// Optionally the lists hold product quantisation (PQ) codes instead of the
+// rows: the residual of a row to its centroid is split into m subspaces of
+// consecutive coordinates, each replaced by the index of the nearest of up
+// to 256 codewords, trained by the same k-means code. A query then looks up
+// the distances of its own residual to all codewords in a table per probed
+// list, so a row costs m table lookups instead of a full distance, and the
+// list entries take m bytes instead of columns doubles.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "knn.h"
+#include "kmeans.h"
+
+int _debug = 0; // read by the kmeans code
+
+#define IVF_THRESHOLD 0.01  // k-means stops below this fraction of changes
+#define PQ_KSUB 256    // codewords per subspace, fit in a byte
+
+struct ivf {
+    int rows, columns, nlist;
+    double *centroid;       // [nlist][columns]
+    int *start;             // [nlist + 1] first entry of each list
+    int *index;             // [rows] row of each entry, list after list
+    double *pts;            // [rows][columns] the entries, or NULL with PQ
+    int m, ksub;            // PQ subspaces and codewords per subspace
+    int *sub;               // [m + 1] first coordinate of each subspace
+    double *codebook;       // [m][ksub][subspace width], subspace s at
+                            // codebook + ksub * sub[s]
+    unsigned char *codes;   // [rows][m] the entries
+    struct aux *probe;      // [nlist] query scratch
+    double *table;          // [m][ksub] query scratch
+};
+
+static void *xmalloc(size_t size)
+{
+    void *p = malloc(size);
+    if (p == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+// n rows of dim floats as the float** the kmeans code takes
+static float **rows_of(float *x, int n, int dim)
+{
+    float **r = xmalloc(n * sizeof(float *));
+    for (int i = 0; i < n; i++) r[i] = x + (size_t)i * dim;
+    return r;
+}
+
+// k-means on the n objects obj[n][dim] into clusters[k][dim]. Returns k, less
+// than asked if there are not that many distinct objects.
+static int train(float *obj, int n, int dim, int k, float *clusters)
+{
+    float **o = rows_of(obj, n, dim), **c = rows_of(clusters, k, dim);
+    int *membership = xmalloc(n * sizeof(int));
+
+    if (k > n) k = n;
+    while (k > 1 && !seed_kmeanspp(o, dim, n, k, 1, c)) k /= 2;
+    if (k > 1)
+        omp_kmeans(0, 1, o, dim, n, k, IVF_THRESHOLD, membership, c);
+    else
+        memcpy(clusters, obj, dim * sizeof(float));
+
+    free(membership);
+    free(c);
+    free(o);
+    return k;
+}
+
+// nearest of the k clusters[k][dim] of each of the n objects obj[n][dim]
+static void assign(const float *obj, int n, int dim, float *clusters, int k,
+                   int *nearest)
+{
+    float **c = rows_of(clusters, k, dim);
+    float *packed = xmalloc(assign_packed_size(k, dim) * sizeof(float));
+    assign_pack(k, dim, c, packed);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i += ASSIGN_TILE)
+        assign_nearest(n - i < ASSIGN_TILE ? n - i : ASSIGN_TILE, dim, k,
+                       obj + (size_t)i * dim, packed, nearest + i);
+
+    free(packed);
+    free(c);
+}
+
+struct ivf *ivf_build(double *data, int rows, int columns, int nlist, int m)
+{
+    struct ivf *t = xmalloc(sizeof(struct ivf));
+    size_t n = (size_t)rows * columns;
+    int ntrain, step;
+
+    t->rows = rows;
+    t->columns = columns;
+
+    // a float copy for the kmeans code, and every step-th row to train on
+    float *x = xmalloc(n * sizeof(float));
+    for (size_t i = 0; i < n; i++) x[i] = data[i];
+    step = rows / (IVF_TRAIN * nlist);
+    if (step < 1) step = 1;
+    ntrain = (rows + step - 1) / step;
+    float *sample = xmalloc((size_t)ntrain * columns * sizeof(float));
+    for (int i = 0; i < ntrain; i++)
+        memcpy(sample + (size_t)i * columns, x + (size_t)i * step * columns,
+               columns * sizeof(float));
+
+    // coarse quantiser
+    float *centroid = xmalloc((size_t)nlist * columns * sizeof(float));
+    t->nlist = nlist = train(sample, ntrain, columns, nlist, centroid);
+    t->centroid = xmalloc((size_t)nlist * columns * sizeof(double));
+    for (size_t i = 0; i < (size_t)nlist * columns; i++)
+        t->centroid[i] = centroid[i];
+
+    // rows into lists, by a counting sort on their nearest centroid
+    int *list = xmalloc(rows * sizeof(int));
+    assign(x, rows, columns, centroid, nlist, list);
+    t->start = calloc(nlist + 1, sizeof(int));
+    t->index = xmalloc(rows * sizeof(int));
+    if (t->start == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < rows; i++) t->start[list[i] + 1]++;
+    for (int l = 0; l < nlist; l++) t->start[l + 1] += t->start[l];
+    for (int i = 0; i < rows; i++) {
+        int e = t->start[list[i]]++;
+        t->index[e] = i;
+    }
+    for (int l = nlist; l > 0; l--) t->start[l] = t->start[l - 1];
+    t->start[0] = 0;
+
+    t->m = m > columns ? columns : m;
+    t->pts = NULL;
+    t->sub = NULL;
+    t->codebook = NULL;
+    t->codes = NULL;
+    t->table = NULL;
+    t->probe = xmalloc(nlist * sizeof(struct aux));
+
+    if (t->m <= 0) {
+        t->m = 0;
+        t->ksub = 0;
+        t->pts = xmalloc(n * sizeof(double));
+        for (int e = 0; e < rows; e++)
+            memcpy(t->pts + (size_t)e * columns,
+                   data + (size_t)t->index[e] * columns,
+                   columns * sizeof(double));
+    } else {
+        // residuals to the centroids, replacing the float copy
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < columns; j++)
+                x[(size_t)i * columns + j] = data[(size_t)i * columns + j] -
+                    t->centroid[(size_t)list[i] * columns + j];
+
+        m = t->m;
+        t->ksub = PQ_KSUB;
+        t->sub = xmalloc((m + 1) * sizeof(int));
+        for (int s = 0; s <= m; s++) t->sub[s] = s * columns / m;
+        t->codebook = xmalloc((size_t)PQ_KSUB * columns * sizeof(double));
+        t->codes = xmalloc((size_t)rows * m);
+        t->table = xmalloc((size_t)m * PQ_KSUB * sizeof(double));
+
+        float *subx = xmalloc((size_t)rows * columns * sizeof(float));
+        float *cb = xmalloc((size_t)PQ_KSUB * columns * sizeof(float));
+        int *code = xmalloc(rows * sizeof(int));
+        step = rows / (IVF_TRAIN * PQ_KSUB);
+        if (step < 1) step = 1;
+        ntrain = (rows + step - 1) / step;
+        for (int s = 0; s < m; s++) {
+            int d = t->sub[s + 1] - t->sub[s], k;
+            // the subvectors of the training rows, then of all rows
+            for (int i = 0; i < ntrain; i++)
+                memcpy(subx + (size_t)i * d,
+                       x + (size_t)i * step * columns + t->sub[s],
+                       d * sizeof(float));
+            k = train(subx, ntrain, d, PQ_KSUB, cb);
+            // unused codewords, if too few distinct subvectors, never match
+            for (int c = 0; c < PQ_KSUB; c++)
+                for (int j = 0; j < d; j++)
+                    t->codebook[(size_t)PQ_KSUB * t->sub[s] + c * d + j] =
+                        c < k ? cb[c * d + j] : DBL_MAX;
+            for (int i = 0; i < rows; i++)
+                memcpy(subx + (size_t)i * d,
+                       x + (size_t)i * columns + t->sub[s], d * sizeof(float));
+            assign(subx, rows, d, cb, k, code);
+            for (int e = 0; e < rows; e++)
+                t->codes[(size_t)e * m + s] = code[t->index[e]];
+        }
+        free(code);
+        free(cb);
+        free(subx);
+    }
+
+    free(list);
+    free(centroid);
+    free(sample);
+    free(x);
+    return t;
+}
+
+int ivf_lists(const struct ivf *t)
+{
+    return t->nlist;
+}
+
+// The K nearest rows of x other than row self (-1 for none) found in the
+// nprobe nearest lists into heap[K], returns their number. With PQ the
+// distances are approximate. Not thread safe, uses scratch space of t.
+int ivf_query(const struct ivf *t, const double *x, int self, int K,
+              int nprobe, struct aux *heap)
+{
+    int columns = t->columns, found = 0;
+
+    for (int l = 0; l < t->nlist; l++) {
+        const double *c = t->centroid + (size_t)l * columns;
+        double a = 0.0;
+        for (int j = 0; j < columns; j++) {
+            double b = (c[j] - x[j]);
+            a += b * b;
+        }
+        t->probe[l] = (struct aux){a, l};
+    }
+    if (nprobe > t->nlist) nprobe = t->nlist;
+    select_k(t->probe, t->nlist, nprobe);
+
+    for (int p = 0; p < nprobe; p++) {
+        int l = t->probe[p].index;
+        if (t->m == 0) {
+            for (int e = t->start[l]; e < t->start[l + 1]; e++) {
+                const double *r = t->pts + (size_t)e * columns;
+                double a = 0.0;
+                for (int j = 0; j < columns; j++) {
+                    double b = (r[j] - x[j]);
+                    a += b * b;
+                }
+                if (t->index[e] != self) heap_push(heap, &found, K, a, t->index[e]);
+            }
+            continue;
+        }
+
+        // distances of the query residual to all codewords
+        const double *c = t->centroid + (size_t)l * columns;
+        for (int s = 0; s < t->m; s++) {
+            int j0 = t->sub[s], d = t->sub[s + 1] - j0;
+            const double *cb = t->codebook + (size_t)t->ksub * j0;
+            for (int k = 0; k < t->ksub; k++) {
+                double a = 0.0;
+                for (int j = 0; j < d; j++) {
+                    double b = (x[j0 + j] - c[j0 + j]) - cb[k * d + j];
+                    a += b * b;
+                }
+                t->table[s * t->ksub + k] = a;
+            }
+        }
+        for (int e = t->start[l]; e < t->start[l + 1]; e++) {
+            const unsigned char *code = t->codes + (size_t)e * t->m;
+            double a = 0.0;
+            for (int s = 0; s < t->m; s++) a += t->table[s * t->ksub + code[s]];
+            if (t->index[e] != self) heap_push(heap, &found, K, a, t->index[e]);
+        }
+    }
+    return found;
+}
+
+void ivf_free(struct ivf *t)
+{
+    free(t->table);
+    free(t->codes);
+    free(t->codebook);
+    free(t->sub);
+    free(t->probe);
+    free(t->pts);
+    free(t->index);
+    free(t->start);
+    free(t->centroid);
+    free(t);
+}
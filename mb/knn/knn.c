@@ -2,123 +2,167 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <omp.h>
 #include "oprecomp.h"
+#include "knn.h"
 
-FILE *open_data(const char *file, int *rows, int *columns)
-{
-    FILE *data = fopen(file, "r");
-    if (data == NULL) {
-        perror(file);
-        exit(1);
-    }
+enum method { SORT, HEAP, SELECT, KDTREE, BATCH, IVF, METHODS };
+static const char *method_name[METHODS] = {
+    "sort", "heap", "select", "kdtree", "batch", "ivf"
+};
 
-    // read data size
-    if (fscanf(data, "%d %d\n", rows, columns) != 2) {
-        perror("Error reading header");
-        exit(1);
-    }
-    return data;
+#define KDTREE_LEAF 32
+
+int compar(const void *a, const void *b)
+{
+    const struct aux *c = a, *d = b;
+    if (aux_less(c->dist, c->index, d)) return -1;
+    else if (aux_less(d->dist, d->index, c)) return 1;
+    else return 0;
 }
 
-char ***read_category(FILE *data, int columns)
+// IVF search parameters
+static struct ivf *ivf;
+static int nprobe = 8;
+
+// Find the K nearest rows of x, other than row self, into v[0..K): a full
+// sort, a bounded max-heap, quickselect, a KD-tree or an approximate IVF
+// search.
+int nearest(enum method m, int K, double *x, int self, int rows, int columns,
+            double *data, struct aux *v, const struct kdtree *tree)
 {
-    char buffer[1024];
-    char ***cat = malloc(sizeof(char **) * columns);
-    for (int i = 0; i < columns; i++) {
-        if (fgets(buffer, sizeof(buffer), data) == NULL) {
-            perror("Error reading categories");
-            exit(1);
-        }
-        char *t = strtok(buffer, ",\n");
-        if (t == NULL) {
-            fprintf(stderr, "Error reading categories\n");
-            exit(1);
+    int n = 0;
+    if (m == KDTREE) return kdtree_query(tree, x, self, K, v);
+    if (m == IVF) return ivf_query(ivf, x, self, K, nprobe, v);
+
+    for (int i = 0; i < rows; i++) {
+        double a = 0.0;
+        for (int j = 0; j < columns; j++) {
+            double b = (data[i * columns + j] - x[j]);
+            a += b * b;
         }
-        int n = atoi(t);
-        if (n <= 0) cat[i] = NULL;
+        if (i == self) continue;
+        if (m == HEAP) heap_push(v, &n, K, a, i);
         else {
-            cat[i] = malloc(sizeof(char *) * n);
-            for (int j = 0; j < n; j++) {
-                t = strtok(NULL, ",\n");
-                if (t == NULL) {
-                    fprintf(stderr, "Error reading categories\n");
-                    exit(1);
-                }
-                cat[i][j] = strcpy(malloc((strlen(t) + 1) * sizeof(char)), t);
-            }
+            v[n].dist = a;
+            v[n].index = i;
+            n++;
         }
     }
-    return cat;
+    if (m == SORT) qsort(v, n, sizeof(struct aux), compar);
+    else if (m == SELECT) select_k(v, n, K);
+    return n < K ? n : K;
 }
 
-double *read_data(FILE *data, int rows, int columns)
+int ballot(int n, const struct aux *v, const int *label)
 {
-    double *x = malloc(rows * columns * sizeof(double));
-    if (x == NULL) {
-        fprintf(stderr, "Out of memory\n");
-        exit(1);
-    }
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < columns; j++) {
-            if (fscanf(data, j == 0 ? "%lf" : ",%lf", x + i * columns + j) != 1) {
-                fprintf(stderr, "Error reading data row %d column %d\n", i, j);
-                exit(1);
-            }
-        }
+    int c[2] = { 0, 0 };
+    for (int i = 0; i < n; i++) {
+        // ballot (assumes binary clasification)
+        if (label[v[i].index] == 0) c[0]++;
+        else c[1]++;
     }
-    return x;
+    if (c[0] >= c[1]) return 0;
+    else return 1;
 }
 
-struct aux {
-    double dist;
-    int index;
-};
+int vote(enum method m, int K, double *x, int self, int rows, int columns,
+         double *data, const int *label, struct aux *v,
+         const struct kdtree *tree)
+{
+    int n = nearest(m, K, x, self, rows, columns, data, v, tree);
+    return ballot(n, v, label);
+}
 
-int compar(const void *a, const void *b)
+static double now(void)
 {
-    double c = ((struct aux *)a)->dist;
-    double d = ((struct aux *)b)->dist;
-    if (c < d) return -1;
-    else if (c > d) return 1;
-    else return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
 }
 
-int vote(int K, double *x, int rows, int columns, double *data, struct aux *v)
+static int compar_index(const void *a, const void *b)
 {
-    for (int i = 0; i < rows; i++) {
-        double a = 0.0;
-        for (int j = 0; j < columns; j++) {
-            double b = (data[i * columns + j] - x[j]);
-            a += b * b;
-        }
-        v[i].dist = a;
-        v[i].index = i;
+    return ((const struct aux *)a)->index - ((const struct aux *)b)->index;
+}
+
+// Fraction of the exact K nearest rows of the first samples rows that the
+// approximate search finds.
+double recall(int K, int samples, int rows, int columns, double *data)
+{
+    struct tiles *tiles = tiles_build(data, rows, columns);
+    struct aux *exact = malloc((size_t)samples * K * sizeof(struct aux));
+    struct aux *v = malloc(K * sizeof(struct aux));
+    int *found = malloc(samples * sizeof(int));
+    long hits = 0, total = 0;
+    if (exact == NULL || v == NULL || found == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
     }
-    qsort(v, rows, sizeof(struct aux), compar);
-    int c[1]; c[0] = 0; c[1] = 0;
-    for (int i = 1; i < K + 1; i++) { // first element is himself
-        // ballot (assumes binary clasification)
-        if (data[v[i].index * columns + columns - 1] == 0) c[0]++;
-        else c[1]++;
-        // c[b]++; does not with optimization GCC bug}
+    batch_nearest(tiles, data, samples, 0, K, exact, found);
+
+    for (int k = 0; k < samples; k++) {
+        struct aux *e = exact + (size_t)k * K;
+        int n = ivf_query(ivf, data + (size_t)k * columns, k, K, nprobe, v);
+        qsort(e, found[k], sizeof(struct aux), compar_index);
+        qsort(v, n, sizeof(struct aux), compar_index);
+        for (int i = 0, j = 0; i < found[k] && j < n;) {
+            if (e[i].index == v[j].index) hits++;
+            if (e[i].index <= v[j].index) i++;
+            else j++;
+        }
+        total += found[k];
     }
-    if (c[0] >= c[1]) return 0;
-    else return 1;
+
+    free(found);
+    free(v);
+    free(exact);
+    tiles_free(tiles);
+    return total > 0 ? (double)hits / total : 1.0;
 }
 
 int main(int argc, const char* argv[])
 {
-    int K, rows, columns, samples;
-    if (argc != 4 || (K = atoi(argv[1])) <= 0 ||
-            (samples = atoi(argv[3])) <= 0) {
-        fprintf(stderr, "usage: <k> <data file> <samples>\n");
+    int K, rows, columns, samples, m = HEAP, opt, norm = 0, nlist = 0, pq = 0;
+    while ((opt = getopt(argc, (char **)argv, "nl:p:q:")) != -1) {
+        if (opt == 'n') norm = 1;
+        else if (opt == 'l') nlist = atoi(optarg);
+        else if (opt == 'p') nprobe = atoi(optarg);
+        else if (opt == 'q') pq = atoi(optarg);
+        else argc = 0;
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+    if (argc == 5)
+        for (m = METHODS - 1; m >= 0; m--)
+            if (strcmp(argv[4], method_name[m]) == 0) break;
+    if (argc < 4 || argc > 5 || m < 0 || (K = atoi(argv[1])) <= 0 ||
+            (samples = atoi(argv[3])) <= 0 || nlist < 0 || nprobe <= 0 ||
+            pq < 0) {
+        fprintf(stderr, "usage: [-n] [-l nlist] [-p nprobe] [-q m] <k> "
+                "<data file> <samples> [sort|heap|select|kdtree|batch|ivf]\n"
+                "  -n: normalise the coordinates to mean 0, deviation 1\n"
+                "  -l: ivf lists (default sqrt(rows), at most rows/%d)\n"
+                "  -p: ivf lists searched per query (default 8)\n"
+                "  -q: ivf product quantisation into m subspaces (default 0, off)\n",
+                IVF_TRAIN);
         return 1;
     }
-    FILE *f = open_data(argv[2], &rows, &columns);
 
-    read_category(f, columns);
-    double *x = read_data(f, rows, columns);
-    fclose(f);
+    // text, or binary from txt2bin
+    struct dataset d;
+    double load_time = now();
+    load_data(argv[2], &d);
+    if (norm) normalise(&d);
+    load_time = now() - load_time;
+    rows = d.rows;
+    columns = d.columns;
+    double *x = d.x;
+    int *label = d.label;
+
+    if (samples > rows) samples = rows;
 
     struct aux *aux = malloc(rows * sizeof(struct aux));
     if (aux == NULL) {
@@ -126,19 +170,69 @@ int main(int argc, const char* argv[])
         return 1;
     }
 
+    struct kdtree *tree = NULL;
+    struct tiles *tiles = NULL;
+    struct aux *heaps = NULL;
+    int *found = NULL;
+    double build_time = 0.0, query_time, queries = 0;
+    if (m == KDTREE) {
+        build_time = now();
+        tree = kdtree_build(x, rows, columns, KDTREE_LEAF);
+        build_time = now() - build_time;
+    }
+    if (m == IVF) {
+        // every list needs IVF_TRAIN rows to train its centroid on
+        int max_nlist = rows / IVF_TRAIN > 1 ? rows / IVF_TRAIN : 1;
+        if (nlist == 0) nlist = sqrt(rows);
+        else if (nlist > max_nlist)
+            fprintf(stderr, "nlist %d limited to %d, rows/%d\n", nlist,
+                    max_nlist, IVF_TRAIN);
+        if (nlist > max_nlist) nlist = max_nlist;
+        build_time = now();
+        ivf = ivf_build(x, rows, columns, nlist, pq);
+        build_time = now() - build_time;
+        nlist = ivf_lists(ivf);
+    }
+    if (m == BATCH) {
+        build_time = now();
+        tiles = tiles_build(x, rows, columns);
+        build_time = now() - build_time;
+        heaps = malloc((size_t)samples * K * sizeof(struct aux));
+        found = malloc(samples * sizeof(int));
+        if (heaps == NULL || found == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
     int TP = 0, TN = 0, FP = 0, FN = 0;
 
     printf("# K: %d\n", K);
     printf("# datafile: %s\n", argv[2]);
     printf("# problem_size: %d\n", rows);
     printf("# dimension: %d\n", columns);
+    printf("# normalised: %d\n", norm);
+    printf("# load_time: %f\n", load_time);
     printf("# samples: %d\n", samples);
+    printf("# method: %s\n", method_name[m]);
+    if (m == BATCH) printf("# num_threads: %d\n", omp_get_max_threads());
+    if (m == IVF) {
+        printf("# nlist: %d\n", nlist);
+        printf("# nprobe: %d\n", nprobe);
+        printf("# pq_subspaces: %d\n", pq > columns ? columns : pq);
+    }
+    if (m == KDTREE || m == BATCH || m == IVF)
+        printf("# build_time: %f\n", build_time);
+    query_time = now();
     oprecomp_start();
     do {
 
+    if (m == BATCH) batch_nearest(tiles, x, samples, 0, K, heaps, found);
+
     for (int k = 0; k < samples; k++) {
-        int r = vote(K, x + k * columns, rows, columns, x, aux); // ballot result
-        int c = x[k * columns + columns - 1]; // true value
+        int r = (m == BATCH) ? ballot(found[k], heaps + (size_t)k * K, label)
+                             : vote(m, K, x + k * columns, k, rows, columns, x, label, aux, tree); // ballot result
+        int c = label[k]; // true value
         if (r == c) {
             if (r == 0) TN++;
             else TP++;
@@ -148,14 +242,27 @@ int main(int argc, const char* argv[])
         }
     }
 
+    queries += samples;
     } while (oprecomp_iterate());
     oprecomp_stop();
+    query_time = now() - query_time;
+    printf("# query_time_us: %f\n", 1e6 * query_time / queries);
     printf("# TP: %d\n", TP);
     printf("# TN: %d\n", TN);
     printf("# FP: %d\n", FP);
     printf("# FN: %d\n", FN);
     printf("# Sensitiviy:  %f\n", (double)TP / (TP + FN));
     printf("# Specificity: %f\n", (double)TN / (TN + FP));
+    if (m == IVF)
+        printf("# recall: %f\n", recall(K, samples, rows, columns, x));
+
+    if (tree != NULL) kdtree_free(tree);
+    if (tiles != NULL) tiles_free(tiles);
+    if (ivf != NULL) ivf_free(ivf);
+    free(heaps);
+    free(found);
+    free(aux);
+    free_data(&d);
 
     return 0;
 }
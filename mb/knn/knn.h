@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+
+// A row of the data set and its squared distance to the query.
+struct aux {
+    double dist;
+    int index;
+};
+
+// Neighbours are ordered by distance, ties by row index, so that every
+// search method selects exactly the same K rows.
+static inline int aux_less(double d, int i, const struct aux *b)
+{
+    return d < b->dist || (d == b->dist && i < b->index);
+}
+
+// Offer a row to a bounded max-heap of at most K entries; heap[0] is the
+// farthest of the current K nearest and is replaced by closer rows.
+static inline void heap_push(struct aux *heap, int *n, int K, double d, int i)
+{
+    int j;
+    if (*n < K) {
+        // sift up
+        for (j = (*n)++; j > 0 && aux_less(heap[(j - 1) / 2].dist,
+                                           heap[(j - 1) / 2].index,
+                                           &(struct aux){d, i}); j = (j - 1) / 2)
+            heap[j] = heap[(j - 1) / 2];
+        heap[j] = (struct aux){d, i};
+    } else if (aux_less(d, i, &heap[0])) {
+        // sift down
+        for (j = 0; 2 * j + 1 < K;) {
+            int c = 2 * j + 1;
+            if (c + 1 < K && aux_less(heap[c].dist, heap[c].index, &heap[c + 1]))
+                c++;
+            if (!aux_less(d, i, &heap[c])) break;
+            heap[j] = heap[c];
+            j = c;
+        }
+        heap[j] = (struct aux){d, i};
+    }
+}
+
+// A data set: the coordinates and, separately, the class label of each row.
+struct dataset {
+    int rows, columns;  // columns: coordinates, without the label
+    double *x;          // [rows][columns]
+    int *label;         // [rows]
+    void *map;          // mapped binary file, or NULL
+    size_t map_size;
+};
+
+// data.c
+void load_data(const char *file, struct dataset *d);
+void save_binary(const char *file, const struct dataset *d, int single);
+void normalise(struct dataset *d);
+void free_data(struct dataset *d);
+
+// select.c
+void select_k(struct aux *v, int n, int K);
+
+// kdtree.c
+struct kdtree;
+struct kdtree *kdtree_build(double *data, int rows, int columns, int leaf);
+int kdtree_query(const struct kdtree *t, const double *x, int self, int K,
+                 struct aux *heap);
+void kdtree_free(struct kdtree *t);
+
+// batch.c
+struct tiles;
+struct tiles *tiles_build(double *data, int rows, int columns);
+void batch_nearest(const struct tiles *t, const double *x, int nq, int self0,
+                   int K, struct aux *heaps, int *found);
+void tiles_free(struct tiles *t);
+
+// ivf.c
+#define IVF_TRAIN 64   // training rows per centroid or codeword
+struct ivf;
+struct ivf *ivf_build(double *data, int rows, int columns, int nlist, int m);
+int ivf_lists(const struct ivf *t);
+int ivf_query(const struct ivf *t, const double *x, int self, int K,
+              int nprobe, struct aux *heap);
+void ivf_free(struct ivf *t);
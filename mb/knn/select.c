@@ -0,0 +1,36 @@
+// Quickselect of the K nearest rows, O(rows) on average.
+
+#include "knn.h"
+
+static inline void swap(struct aux *a, struct aux *b)
+{
+    struct aux t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// Reorder v[0..n) so that v[0..K) are its K smallest entries, in no
+// particular order.
+void select_k(struct aux *v, int n, int K)
+{
+    int lo = 0, hi = n - 1;
+    if (K <= 0 || K >= n) return;
+    while (lo < hi) {
+        // median of three as pivot, moved to v[hi]
+        int mid = lo + (hi - lo) / 2;
+        if (aux_less(v[mid].dist, v[mid].index, &v[lo])) swap(&v[mid], &v[lo]);
+        if (aux_less(v[hi].dist, v[hi].index, &v[lo])) swap(&v[hi], &v[lo]);
+        if (aux_less(v[mid].dist, v[mid].index, &v[hi])) swap(&v[mid], &v[hi]);
+        struct aux p = v[hi];
+
+        int s = lo;
+        for (int i = lo; i < hi; i++)
+            if (aux_less(v[i].dist, v[i].index, &p)) swap(&v[i], &v[s++]);
+        swap(&v[s], &v[hi]);
+
+        // v[lo..s) < p == v[s] < v(s..hi]
+        if (s == K || s == K - 1) return;
+        if (s < K) lo = s + 1;
+        else hi = s - 1;
+    }
+}
@@ -0,0 +1,29 @@
+// Converts a KNN data set to the binary format of data.c, which knn maps
+// instead of parsing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "knn.h"
+
+int main(int argc, char *argv[])
+{
+    int opt, single = 0;
+    while ((opt = getopt(argc, argv, "f")) != -1) {
+        if (opt == 'f') single = 1;
+        else argc = 0;
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "usage: [-f] <data file> <binary file>\n"
+                "  -f: store the coordinates as float (default double)\n");
+        return 1;
+    }
+
+    struct dataset d;
+    load_data(argv[optind], &d);
+    save_binary(argv[optind + 1], &d, single);
+    printf("%s: %d rows, %d coordinates, %s\n", argv[optind + 1], d.rows,
+           d.columns, single ? "float" : "double");
+    free_data(&d);
+    return 0;
+}
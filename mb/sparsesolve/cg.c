@@ -86,3 +86,116 @@ void conjugate_gradient(int n, struct matrix *A, struct matrix *M, FLOAT *b, FLO
     FREE(z);
     FREE(tr);
 }
+
+// Block version solving for k right-hand sides at once. b and x are n x k
+// row major blocks, so every product with A streams the matrix once for all
+// columns. Each column runs its own CG recurrence and is masked out (zero
+// step, no further updates) as soon as it converges or stalls.
+
+void block_conjugate_gradient(int n, int k, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter)
+{
+    int iter = 0;
+    FLOAT2 *alpha = ALLOC(FLOAT2, k);
+    FLOAT2 *beta = ALLOC(FLOAT2, k);
+    FLOAT2 *rho = ALLOC(FLOAT2, k);
+    FLOAT2 *tau = ALLOC(FLOAT2, k);
+    FLOAT2 *tol = ALLOC(FLOAT2, k);
+    FLOAT2 *residual = ALLOC(FLOAT2, k);
+    bool *active = ALLOC(bool, k);
+
+    FLOAT *r = ALLOC(FLOAT, n * k);
+    FLOAT *p = ALLOC(FLOAT, n * k);
+    FLOAT *z = ALLOC(FLOAT, n * k);
+
+    FLOAT *tr = ALLOC(FLOAT, n * k);
+
+    floatm_mmult(A, k, x, r);
+    floatm_xpby(n * k, b, -1.0, r); // r = b - Ax
+
+    if (M) {
+        floatm_mmult(M, k, r, p);
+        floatm_block_dot(n, k, r, p, rho);
+        floatm_block_norm2(n, k, r, tol);
+    } else {
+        floatm_copy(n * k, r, p);
+        floatm_block_dot(n, k, r, r, rho);
+        for (int c = 0; c < k; c++) tol[c] = sqrt(rho[c]);
+    }
+
+    int nactive = 0;
+    for (int c = 0; c < k; c++) {
+        active[c] = tol[c] > umbral;
+        if (active[c]) nactive++;
+    }
+
+    int step = 0;
+
+    while ((iter < maxiter) && (nactive > 0)) {
+        floatm_mmult(A, k, p, z);
+        // compute true residual
+        if (step < step_check) step++;
+        else {
+            floatm_mmult(A, k, x, tr);
+            floatm_xpby(n * k, b, -1.0, tr);
+            floatm_block_norm2(n, k, tr, residual);
+            for (int c = 0; c < k; c++) {
+                if (!active[c]) continue;
+                printf("# rescheck: %d %d %e %e %d\n", *in_iter, iter, (double)tol[c], (double)residual[c], c);
+                if (residual[c] / tol[c] > 10) {
+                    active[c] = false;
+                    nactive--;
+                }
+            }
+            if (nactive == 0) break;
+            step = 1;
+        }
+
+        // alpha = (r,z) / (Ap,p), zero for masked columns
+        floatm_block_dot(n, k, z, p, alpha);
+        for (int c = 0; c < k; c++) alpha[c] = active[c] ? rho[c] / alpha[c] : 0.0;
+        // x = x + alpha * p
+        floatm_block_axpy(n, k, alpha, p, x);
+        // r = r - alpha * Ap
+        for (int c = 0; c < k; c++) alpha[c] = -alpha[c];
+        floatm_block_axpy(n, k, alpha, z, r);
+        // apply preconditioner
+        if (M) {
+            floatm_mmult(M, k, r, z);
+            floatm_block_dot(n, k, r, z, tau);
+            floatm_block_norm2(n, k, r, tol);
+        } else {
+            floatm_block_dot(n, k, r, r, tau);
+            for (int c = 0; c < k; c++) tol[c] = sqrt(tau[c]);
+        }
+        // beta = (r,z) / rho
+        for (int c = 0; c < k; c++) {
+            if (!active[c]) {
+                beta[c] = 0.0;
+                continue;
+            }
+            beta[c] = tau[c] / rho[c];
+            rho[c] = tau[c];
+            if (tol[c] <= umbral) {
+                active[c] = false;
+                nactive--;
+            }
+        }
+        // p = z + beta * p
+        if (M) floatm_block_xpby(n, k, z, beta, p);
+        else floatm_block_xpby(n, k, r, beta, p);
+        iter++;
+        (*in_iter)++;
+    }
+
+    FREE(alpha);
+    FREE(beta);
+    FREE(rho);
+    FREE(tau);
+    FREE(tol);
+    FREE(residual);
+    free(active);
+    FREE(r);
+    FREE(p);
+    FREE(z);
+    FREE(tr);
+}
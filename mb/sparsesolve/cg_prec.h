@@ -0,0 +1,108 @@
+// Conjugate gradient template, included by precision.c once per precision
+// with the following macros defined:
+//   SUFFIX          suffix of the generated function names
+//   REAL            type of the vectors, FLOAT or DOUBLE
+//   ACC             accumulation type of the dot products
+//   ROUND(x)        rounding of a stored value to the emulated format
+//   MULT(A, x, y)   product with the matrix
+//   PRECOND(M, x, y, w) application of the preconditioner, w scratch
+//   PRECOND_WORK    FLOAT scratch entries per row needed by PRECOND
+
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+#define FN(name) CAT(name, SUFFIX)
+
+static inline ACC FN(dot_)(int n, REAL *x, REAL *y) {
+    ACC r = 0.0;
+    for (int i = 0; i < n; i++) r += (ACC)y[i] * x[i];
+    return r;
+}
+
+static inline void FN(round_vector_)(int n, REAL *x) {
+    for (int i = 0; i < n; i++) x[i] = ROUND(x[i]);
+}
+
+static inline void FN(axpy_)(int n, REAL a, REAL *x, REAL *y) {
+    for (int i = 0; i < n; i++) y[i] = ROUND(y[i] + x[i] * a);
+}
+
+static inline void FN(xpby_)(int n, REAL *x, REAL b, REAL *y) {
+    for (int i = 0; i < n; i++) y[i] = ROUND(x[i] + b * y[i]);
+}
+
+static void FN(conjugate_gradient_)(int n, struct matrix *A, struct matrix *M, REAL *b, REAL *x, int maxiter, REAL umbral, int step_check, int *in_iter)
+{
+    int iter = 0;
+    ACC alpha, beta, rho, tau, tol;
+
+    REAL *r = ALLOC(REAL, n);
+    REAL *p = ALLOC(REAL, n);
+    REAL *z = ALLOC(REAL, n);
+
+    REAL *tr = ALLOC(REAL, n);
+
+    FLOAT *w = (M && PRECOND_WORK) ? ALLOC(FLOAT, PRECOND_WORK * n) : NULL;
+
+    MULT(A, x, r);
+    FN(xpby_)(n, b, -1.0, r); // r = b - Ax
+
+    if (M) {
+        PRECOND(M, r, p, w);
+        FN(round_vector_)(n, p);
+        rho = FN(dot_)(n, r, p);
+        tol = sqrt(FN(dot_)(n, r, r));
+    } else {
+        for (int i = 0; i < n; i++) p[i] = r[i];
+        rho = FN(dot_)(n, r, r);
+        tol = sqrt(rho);
+    }
+
+    int step = 0;
+    ACC residual = tol;
+
+    while ((iter < maxiter) && (tol > umbral)) {
+        MULT(A, p, z);
+        FN(round_vector_)(n, z);
+        // compute true residual
+        if (step < step_check) step++;
+        else {
+            MULT(A, x, tr);
+            FN(xpby_)(n, b, -1.0, tr);
+            residual = sqrt(FN(dot_)(n, tr, tr));
+            printf("# rescheck: %d %d %e %e\n", *in_iter, iter, (double)tol, (double)residual);
+            if (residual / tol > 10) break;
+            step = 1;
+        }
+
+        alpha = rho / FN(dot_)(n, z, p);
+        FN(axpy_)(n, alpha, p, x);
+        FN(axpy_)(n, -alpha, z, r);
+        if (M) {
+            PRECOND(M, r, z, w);
+            FN(round_vector_)(n, z);
+            tau = FN(dot_)(n, r, z);
+            tol = sqrt(FN(dot_)(n, r, r));
+        } else {
+            tau = FN(dot_)(n, r, r);
+            tol = sqrt(tau);
+        }
+        beta = tau / rho;
+        rho = tau;
+        if (M) FN(xpby_)(n, z, beta, p);
+        else FN(xpby_)(n, r, beta, p);
+        iter++;
+        (*in_iter)++;
+    }
+
+    FREE(r);
+    FREE(p);
+    FREE(z);
+    FREE(tr);
+    if (w) {
+        FREE(w);
+    }
+}
+
+#undef FN
+#undef CAT
+#undef CAT_
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <tgmath.h>
+#include <float.h>
+#include <stdbool.h>
+
+#include "cg.h"
+#include "vector.h"
+#include "matrix.h"
+
+// Krylov inner solvers for non-symmetric matrices. Like conjugate_gradient
+// they work on FLOAT vectors with FLOAT2 dot products, and apply M as a
+// right preconditioner.
+
+int gmres_restart = 30;
+
+// x += Z y, y the least squares solution of the first j columns of H
+
+static void gmres_update(int n, int m, int j, FLOAT2 *H, FLOAT2 *g, FLOAT2 *y, FLOAT *Z, FLOAT *x)
+{
+    for (int i = j - 1; i >= 0; i--) {
+        FLOAT2 t = g[i];
+        for (int l = i + 1; l < j; l++) t -= H[i + l * (m + 1)] * y[l];
+        y[i] = t / H[i + i * (m + 1)];
+    }
+    for (int i = 0; i < j; i++) floatm_axpy(n, y[i], Z + i * n, x);
+}
+
+// restarted GMRES(m) with modified Gram-Schmidt and Givens rotations, the
+// true residual is recomputed (and reported) at every restart and every
+// step_check iterations within a cycle, and the solve stops like
+// conjugate_gradient once it drifts from the estimated one
+
+void gmres(int n, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter)
+{
+    int m = gmres_restart;
+    int iter = 0;
+
+    FLOAT *V = ALLOC(FLOAT, n * (m + 1));
+    FLOAT *Z = M ? ALLOC(FLOAT, n * m) : V;
+    FLOAT *w = ALLOC(FLOAT, n);
+    FLOAT2 *H = ALLOC(FLOAT2, (m + 1) * m); // column major, H[i + j * (m + 1)]
+    FLOAT2 *cs = ALLOC(FLOAT2, m);
+    FLOAT2 *sn = ALLOC(FLOAT2, m);
+    FLOAT2 *g = ALLOC(FLOAT2, m + 1);
+    FLOAT2 *y = ALLOC(FLOAT2, m);
+
+    FLOAT *xt = ALLOC(FLOAT, n);
+    FLOAT *tr = ALLOC(FLOAT, n);
+
+    int step = 0;
+    bool stagnation = false;
+    FLOAT2 tol = 0.0;
+    while (true) {
+        // r = b - Ax
+        floatm_mult(A, x, V);
+        floatm_xpby(n, b, -1.0, V);
+        FLOAT2 beta = floatm_norm2(n, V);
+        if (iter > 0) {
+            printf("# rescheck: %d %d %e %e\n", *in_iter, iter, (double)tol, (double)beta);
+            // the recurrence has drifted away from the true residual, stagnation
+            if (beta / tol > 10) break;
+        }
+        tol = beta;
+        if ((tol <= umbral) || (iter >= maxiter) || (beta == 0.0)) break;
+
+        floatm_scal(n, 1.0 / beta, V);
+        g[0] = beta;
+        step = 0;
+
+        int j = 0;
+        while ((j < m) && (iter < maxiter) && (tol > umbral)) {
+            // compute true residual of the iterate so far in this cycle
+            if (step < step_check) step++;
+            else {
+                floatm_copy(n, x, xt);
+                gmres_update(n, m, j, H, g, y, Z, xt);
+                floatm_mult(A, xt, tr);
+                floatm_xpby(n, b, -1.0, tr);
+                FLOAT2 residual = floatm_norm2(n, tr);
+                printf("# rescheck: %d %d %e %e\n", *in_iter, iter, (double)tol, (double)residual);
+                if (residual / tol > 10) {
+                    stagnation = true;
+                    break;
+                }
+                step = 1;
+            }
+            FLOAT *vj = V + j * n;
+            FLOAT *zj = Z + j * n;
+            if (M) floatm_mult(M, vj, zj);
+            floatm_mult(A, zj, w);
+            FLOAT2 *h = H + j * (m + 1);
+            for (int i = 0; i <= j; i++) {
+                h[i] = floatm_dot(n, w, V + i * n);
+                floatm_axpy(n, -h[i], V + i * n, w);
+            }
+            h[j + 1] = floatm_norm2(n, w);
+            bool breakdown = h[j + 1] == 0.0;
+            if (!breakdown) {
+                floatm_copy(n, w, V + (j + 1) * n);
+                floatm_scal(n, 1.0 / h[j + 1], V + (j + 1) * n);
+            }
+            // apply the previous rotations and eliminate h[j + 1]
+            for (int i = 0; i < j; i++) {
+                FLOAT2 t = cs[i] * h[i] + sn[i] * h[i + 1];
+                h[i + 1] = -sn[i] * h[i] + cs[i] * h[i + 1];
+                h[i] = t;
+            }
+            FLOAT2 r = sqrt(h[j] * h[j] + h[j + 1] * h[j + 1]);
+            cs[j] = h[j] / r;
+            sn[j] = h[j + 1] / r;
+            h[j] = r;
+            h[j + 1] = 0.0;
+            g[j + 1] = -sn[j] * g[j];
+            g[j] = cs[j] * g[j];
+            tol = fabs(g[j + 1]);
+            j++;
+            iter++;
+            (*in_iter)++;
+            if (breakdown) break;
+        }
+
+        // solve the triangular system and update x with the preconditioned basis
+        gmres_update(n, m, j, H, g, y, Z, x);
+        if (stagnation) break;
+    }
+
+    FREE(V);
+    if (M) {
+        FREE(Z);
+    }
+    FREE(w);
+    FREE(H);
+    FREE(cs);
+    FREE(sn);
+    FREE(g);
+    FREE(y);
+    FREE(xt);
+    FREE(tr);
+}
+
+// BiCGStab, the true residual is checked every step_check iterations as in
+// conjugate_gradient
+
+void bicgstab(int n, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter)
+{
+    int iter = 0;
+    FLOAT2 alpha = 1.0, omega = 1.0, rho = 1.0, rho_new, beta, tol, residual;
+
+    FLOAT *r = ALLOC(FLOAT, n);
+    FLOAT *rh = ALLOC(FLOAT, n);
+    FLOAT *p = ALLOC(FLOAT, n);
+    FLOAT *v = ALLOC(FLOAT, n);
+    FLOAT *s = ALLOC(FLOAT, n);
+    FLOAT *t = ALLOC(FLOAT, n);
+    FLOAT *ph = M ? ALLOC(FLOAT, n) : p;
+    FLOAT *sh = M ? ALLOC(FLOAT, n) : s;
+
+    FLOAT *tr = ALLOC(FLOAT, n);
+
+    floatm_mult(A, x, r);
+    floatm_xpby(n, b, -1.0, r); // r = b - Ax
+    floatm_copy(n, r, rh);
+    floatm_set(n, 0.0, p);
+    floatm_set(n, 0.0, v);
+    tol = floatm_norm2(n, r);
+
+    int step = 0;
+
+    while ((iter < maxiter) && (tol > umbral)) {
+        // compute true residual
+        if (step < step_check) step++;
+        else {
+            floatm_mult(A, x, tr);
+            floatm_xpby(n, b, -1.0, tr);
+            residual = floatm_norm2(n, tr);
+            printf("# rescheck: %d %d %e %e\n", *in_iter, iter, (double)tol, (double)residual);
+            if (residual / tol > 10) break;
+            step = 1;
+        }
+
+        rho_new = floatm_dot(n, rh, r);
+        if (rho_new == 0.0) break;
+        beta = (rho_new / rho) * (alpha / omega);
+        rho = rho_new;
+        // p = r + beta * (p - omega * v)
+        floatm_axpy(n, -omega, v, p);
+        floatm_xpby(n, r, beta, p);
+        if (M) floatm_mult(M, p, ph);
+        floatm_mult(A, ph, v);
+        alpha = rho / floatm_dot(n, rh, v);
+        // s = r - alpha * v
+        floatm_copy(n, r, s);
+        floatm_axpy(n, -alpha, v, s);
+        if (floatm_norm2(n, s) <= umbral) {
+            floatm_axpy(n, alpha, ph, x);
+            tol = floatm_norm2(n, s);
+            iter++;
+            (*in_iter)++;
+            break;
+        }
+        if (M) floatm_mult(M, s, sh);
+        floatm_mult(A, sh, t);
+        omega = floatm_dot(n, t, s) / floatm_dot(n, t, t);
+        // x = x + alpha * ph + omega * sh
+        floatm_axpy(n, alpha, ph, x);
+        floatm_axpy(n, omega, sh, x);
+        // r = s - omega * t
+        floatm_copy(n, s, r);
+        floatm_axpy(n, -omega, t, r);
+        tol = floatm_norm2(n, r);
+        iter++;
+        (*in_iter)++;
+        if (omega == 0.0) break;
+    }
+
+    FREE(r);
+    FREE(rh);
+    FREE(p);
+    FREE(v);
+    FREE(s);
+    FREE(t);
+    if (M) {
+        FREE(ph);
+        FREE(sh);
+    }
+    FREE(tr);
+}
@@ -9,9 +9,9 @@
 #include "vector.h"
 #include "matrix.h"
 
-void conjugate_gradient(int n, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter);
+// solve is the low precision inner solver, e.g. conjugate_gradient or gmres
 
-void iterative_refinement(int n, struct matrix *A, struct matrix *M, DOUBLE *b, DOUBLE *x,
+void iterative_refinement(inner_solver solve, int n, struct matrix *A, struct matrix *M, DOUBLE *b, DOUBLE *x,
         int out_maxiter, DOUBLE out_tol, int in_maxiter, DOUBLE in_tol, int step_check,
         int *out_iter, int *in_iter)
 {
@@ -25,7 +25,7 @@ void iterative_refinement(int n, struct matrix *A, struct matrix *M, DOUBLE *b,
 
     DOUBLE residual;
     do {
-        conjugate_gradient(n, A, M, r, d, in_maxiter, in_tol, step_check, in_iter);
+        solve(n, A, M, r, d, in_maxiter, in_tol, step_check, in_iter);
 
         mixed_axpy(n, 1.0, d, x); // x = x + d
         matrix_mult(A, x, e);
@@ -44,3 +44,49 @@ void iterative_refinement(int n, struct matrix *A, struct matrix *M, DOUBLE *b,
     FREE(r);
     FREE(d);
 }
+
+void block_conjugate_gradient(int n, int k, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter);
+
+// Block version for k right-hand sides stored as n x k row major blocks.
+// Columns that reach out_tol get a zero right-hand side for the following
+// inner solves, which masks them out of the block CG.
+
+void block_iterative_refinement(int n, int k, struct matrix *A, struct matrix *M, DOUBLE *b, DOUBLE *x,
+        int out_maxiter, DOUBLE out_tol, int in_maxiter, DOUBLE in_tol, int step_check,
+        int *out_iter, int *in_iter)
+{
+    DOUBLE *e = ALLOC(DOUBLE, n * k);
+    FLOAT *r = ALLOC(FLOAT, n * k);
+    FLOAT *d = ALLOC(FLOAT, n * k);
+    DOUBLE *residual = ALLOC(DOUBLE, k);
+
+    mixed_copy(n * k, x, d);
+    vector_set(n * k, 0.0, x);
+    mixed_copy(n * k, b, r);
+
+    int nactive;
+    do {
+        block_conjugate_gradient(n, k, A, M, r, d, in_maxiter, in_tol, step_check, in_iter);
+
+        mixed_axpy(n * k, 1.0, d, x); // x = x + d
+        matrix_mmult(A, k, x, e);
+        vector_xpby(n * k, b, -1.0, e); // r = b - Ax
+        vector_block_norm2(n, k, e, residual);
+
+        nactive = 0;
+        for (int c = 0; c < k; c++) {
+            if (residual[c] > out_tol) nactive++;
+            else for (int i = 0; i < n; i++) e[i * k + c] = 0.0;
+        }
+
+        mixed_copy(n * k, e, r);
+        floatm_set(n * k, 0.0, d);
+
+        (*out_iter)++;
+    } while ((nactive > 0) && (*out_iter < out_maxiter));
+
+    FREE(e);
+    FREE(r);
+    FREE(d);
+    FREE(residual);
+}
@@ -9,6 +9,7 @@
 #include <tgmath.h> // interferes with mmio.h
 
 #include "cg.h"
+#include "vector.h"
 #include "matrix.h"
 
 static int compar(const void *pa, const void *pb)
@@ -73,34 +74,23 @@ void coo_load(const char *fname, int *n, int *nz, struct matrix_coo **a)
     *n = N; *nz = k; *a = coo;
 }
 
-double coo_norm_inf(int n, int nz, struct matrix_coo *coo)
+double csr_norm_inf(int n, int *ia, double *a)
 {
-    double *amax = CALLOC(double, n);
-    for (int i = 0; i < nz; i++) {
-        int row = coo[i].i;
-        int val = coo[i].a;
-        amax[row] += abs(val);
-    }
     double norm = 0.0;
     for (int i = 0; i < n; i++) {
-        if (amax[i] > norm) norm = amax[i];
+        double t = 0.0;
+        for (int l = ia[i]; l < ia[i + 1]; l++) t += fabs(a[l]);
+        if (t > norm) norm = t;
     }
-    FREE(amax);
     return norm;
 }
 
-double coo_max_nz(int n, int nz, struct matrix_coo *coo)
+double csr_max_nz(int n, int *ia)
 {
-    double *m = CALLOC(double, n);
-    for (int i = 0; i < nz; i++) {
-        int row = coo[i].i;
-        m[row]++;
-    }
-    int r = 0.0;
+    int r = 0;
     for (int i = 0; i < n; i++) {
-        if (m[i] > r) r = m[i];
+        if (ia[i + 1] - ia[i] > r) r = ia[i + 1] - ia[i];
     }
-    FREE(m);
     return r;
 }
 
@@ -128,22 +118,75 @@ void csr_smult(struct matrix_csr *mat, FLOAT *x, FLOAT *y)
     }
 }
 
-struct matrix *csr_create(int n, int nz, struct matrix_coo *coo)
+// block product: the matrix is streamed once for all k columns. The kernels
+// are instantiated for common block widths so that the column loops unroll.
+
+static inline __attribute__((always_inline))
+void csr_dmmult_kernel(struct matrix_csr *mat, const int k, DOUBLE *x, DOUBLE *y)
+{
+    int n = mat->super.n, *i = mat->i, *j = mat->j;
+    DOUBLE *A = mat->A;
+    for (int r = 0; r < n; r++) {
+        DOUBLE t[k];
+        for (int c = 0; c < k; c++) t[c] = 0.0;
+        for (int l = i[r]; l < i[r + 1]; l++) {
+            DOUBLE a = A[l];
+            DOUBLE *xr = x + j[l] * k;
+            for (int c = 0; c < k; c++) t[c] += a * xr[c];
+        }
+        for (int c = 0; c < k; c++) y[r * k + c] = t[c];
+    }
+}
+
+static inline __attribute__((always_inline))
+void csr_smmult_kernel(struct matrix_csr *mat, const int k, FLOAT *x, FLOAT *y)
+{
+    int n = mat->super.n, *i = mat->i, *j = mat->j;
+    DOUBLE *A = mat->A;
+    for (int r = 0; r < n; r++) {
+        FLOAT2 t[k];
+        for (int c = 0; c < k; c++) t[c] = 0.0;
+        for (int l = i[r]; l < i[r + 1]; l++) {
+            FLOAT2 a = A[l];
+            FLOAT *xr = x + j[l] * k;
+            for (int c = 0; c < k; c++) t[c] += a * xr[c];
+        }
+        for (int c = 0; c < k; c++) y[r * k + c] = t[c];
+    }
+}
+
+void csr_dmmult(struct matrix_csr *mat, int k, DOUBLE *x, DOUBLE *y)
+{
+    switch (k) {
+        case 1: csr_dmmult_kernel(mat, 1, x, y); break;
+        case 2: csr_dmmult_kernel(mat, 2, x, y); break;
+        case 4: csr_dmmult_kernel(mat, 4, x, y); break;
+        case 8: csr_dmmult_kernel(mat, 8, x, y); break;
+        default: csr_dmmult_kernel(mat, k, x, y);
+    }
+}
+
+void csr_smmult(struct matrix_csr *mat, int k, FLOAT *x, FLOAT *y)
+{
+    switch (k) {
+        case 1: csr_smmult_kernel(mat, 1, x, y); break;
+        case 2: csr_smmult_kernel(mat, 2, x, y); break;
+        case 4: csr_smmult_kernel(mat, 4, x, y); break;
+        case 8: csr_smmult_kernel(mat, 8, x, y); break;
+        default: csr_smmult_kernel(mat, k, x, y);
+    }
+}
+
+struct matrix *csr_create(int n, int *ia, int *ja, double *a)
 {
+    int nz = ia[n];
     int *i = ALLOC(int, n + 1);
     int *j = ALLOC(int, nz);
     DOUBLE *A = ALLOC(DOUBLE, nz);
 
-    i[0] = 0;
-    int l = 0;
-    for (int k = 0; k < n; k++) {
-        while (l < nz && coo[l].i == k) {
-            j[l] = coo[l].j;
-            A[l] = coo[l].a;
-            l++;
-        }
-        i[k + 1] = l;
-    }
+    memcpy(i, ia, (n + 1) * sizeof(int));
+    memcpy(j, ja, nz * sizeof(int));
+    for (int l = 0; l < nz; l++) A[l] = a[l];
 
     struct matrix_csr *mat = ALLOC(struct matrix_csr, 1);
     mat->super.n = n;
@@ -152,6 +195,8 @@ struct matrix *csr_create(int n, int nz, struct matrix_coo *coo)
     mat->A = A;
     mat->super.dmult = (void (*)(struct matrix *, DOUBLE *, DOUBLE *))csr_dmult;
     mat->super.smult = (void (*)(struct matrix *, FLOAT *, FLOAT *))csr_smult;
+    mat->super.dmmult = (void (*)(struct matrix *, int, DOUBLE *, DOUBLE *))csr_dmmult;
+    mat->super.smmult = (void (*)(struct matrix *, int, FLOAT *, FLOAT *))csr_smmult;
     return (struct matrix *)mat;
 }
 
@@ -179,17 +224,45 @@ void dense_smult(uint8_t m, struct matrix_dense *mat, FLOAT *x, FLOAT *y)
     }
 }
 
-struct matrix *dense_create(int n, int nz, struct matrix_coo *coo)
+void dense_dmmult(struct matrix_dense *mat, int k, DOUBLE *x, DOUBLE *y)
+{
+    int n = mat->super.n;
+    for (int i = 0; i < n * k; i++) y[i] = 0.0;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++) {
+            DOUBLE a = mat->A[i * n + j];
+            for (int c = 0; c < k; c++) y[i * k + c] += a * x[j * k + c];
+        }
+}
+
+void dense_smmult(struct matrix_dense *mat, int k, FLOAT *x, FLOAT *y)
+{
+    int n = mat->super.n;
+    FLOAT2 t[k];
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < k; c++) t[c] = 0.0;
+        for (int j = 0; j < n; j++) {
+            FLOAT2 a = mat->A[i * n + j];
+            for (int c = 0; c < k; c++) t[c] += a * x[j * k + c];
+        }
+        for (int c = 0; c < k; c++) y[i * k + c] = t[c];
+    }
+}
+
+struct matrix *dense_create(int n, int *ia, int *ja, double *a)
 {
     DOUBLE *A = CALLOC(DOUBLE, n * n);
 
     // row major format
-    for (int k = 0; k < nz; k++) A[coo[k].i * n + coo[k].j] = coo[k].a;
+    for (int i = 0; i < n; i++)
+        for (int l = ia[i]; l < ia[i + 1]; l++) A[i * n + ja[l]] = a[l];
 
     struct matrix_dense *mat = ALLOC(struct matrix_dense, 1);
     mat->super.n = n;
     mat->super.dmult = (void (*)(struct matrix *, DOUBLE *, DOUBLE *))dense_dmult;
     mat->super.smult = (void (*)(struct matrix *, FLOAT *, FLOAT *))dense_smult;
+    mat->super.dmmult = (void (*)(struct matrix *, int, DOUBLE *, DOUBLE *))dense_dmmult;
+    mat->super.smmult = (void (*)(struct matrix *, int, FLOAT *, FLOAT *))dense_smmult;
     mat->A = A;
     return (struct matrix *)mat;
 }
@@ -205,18 +278,332 @@ void jacobi_smult(struct precond_jacobi *pre, FLOAT *x, FLOAT *y)
     }
 }
 
-struct matrix *jacobi_create(int n, int nz, struct matrix_coo *coo)
+void jacobi_smmult(struct precond_jacobi *pre, int k, FLOAT *x, FLOAT *y)
+{
+    for (int r = 0; r < pre->super.n; r++) {
+        for (int c = 0; c < k; c++) y[r * k + c] = x[r * k + c] / pre->d[r];
+    }
+}
+
+struct matrix *jacobi_create(int n, int *ia, int *ja, double *a)
 {
     FLOAT *d = ALLOC(FLOAT, n);
     for (int k = 0; k < n; k++) d[k] = 0.0;
-    for (int k = 0; k < nz; k++)
-        if (coo[k].i == coo[k].j)
-            d[coo[k].i] = coo[k].a;
+    for (int i = 0; i < n; i++)
+        for (int l = ia[i]; l < ia[i + 1]; l++)
+            if (ja[l] == i)
+                d[i] = a[l];
 
     struct precond_jacobi *pre = ALLOC(struct precond_jacobi, 1);
     pre->super.n = n;
     pre->super.dmult = NULL;
     pre->super.smult = (void (*)(struct matrix *, FLOAT *, FLOAT *))jacobi_smult;
+    pre->super.dmmult = NULL;
+    pre->super.smmult = (void (*)(struct matrix *, int, FLOAT *, FLOAT *))jacobi_smmult;
     pre->d = d;
     return (struct matrix *)pre;
 }
+
+// Level scheduling for sparse triangular solves: rows are grouped into levels
+// such that the rows of one level only depend on rows of earlier levels and
+// can be solved in parallel. ia/ja hold the off-diagonal part of a lower
+// (backward = 0) or upper (backward = 1) triangular CSR matrix.
+
+struct levels { int n; int *ptr; int *rows; };
+
+static void levels_create(int n, int *ia, int *ja, int backward, struct levels *lev)
+{
+    int *level = ALLOC(int, n);
+    int nlev = 0;
+    for (int q = 0; q < n; q++) {
+        int i = backward ? n - 1 - q : q;
+        int m = 0;
+        for (int l = ia[i]; l < ia[i + 1]; l++)
+            if (level[ja[l]] + 1 > m) m = level[ja[l]] + 1;
+        level[i] = m;
+        if (m + 1 > nlev) nlev = m + 1;
+    }
+
+    // counting sort of the rows by level
+    int *ptr = CALLOC(int, nlev + 1);
+    int *rows = ALLOC(int, n);
+    for (int i = 0; i < n; i++) ptr[level[i] + 1]++;
+    for (int l = 0; l < nlev; l++) ptr[l + 1] += ptr[l];
+    for (int i = 0; i < n; i++) rows[ptr[level[i]]++] = i;
+    for (int l = nlev; l > 0; l--) ptr[l] = ptr[l - 1];
+    ptr[0] = 0;
+
+    free(level);
+    lev->n = nlev;
+    lev->ptr = ptr;
+    lev->rows = rows;
+}
+
+// Incomplete Cholesky IC(0) preconditioner: A ~ L L^T with L restricted to
+// the pattern of the lower triangle of A. L (strictly lower) and U = L^T
+// (strictly upper) are both kept in CSR so that the two solves run row wise.
+
+struct precond_ic0 {
+    struct matrix super;
+    int *li; int *lj; FLOAT *l;
+    int *ui; int *uj; FLOAT *u;
+    FLOAT *d;
+    struct levels lower, upper;
+};
+
+void ic0_smmult(struct precond_ic0 *pre, int k, FLOAT *x, FLOAT *y)
+{
+    #pragma omp parallel
+    {
+        // forward solve L y = x
+        for (int lev = 0; lev < pre->lower.n; lev++) {
+            #pragma omp for
+            for (int q = pre->lower.ptr[lev]; q < pre->lower.ptr[lev + 1]; q++) {
+                int i = pre->lower.rows[q];
+                FLOAT2 t[k];
+                for (int c = 0; c < k; c++) t[c] = x[i * k + c];
+                for (int l = pre->li[i]; l < pre->li[i + 1]; l++) {
+                    FLOAT2 a = pre->l[l];
+                    FLOAT *yr = y + pre->lj[l] * k;
+                    for (int c = 0; c < k; c++) t[c] -= a * yr[c];
+                }
+                for (int c = 0; c < k; c++) y[i * k + c] = t[c] / pre->d[i];
+            }
+        }
+        // backward solve L^T y = y, in place
+        for (int lev = 0; lev < pre->upper.n; lev++) {
+            #pragma omp for
+            for (int q = pre->upper.ptr[lev]; q < pre->upper.ptr[lev + 1]; q++) {
+                int i = pre->upper.rows[q];
+                FLOAT2 t[k];
+                for (int c = 0; c < k; c++) t[c] = y[i * k + c];
+                for (int l = pre->ui[i]; l < pre->ui[i + 1]; l++) {
+                    FLOAT2 a = pre->u[l];
+                    FLOAT *yr = y + pre->uj[l] * k;
+                    for (int c = 0; c < k; c++) t[c] -= a * yr[c];
+                }
+                for (int c = 0; c < k; c++) y[i * k + c] = t[c] / pre->d[i];
+            }
+        }
+    }
+}
+
+void ic0_smult(struct precond_ic0 *pre, FLOAT *x, FLOAT *y)
+{
+    ic0_smmult(pre, 1, x, y);
+}
+
+struct matrix *ic0_create(int n, int *ia, int *ja, double *aa)
+{
+    // strictly lower part of A, the rows are sorted by column
+    int *li = CALLOC(int, n + 1);
+    for (int i = 0; i < n; i++)
+        for (int k = ia[i]; k < ia[i + 1]; k++)
+            if (ja[k] < i) li[i + 1]++;
+    for (int i = 0; i < n; i++) li[i + 1] += li[i];
+    int *lj = ALLOC(int, li[n]);
+    double *l = ALLOC(double, li[n]);
+    double *a = CALLOC(double, n);
+    double *d = ALLOC(double, n);
+    for (int i = 0, m = 0; i < n; i++) {
+        for (int k = ia[i]; k < ia[i + 1]; k++) {
+            if (ja[k] < i) {
+                lj[m] = ja[k];
+                l[m] = aa[k];
+                m++;
+            } else if (ja[k] == i) a[i] = aa[k];
+        }
+    }
+
+    // row oriented factorization, pos maps the columns of row i to entries
+    int *pos = ALLOC(int, n);
+    for (int i = 0; i < n; i++) pos[i] = -1;
+    int breakdowns = 0;
+    for (int i = 0; i < n; i++) {
+        for (int m = li[i]; m < li[i + 1]; m++) pos[lj[m]] = m;
+        double s = a[i];
+        for (int m = li[i]; m < li[i + 1]; m++) {
+            int k = lj[m];
+            double t = l[m];
+            for (int q = li[k]; q < li[k + 1]; q++)
+                if (pos[lj[q]] >= 0) t -= l[pos[lj[q]]] * l[q];
+            l[m] = t / d[k];
+            s -= l[m] * l[m];
+        }
+        if (s <= 0.0) { // not positive, fall back to the diagonal of A
+            s = fabs(a[i]) > 0.0 ? fabs(a[i]) : 1.0;
+            breakdowns++;
+        }
+        d[i] = sqrt(s);
+        for (int m = li[i]; m < li[i + 1]; m++) pos[lj[m]] = -1;
+    }
+    if (breakdowns)
+        fprintf(stderr, "Warning: IC(0) replaced %d non-positive pivots\n", breakdowns);
+
+    // transpose into U = L^T
+    int *ui = CALLOC(int, n + 1);
+    for (int m = 0; m < li[n]; m++) ui[lj[m] + 1]++;
+    for (int i = 0; i < n; i++) ui[i + 1] += ui[i];
+    int *uj = ALLOC(int, li[n]);
+    FLOAT *u = ALLOC(FLOAT, li[n]);
+    for (int i = 0; i < n; i++) pos[i] = ui[i];
+    for (int i = 0; i < n; i++) {
+        for (int m = li[i]; m < li[i + 1]; m++) {
+            int q = pos[lj[m]]++;
+            uj[q] = i;
+            u[q] = l[m];
+        }
+    }
+
+    struct precond_ic0 *pre = ALLOC(struct precond_ic0, 1);
+    pre->super.n = n;
+    pre->super.dmult = NULL;
+    pre->super.smult = (void (*)(struct matrix *, FLOAT *, FLOAT *))ic0_smult;
+    pre->super.dmmult = NULL;
+    pre->super.smmult = (void (*)(struct matrix *, int, FLOAT *, FLOAT *))ic0_smmult;
+    pre->li = li;
+    pre->lj = lj;
+    pre->l = ALLOC(FLOAT, li[n]);
+    for (int m = 0; m < li[n]; m++) pre->l[m] = l[m];
+    pre->ui = ui;
+    pre->uj = uj;
+    pre->u = u;
+    pre->d = ALLOC(FLOAT, n);
+    for (int i = 0; i < n; i++) pre->d[i] = d[i];
+    levels_create(n, li, lj, 0, &pre->lower);
+    levels_create(n, ui, uj, 1, &pre->upper);
+
+    free(pos);
+    free(l);
+    free(a);
+    free(d);
+    return (struct matrix *)pre;
+}
+
+int ic0_levels(struct matrix *M)
+{
+    return ((struct precond_ic0 *)M)->lower.n;
+}
+
+// Polynomial preconditioners: a fixed number of Jacobi preconditioned
+// Chebyshev or Richardson (truncated Neumann series) steps on A z = r from
+// z = 0. Both are polynomials in D^-1 A and only need products with A. The
+// largest eigenvalue of D^-1 A is estimated with a few power iterations.
+
+struct precond_poly {
+    struct matrix super;
+    struct matrix *A;
+    int kind; int degree;
+    FLOAT *dinv;
+    DOUBLE lmin, lmax;
+    int wk; FLOAT *w, *res, *dir;
+};
+
+static void poly_work(struct precond_poly *pre, int k)
+{
+    if (k <= pre->wk) return;
+    free(pre->w);
+    free(pre->res);
+    free(pre->dir);
+    pre->w = ALLOC(FLOAT, pre->super.n * k);
+    pre->res = ALLOC(FLOAT, pre->super.n * k);
+    pre->dir = ALLOC(FLOAT, pre->super.n * k);
+    pre->wk = k;
+}
+
+// res = D^-1 (r - w), with w = NULL meaning zero
+static void poly_residual(struct precond_poly *pre, int k, FLOAT *r, FLOAT *w, FLOAT *res)
+{
+    for (int i = 0; i < pre->super.n; i++)
+        for (int c = 0; c < k; c++)
+            res[i * k + c] = (w ? r[i * k + c] - w[i * k + c] : r[i * k + c]) * pre->dinv[i];
+}
+
+void poly_smmult(struct precond_poly *pre, int k, FLOAT *x, FLOAT *y)
+{
+    int nk = pre->super.n * k;
+    poly_work(pre, k);
+
+    if (pre->kind == POLY_NEUMANN) {
+        FLOAT omega = 1.0 / pre->lmax;
+        poly_residual(pre, k, x, NULL, pre->res);
+        for (int i = 0; i < nk; i++) y[i] = omega * pre->res[i];
+        for (int m = 1; m < pre->degree; m++) {
+            floatm_mmult(pre->A, k, y, pre->w);
+            poly_residual(pre, k, x, pre->w, pre->res);
+            floatm_axpy(nk, omega, pre->res, y);
+        }
+        return;
+    }
+
+    DOUBLE theta = (pre->lmax + pre->lmin) / 2.0;
+    DOUBLE delta = (pre->lmax - pre->lmin) / 2.0;
+    DOUBLE sigma = theta / delta;
+    DOUBLE rho = 1.0 / sigma;
+
+    poly_residual(pre, k, x, NULL, pre->dir);
+    for (int i = 0; i < nk; i++) {
+        pre->dir[i] /= theta;
+        y[i] = pre->dir[i];
+    }
+    for (int m = 1; m < pre->degree; m++) {
+        floatm_mmult(pre->A, k, y, pre->w);
+        poly_residual(pre, k, x, pre->w, pre->res);
+        DOUBLE rho_new = 1.0 / (2.0 * sigma - rho);
+        FLOAT a = rho_new * rho, b = 2.0 * rho_new / delta;
+        for (int i = 0; i < nk; i++) {
+            pre->dir[i] = a * pre->dir[i] + b * pre->res[i];
+            y[i] += pre->dir[i];
+        }
+        rho = rho_new;
+    }
+}
+
+void poly_smult(struct precond_poly *pre, FLOAT *x, FLOAT *y)
+{
+    poly_smmult(pre, 1, x, y);
+}
+
+struct matrix *poly_create(struct matrix *A, int n, int *ia, int *ja, double *a, int kind, int degree)
+{
+    struct precond_poly *pre = CALLOC(struct precond_poly, 1);
+    pre->super.n = n;
+    pre->super.dmult = NULL;
+    pre->super.smult = (void (*)(struct matrix *, FLOAT *, FLOAT *))poly_smult;
+    pre->super.dmmult = NULL;
+    pre->super.smmult = (void (*)(struct matrix *, int, FLOAT *, FLOAT *))poly_smmult;
+    pre->A = A;
+    pre->kind = kind;
+    pre->degree = degree > 0 ? degree : 1;
+
+    DOUBLE *dinv = ALLOC(DOUBLE, n);
+    vector_set(n, 1.0, dinv);
+    for (int i = 0; i < n; i++)
+        for (int l = ia[i]; l < ia[i + 1]; l++)
+            if (ja[l] == i && a[l] != 0.0)
+                dinv[i] = 1.0 / a[l];
+    pre->dinv = ALLOC(FLOAT, n);
+    for (int i = 0; i < n; i++) pre->dinv[i] = dinv[i];
+
+    // power iteration for the largest eigenvalue of D^-1 A
+    DOUBLE *v = ALLOC(DOUBLE, n);
+    DOUBLE *w = ALLOC(DOUBLE, n);
+    DOUBLE lambda = 1.0;
+    vector_rand(n, v);
+    for (int it = 0; it < 20; it++) {
+        DOUBLE norm = vector_norm2(n, v);
+        for (int i = 0; i < n; i++) v[i] /= norm;
+        matrix_mult(A, v, w);
+        for (int i = 0; i < n; i++) w[i] *= dinv[i];
+        lambda = vector_dot(n, v, w);
+        vector_copy(n, w, v);
+    }
+    // the estimate is from below, leave some safety margin
+    pre->lmax = 1.1 * lambda;
+    pre->lmin = pre->lmax / POLY_EIG_RATIO;
+
+    free(dinv);
+    free(v);
+    free(w);
+    return (struct matrix *)pre;
+}
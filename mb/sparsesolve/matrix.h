@@ -4,15 +4,29 @@ struct matrix_coo { int i; int j; double a; };
 
 extern void coo_load(const char *fname, int *n, int *nz, struct matrix_coo **coo);
 
-extern double coo_norm_inf(int n, int nz, struct matrix_coo *coo);
-extern double coo_max_nz(int n, int nz, struct matrix_coo *coo);
+// parallel loader going straight to CSR, and the same with a binary CSR cache
+// in <fname>.csr. Symmetric and general matrices are accepted, symmetric ones
+// are expanded to both triangles. Row i holds the entries ia[i] to
+// ia[i + 1] - 1, sorted by column; the matrix constructors below take them
+// as they are.
+extern void csr_load(const char *fname, int *n, int *nz, int **ia, int **ja, double **a, int *symmetric);
+extern void csr_load_cached(const char *fname, int use_cache, int *n, int *nz, int **ia, int **ja, double **a, int *symmetric);
+
+extern double csr_norm_inf(int n, int *ia, double *a);
+extern double csr_max_nz(int n, int *ia);
 
 struct matrix {
     int n;
     void (*dmult)(struct matrix *, DOUBLE *, DOUBLE *);
     void (*smult)(struct matrix *, FLOAT *, FLOAT *);
+    // block versions: x and y hold k vectors as an n x k row major block
+    void (*dmmult)(struct matrix *, int, DOUBLE *, DOUBLE *);
+    void (*smmult)(struct matrix *, int, FLOAT *, FLOAT *);
 };
 
+// inner solvers used by iterative_refinement
+typedef void (*inner_solver)(int n, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter);
+
 static inline void matrix_mult(struct matrix *mat, DOUBLE *x, DOUBLE *y) {
     mat->dmult(mat, x, y);
 }
@@ -21,8 +35,31 @@ static inline void floatm_mult(struct matrix *mat, FLOAT *x, FLOAT *y) {
     mat->smult(mat, x, y);
 }
 
-extern struct matrix *csr_create(int n, int nz, struct matrix_coo *coo);
+static inline void matrix_mmult(struct matrix *mat, int k, DOUBLE *x, DOUBLE *y) {
+    mat->dmmult(mat, k, x, y);
+}
+
+static inline void floatm_mmult(struct matrix *mat, int k, FLOAT *x, FLOAT *y) {
+    mat->smmult(mat, k, x, y);
+}
+
+extern struct matrix *csr_create(int n, int *ia, int *ja, double *a);
+
+extern struct matrix *dense_create(int n, int *ia, int *ja, double *a);
+
+extern struct matrix *jacobi_create(int n, int *ia, int *ja, double *a);
+
+extern struct matrix *ic0_create(int n, int *ia, int *ja, double *a);
+extern int ic0_levels(struct matrix *M);
+
+// polynomial preconditioner kinds, the Chebyshev variant targets the
+// interval [lmax / POLY_EIG_RATIO, lmax] of the spectrum of D^-1 A
+
+#define POLY_CHEBYSHEV 0
+#define POLY_NEUMANN 1
 
-extern struct matrix *dense_create(int n, int nz, struct matrix_coo *coo);
+#ifndef POLY_EIG_RATIO
+#define POLY_EIG_RATIO 30.0
+#endif
 
-extern struct matrix *jacobi_create(int n, int nz, struct matrix_coo *coo);
+extern struct matrix *poly_create(struct matrix *A, int n, int *ia, int *ja, double *a, int kind, int degree);
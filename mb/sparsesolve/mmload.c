@@ -0,0 +1,339 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "mmio.h"
+#include <tgmath.h> // interferes with mmio.h
+
+#include "cg.h"
+#include "matrix.h"
+
+// Fast Matrix Market loader. The coordinate section is read in one go, split
+// into one chunk of lines per thread and parsed in parallel. The entries are
+// then placed into CSR with a counting sort by row, every thread counting its
+// own entries, so there is no global sort and no atomics. The CSR arrays are cached next to the matrix file in a binary file
+// that is only reused while the size and mtime of the source match.
+
+#define CSR_CACHE_MAGIC 0x52534353 // "SCSR"
+
+struct csr_cache_header { uint32_t magic; uint32_t version; int64_t size; int64_t mtime_sec; int64_t mtime_nsec; int32_t n; int32_t nz; int32_t symmetric; };
+
+static int csr_cache_read(const char *cname, struct stat *st, int *n, int *nz, int **ia, int **ja, double **a, int *symmetric)
+{
+    FILE *f = fopen(cname, "rb");
+    if (f == NULL) return -1;
+    struct csr_cache_header h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != CSR_CACHE_MAGIC || h.version != 2 ||
+        h.size != (int64_t)st->st_size || h.mtime_sec != (int64_t)st->st_mtim.tv_sec ||
+        h.mtime_nsec != (int64_t)st->st_mtim.tv_nsec) {
+        fclose(f);
+        return -1;
+    }
+    *ia = ALLOC(int, h.n + 1);
+    *ja = ALLOC(int, h.nz);
+    *a = ALLOC(double, h.nz);
+    if (fread(*ia, sizeof(int), h.n + 1, f) != (size_t)h.n + 1 ||
+        fread(*ja, sizeof(int), h.nz, f) != (size_t)h.nz ||
+        fread(*a, sizeof(double), h.nz, f) != (size_t)h.nz) {
+        free(*ia);
+        free(*ja);
+        free(*a);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    *n = h.n;
+    *nz = h.nz;
+    *symmetric = h.symmetric;
+    return 0;
+}
+
+static void csr_cache_write(const char *cname, struct stat *st, int n, int nz, int *ia, int *ja, double *a, int symmetric)
+{
+    // write to a temporary file and rename, so that concurrent runs never
+    // see a partial cache
+    char tname[strlen(cname) + 16];
+    sprintf(tname, "%s.%d", cname, (int)getpid());
+    FILE *f = fopen(tname, "wb");
+    if (f == NULL) return; // e.g. read-only data directory, just skip the cache
+    struct csr_cache_header h = { CSR_CACHE_MAGIC, 2, st->st_size, st->st_mtim.tv_sec, st->st_mtim.tv_nsec, n, nz, symmetric };
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(ia, sizeof(int), n + 1, f) == (size_t)n + 1 &&
+             fwrite(ja, sizeof(int), nz, f) == (size_t)nz &&
+             fwrite(a, sizeof(double), nz, f) == (size_t)nz;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tname, cname) != 0) remove(tname);
+}
+
+static inline const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+// NULL if there is no digit at p
+static inline const char *parse_int(const char *p, const char *end, int *v)
+{
+    const char *q = p;
+    int r = 0;
+    while (p < end && *p >= '0' && *p <= '9') r = r * 10 + (*p++ - '0');
+    *v = r;
+    return p == q ? NULL : p;
+}
+
+// number of entry lines in [p, end), ignoring blank and comment lines
+static int count_entries(const char *p, const char *end)
+{
+    int count = 0;
+    while (p < end) {
+        p = skip_space(p, end);
+        if (p < end && *p != '\n' && *p != '%') count++;
+        const char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    return count;
+}
+
+// one entry per line, every field has to be on it
+static int parse_entries(const char *p, const char *end, int pattern, int *ti, int *tj, double *ta)
+{
+    int k = 0;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *eol = nl ? nl : end;
+        p = skip_space(p, eol);
+        if (p < eol && *p != '%') {
+            if ((p = parse_int(p, eol, &ti[k])) == NULL) return -1;
+            p = skip_space(p, eol);
+            if ((p = parse_int(p, eol, &tj[k])) == NULL) return -1;
+            if (pattern) ta[k] = 1.0;
+            else {
+                // strtod would skip the end of line, look for the field first
+                p = skip_space(p, eol);
+                if (p == eol) return -1;
+                char *e;
+                ta[k] = strtod(p, &e);
+                if (e == p || e > eol) return -1;
+                p = e;
+            }
+            if (skip_space(p, eol) != eol) return -1;
+            ti[k]--;
+            tj[k]--;
+            k++;
+        }
+        p = nl ? nl + 1 : end;
+    }
+    return 0;
+}
+
+struct csr_entry { int j; double v; };
+
+static int entry_cmp(const void *x, const void *y)
+{
+    int i = ((const struct csr_entry *)x)->j, j = ((const struct csr_entry *)y)->j;
+    return (i > j) - (i < j);
+}
+
+#define SORT_SHORT 32 // longest row sorted in place by insertion
+
+static void sort_row(int len, int *ja, double *a)
+{
+    if (len > SORT_SHORT) {
+        struct csr_entry *e = ALLOC(struct csr_entry, len);
+        for (int l = 0; l < len; l++) {
+            e[l].j = ja[l];
+            e[l].v = a[l];
+        }
+        qsort(e, len, sizeof(*e), entry_cmp);
+        for (int l = 0; l < len; l++) {
+            ja[l] = e[l].j;
+            a[l] = e[l].v;
+        }
+        free(e);
+        return;
+    }
+    for (int l = 1; l < len; l++) {
+        int j = ja[l];
+        double v = a[l];
+        int m = l - 1;
+        for (; m >= 0 && ja[m] > j; m--) {
+            ja[m + 1] = ja[m];
+            a[m + 1] = a[m];
+        }
+        ja[m + 1] = j;
+        a[m + 1] = v;
+    }
+}
+
+void csr_load(const char *fname, int *n, int *nz, int **ia, int **ja, double **a, int *symmetric)
+{
+    FILE *f;
+    if ((f = fopen(fname, "r")) == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", fname);
+        exit(1);
+    }
+    MM_typecode matcode;
+    if (mm_read_banner(f, &matcode) != 0) {
+        fprintf(stderr, "Could not process Matrix Market banner\n");
+        exit(1);
+    }
+    if (!mm_is_matrix(matcode) || !mm_is_sparse(matcode) || mm_is_complex(matcode) ||
+        !(mm_is_symmetric(matcode) || mm_is_general(matcode))) {
+        fprintf(stderr, "This application does not support the Market Market type: %s\n",
+                mm_typecode_to_str(matcode));
+        exit(1);
+    }
+    int M, N, NZ;
+    if (mm_read_mtx_crd_size(f, &M, &N, &NZ) != 0) {
+        fprintf(stderr, "Could not parse matrix size\n");
+        exit(1);
+    }
+    if (M != N) {
+        fprintf(stderr, "Matrix is not square\n");
+        exit(1);
+    }
+
+    // slurp the coordinate section
+    long start = ftell(f);
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f) - start;
+    fseek(f, start, SEEK_SET);
+    char *buf = ALLOC(char, len + 1);
+    if (fread(buf, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "Error reading file: %s\n", fname);
+        exit(1);
+    }
+    buf[len] = '\0';
+    fclose(f);
+
+    int nthreads = omp_get_max_threads();
+    const char *chunk[nthreads + 1];
+    int offset[nthreads + 1];
+    chunk[0] = buf;
+    chunk[nthreads] = buf + len;
+    for (int t = 1; t < nthreads; t++) {
+        const char *p = buf + len / nthreads * t;
+        if (p < chunk[t - 1]) p = chunk[t - 1];
+        const char *nl = memchr(p, '\n', buf + len - p);
+        chunk[t] = nl ? nl + 1 : buf + len;
+    }
+
+    int *ti = ALLOC(int, NZ);
+    int *tj = ALLOC(int, NZ);
+    double *ta = ALLOC(double, NZ);
+    int error = 0;
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int t = omp_get_thread_num();
+        offset[t + 1] = count_entries(chunk[t], chunk[t + 1]);
+        #pragma omp barrier
+        #pragma omp single
+        {
+            offset[0] = 0;
+            for (int q = 0; q < nthreads; q++) offset[q + 1] += offset[q];
+            if (offset[nthreads] != NZ) error = 1;
+        }
+        if (!error && parse_entries(chunk[t], chunk[t + 1], mm_is_pattern(matcode),
+                                    ti + offset[t], tj + offset[t], ta + offset[t]) != 0) {
+            #pragma omp atomic write
+            error = 1;
+        }
+    }
+    free(buf);
+    if (error) {
+        fprintf(stderr, "Error parsing matrix entries, expected %d\n", NZ);
+        exit(1);
+    }
+
+    // counting sort by row, off-diagonal entries of symmetric matrices are
+    // mirrored. Every thread counts the entries of its static share of k per
+    // row, the same share then goes to positions handed out in thread order.
+    int sym = mm_is_symmetric(matcode);
+    int *count = CALLOC(int, (size_t)nthreads * N);
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int *c = count + (size_t)omp_get_thread_num() * N;
+        #pragma omp for schedule(static)
+        for (int k = 0; k < NZ; k++) {
+            if (ti[k] < 0 || ti[k] >= N || tj[k] < 0 || tj[k] >= N) {
+                #pragma omp atomic write
+                error = 1;
+                continue;
+            }
+            c[ti[k]]++;
+            if (sym && ti[k] != tj[k]) c[tj[k]]++;
+        }
+    }
+    if (error) {
+        fprintf(stderr, "Matrix entry out of range\n");
+        exit(1);
+    }
+    int *rowptr = ALLOC(int, N + 1);
+    rowptr[0] = 0;
+    #pragma omp parallel for
+    for (int i = 0; i < N; i++) {
+        int len = 0;
+        for (int t = 0; t < nthreads; t++) len += count[(size_t)t * N + i];
+        rowptr[i + 1] = len;
+    }
+    for (int i = 0; i < N; i++) rowptr[i + 1] += rowptr[i];
+    int total = rowptr[N];
+    #pragma omp parallel for
+    for (int i = 0; i < N; i++) {
+        int l = rowptr[i];
+        for (int t = 0; t < nthreads; t++) {
+            int len = count[(size_t)t * N + i];
+            count[(size_t)t * N + i] = l;
+            l += len;
+        }
+    }
+
+    int *col = ALLOC(int, total);
+    double *val = ALLOC(double, total);
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int *fill = count + (size_t)omp_get_thread_num() * N;
+        #pragma omp for schedule(static)
+        for (int k = 0; k < NZ; k++) {
+            int l = fill[ti[k]]++;
+            col[l] = tj[k];
+            val[l] = ta[k];
+            if (sym && ti[k] != tj[k]) {
+                l = fill[tj[k]]++;
+                col[l] = ti[k];
+                val[l] = ta[k];
+            }
+        }
+    }
+    free(count);
+    free(ti);
+    free(tj);
+    free(ta);
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (int i = 0; i < N; i++)
+        sort_row(rowptr[i + 1] - rowptr[i], col + rowptr[i], val + rowptr[i]);
+
+    *n = N; *nz = total; *ia = rowptr; *ja = col; *a = val; *symmetric = sym;
+}
+
+void csr_load_cached(const char *fname, int use_cache, int *n, int *nz, int **ia, int **ja, double **a, int *symmetric)
+{
+    struct stat st;
+    char cname[strlen(fname) + 8];
+    sprintf(cname, "%s.csr", fname);
+    if (stat(fname, &st) != 0) {
+        fprintf(stderr, "Error opening file: %s\n", fname);
+        exit(1);
+    }
+    if (!use_cache || csr_cache_read(cname, &st, n, nz, ia, ja, a, symmetric) != 0) {
+        csr_load(fname, n, nz, ia, ja, a, symmetric);
+        if (use_cache) csr_cache_write(cname, &st, *n, *nz, *ia, *ja, *a, *symmetric);
+    }
+}
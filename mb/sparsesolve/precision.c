@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <tgmath.h>
+#include <float.h>
+#include <stdbool.h>
+
+#include "cg.h"
+#include "vector.h"
+#include "matrix.h"
+#include "precision.h"
+
+const char *precision_name[PREC_LEVELS] = { "bfloat16", "half", "float", "double" };
+
+// unit roundoff of each level
+const double precision_eps[PREC_LEVELS] = { 0x1p-8, 0x1p-11, 0x1p-24, 0x1p-53 };
+
+// kernel set, one conjugate gradient per precision
+
+#define REAL FLOAT
+#define ACC FLOAT2
+#define MULT(A, x, y) floatm_mult(A, x, y)
+#define PRECOND(M, x, y, w) floatm_mult(M, x, y)
+#define PRECOND_WORK 0
+
+#define SUFFIX bfloat16
+#define ROUND(x) round_bfloat16(x)
+#include "cg_prec.h"
+#undef SUFFIX
+#undef ROUND
+
+#define SUFFIX half
+#define ROUND(x) round_half(x)
+#include "cg_prec.h"
+#undef SUFFIX
+#undef ROUND
+
+#define SUFFIX float
+#define ROUND(x) ((float)(x))
+#include "cg_prec.h"
+#undef SUFFIX
+#undef ROUND
+
+#undef REAL
+#undef ACC
+#undef MULT
+#undef PRECOND
+#undef PRECOND_WORK
+
+// the double level uses the double product of A, preconditioners without
+// one are applied in FLOAT through the 2 n entries of w
+
+static void precond_double(struct matrix *M, DOUBLE *x, DOUBLE *y, FLOAT *w)
+{
+    if (M->dmult) {
+        M->dmult(M, x, y);
+        return;
+    }
+    FLOAT *t = w;
+    FLOAT *s = w + M->n;
+    mixed_copy(M->n, x, t);
+    floatm_mult(M, t, s);
+    for (int i = 0; i < M->n; i++) y[i] = s[i];
+}
+
+#define REAL DOUBLE
+#define ACC DOUBLE
+#define MULT(A, x, y) matrix_mult(A, x, y)
+#define PRECOND(M, x, y, w) precond_double(M, x, y, w)
+#define PRECOND_WORK 2
+#define SUFFIX double
+#define ROUND(x) (x)
+#include "cg_prec.h"
+#undef SUFFIX
+#undef ROUND
+#undef REAL
+#undef ACC
+#undef MULT
+#undef PRECOND
+#undef PRECOND_WORK
+
+// Iterative refinement with the inner precision chosen at runtime. Every
+// inner solve works on the residual scaled to unit norm, so that it stays in
+// the range of the 16 bit formats, and is stopped at the relative tolerance
+// in_tol / |r| but not below what the level can resolve. In adaptive mode the
+// inner precision is promoted by one level whenever an outer step reduces the
+// residual by less than min_reduction. level_iter counts the outer
+// iterations spent at each level.
+
+void precision_refinement(int n, struct matrix *A, struct matrix *M, DOUBLE *b, DOUBLE *x,
+        int level, bool adaptive, DOUBLE min_reduction,
+        int out_maxiter, DOUBLE out_tol, int in_maxiter, DOUBLE in_tol, int step_check,
+        int *out_iter, int *in_iter, int *level_iter)
+{
+    DOUBLE *e = ALLOC(DOUBLE, n);
+    FLOAT *rs = ALLOC(FLOAT, n);
+    FLOAT *ds = ALLOC(FLOAT, n);
+    DOUBLE *rd = ALLOC(DOUBLE, n);
+    DOUBLE *dd = ALLOC(DOUBLE, n);
+
+    matrix_mult(A, x, e);
+    vector_xpby(n, b, -1.0, e); // r = b - Ax
+    DOUBLE residual = vector_norm2(n, e);
+
+    while ((residual > out_tol) && (*out_iter < out_maxiter)) {
+        DOUBLE scale = residual;
+        DOUBLE umbral = in_tol / scale;
+        if (umbral < 10 * precision_eps[level]) umbral = 10 * precision_eps[level];
+
+        if (level == PREC_DOUBLE) {
+            for (int i = 0; i < n; i++) rd[i] = e[i] / scale;
+            vector_set(n, 0.0, dd);
+            conjugate_gradient_double(n, A, M, rd, dd, in_maxiter, umbral, step_check, in_iter);
+            vector_axpy(n, scale, dd, x);
+        } else {
+            for (int i = 0; i < n; i++) rs[i] = e[i] / scale;
+            floatm_set(n, 0.0, ds);
+            switch (level) {
+                case PREC_BFLOAT16:
+                    for (int i = 0; i < n; i++) rs[i] = round_bfloat16(rs[i]);
+                    conjugate_gradient_bfloat16(n, A, M, rs, ds, in_maxiter, umbral, step_check, in_iter);
+                    break;
+                case PREC_HALF:
+                    for (int i = 0; i < n; i++) rs[i] = round_half(rs[i]);
+                    conjugate_gradient_half(n, A, M, rs, ds, in_maxiter, umbral, step_check, in_iter);
+                    break;
+                default:
+                    conjugate_gradient_float(n, A, M, rs, ds, in_maxiter, umbral, step_check, in_iter);
+            }
+            mixed_axpy(n, scale, ds, x);
+        }
+
+        matrix_mult(A, x, e);
+        vector_xpby(n, b, -1.0, e);
+        DOUBLE next = vector_norm2(n, e);
+
+        printf("# precision: %d %s %e\n", *out_iter, precision_name[level], (double)next);
+        level_iter[level]++;
+        (*out_iter)++;
+
+        if (adaptive && level < PREC_DOUBLE && residual / next < min_reduction) level++;
+        residual = next;
+    }
+
+    FREE(e);
+    FREE(rs);
+    FREE(ds);
+    FREE(rd);
+    FREE(dd);
+}
@@ -0,0 +1,35 @@
+// runtime selectable precision of the inner solver, from the cheapest to the
+// most accurate. The 16 bit formats are emulated: vectors are kept in FLOAT
+// and every stored value is rounded (to nearest even) to the format.
+
+enum precision { PREC_BFLOAT16, PREC_HALF, PREC_FLOAT, PREC_DOUBLE, PREC_LEVELS };
+
+extern const char *precision_name[PREC_LEVELS];
+extern const double precision_eps[PREC_LEVELS];
+
+static inline float round_bfloat16(float x) {
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    if ((u & 0x7f800000) != 0x7f800000) u += 0x7fff + ((u >> 16) & 1);
+    u &= 0xffff0000;
+    memcpy(&x, &u, sizeof(u));
+    return x;
+}
+
+static inline float round_half(float x) {
+    float a = fabsf(x);
+    if (a != a) return x;
+    if (a >= 65520.0f) return copysignf(INFINITY, x);
+    if (a < 6.103515625e-05f) return rintf(x * 16777216.0f) / 16777216.0f; // subnormals, 2^-24 steps
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    u += 0xfff + ((u >> 13) & 1);
+    u &= 0xffffe000;
+    memcpy(&x, &u, sizeof(u));
+    return x;
+}
+
+extern void precision_refinement(int n, struct matrix *A, struct matrix *M, DOUBLE *b, DOUBLE *x,
+        int level, bool adaptive, DOUBLE min_reduction,
+        int out_maxiter, DOUBLE out_tol, int in_maxiter, DOUBLE in_tol, int step_check,
+        int *out_iter, int *in_iter, int *level_iter);
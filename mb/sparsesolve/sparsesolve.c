@@ -5,44 +5,131 @@
 #include <float.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <omp.h>
 
 #include "cg.h"
 #include "vector.h"
 #include "matrix.h"
+#include "precision.h"
 #include "oprecomp.h"
 
 // #define USE_DENSE
 #define USE_PRECOND
 
-void iterative_refinement(int n, struct matrix *A, struct matrix *M, DOUBLE *b, DOUBLE *x,
+#ifdef USE_PRECOND
+#define DEFAULT_PRECOND "jacobi"
+#else
+#define DEFAULT_PRECOND "none"
+#endif
+
+void conjugate_gradient(int n, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter);
+void gmres(int n, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter);
+void bicgstab(int n, struct matrix *A, struct matrix *M, FLOAT *b, FLOAT *x, int maxiter, FLOAT umbral, int step_check, int *in_iter);
+extern int gmres_restart;
+
+void iterative_refinement(inner_solver solve, int n, struct matrix *A, struct matrix *M, DOUBLE *b, DOUBLE *x,
         int out_maxiter, DOUBLE out_tol, int in_maxiter, DOUBLE in_tol, int step_check,
         int *out_iter, int *in_iter);
 
+void block_iterative_refinement(int n, int k, struct matrix *A, struct matrix *M, DOUBLE *b, DOUBLE *x,
+        int out_maxiter, DOUBLE out_tol, int in_maxiter, DOUBLE in_tol, int step_check,
+        int *out_iter, int *in_iter);
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-s solver] [-m restart] [-P precision] [-R reduction] [-k nrhs] [-p precond] [-d degree] [-C] matrix_file out_its out_tol in_its in_tol step_chk\n", argv0);
+    fprintf(stderr, "       -s solver : inner solver, cg, gmres or bicgstab (default cg)\n");
+    fprintf(stderr, "       -m restart: restart length of gmres (default %d)\n", gmres_restart);
+    fprintf(stderr, "       -P prec   : inner cg precision chosen at runtime, bfloat16, half, float, double\n");
+    fprintf(stderr, "                   or adaptive (start at bfloat16 and promote when refinement stalls)\n");
+    fprintf(stderr, "       -R reduct : minimum residual reduction per outer step before promotion (default 10)\n");
+    fprintf(stderr, "       -k nrhs   : number of right-hand sides solved as one block (default 1)\n");
+    fprintf(stderr, "       -p precond: none, jacobi, ic0, cheb or neumann (default %s)\n", DEFAULT_PRECOND);
+    fprintf(stderr, "       -d degree : degree of the cheb and neumann polynomials (default 4)\n");
+    fprintf(stderr, "       -C        : do not use the binary matrix cache <matrix_file>.csr\n");
+    exit(1);
+}
+
 int main (int argc, char *argv[])
 {
-    if (argc != 7) {
-        fprintf(stderr, "Missing arguments: algorithm matrix_file out_its out_tol in_its in_tol step_chk\n");
+    int opt;
+    int nrhs = 1;
+    const char *precond = DEFAULT_PRECOND;
+    int degree = 4;
+    int use_cache = 1;
+    const char *solver = "cg";
+    const char *prec = NULL;
+    DOUBLE min_reduction = 10.0;
+    while ((opt = getopt(argc, argv, "s:m:P:R:k:p:d:C")) != -1) {
+        switch (opt) {
+            case 'P': prec = optarg; break;
+            case 'R': min_reduction = atof(optarg); break;
+            case 's': solver = optarg; break;
+            case 'm': gmres_restart = atoi(optarg); break;
+            case 'k': nrhs = atoi(optarg); break;
+            case 'p': precond = optarg; break;
+            case 'd': degree = atoi(optarg); break;
+            case 'C': use_cache = 0; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 6 || nrhs < 1 || gmres_restart < 1) usage(argv[0]);
+    inner_solver solve = NULL;
+    if (!strcmp(solver, "cg")) solve = conjugate_gradient;
+    else if (!strcmp(solver, "gmres")) solve = gmres;
+    else if (!strcmp(solver, "bicgstab")) solve = bicgstab;
+    else usage(argv[0]);
+    if (nrhs > 1 && solve != conjugate_gradient) {
+        fprintf(stderr, "Multiple right-hand sides are only supported with cg\n");
+        return 1;
+    }
+    int level = -1;
+    bool adaptive = false;
+    if (prec) {
+        if (!strcmp(prec, "adaptive")) {
+            level = PREC_BFLOAT16;
+            adaptive = true;
+        }
+        for (int l = 0; l < PREC_LEVELS; l++)
+            if (!strcmp(prec, precision_name[l])) level = l;
+        if (level < 0) usage(argv[0]);
+        if (nrhs > 1 || solve != conjugate_gradient) {
+            fprintf(stderr, "Runtime precision is only supported with cg and a single right-hand side\n");
+            return 1;
+        }
+    }
+    if (strcmp(precond, "none") && strcmp(precond, "jacobi") && strcmp(precond, "ic0") &&
+        strcmp(precond, "cheb") && strcmp(precond, "neumann")) usage(argv[0]);
+    argv += optind - 1;
+
+    int n, nz, symmetric;
+    int *ia, *ja;
+    double *a;
+    double load_time = omp_get_wtime();
+    csr_load_cached(argv[1], use_cache, &n, &nz, &ia, &ja, &a, &symmetric);
+    load_time = omp_get_wtime() - load_time;
+    if (!symmetric && (solve == conjugate_gradient || !strcmp(precond, "ic0"))) {
+        fprintf(stderr, "Matrix is not symmetric, use -s gmres or -s bicgstab and no ic0 preconditioner\n");
         return 1;
     }
-
-    int n, nz;
-    struct matrix_coo *coo;
-    coo_load(argv[1], &n, &nz, &coo);
 
 #ifdef USE_DENSE
-    struct matrix *A = dense_create(n, nz, coo);
+    struct matrix *A = dense_create(n, ia, ja, a);
 #else
-    struct matrix *A = csr_create(n, nz, coo);
+    struct matrix *A = csr_create(n, ia, ja, a);
 #endif
 
-    DOUBLE *x = ALLOC(DOUBLE, n);
-    DOUBLE *b = ALLOC(DOUBLE, n);
-    DOUBLE *r = ALLOC(DOUBLE, n);
-    DOUBLE *s = ALLOC(DOUBLE, n);
+    // with several right-hand sides, x and b are n x nrhs row major blocks
+    DOUBLE *x = ALLOC(DOUBLE, n * nrhs);
+    DOUBLE *b = ALLOC(DOUBLE, n * nrhs);
+    DOUBLE *r = ALLOC(DOUBLE, n * nrhs);
+    DOUBLE *s = ALLOC(DOUBLE, n * nrhs);
 
-    vector_rand(n, s);
+    vector_rand(n * nrhs, s);
     // vector_set(n, 1.0 / sqrt(n), s);
-    matrix_mult(A, s, b);
+    if (nrhs == 1) matrix_mult(A, s, b);
+    else matrix_mmult(A, nrhs, s, b);
 
     int out_maxiter = atoi(argv[2]);
     DOUBLE out_tol = atof(argv[3]);
@@ -55,19 +142,21 @@ int main (int argc, char *argv[])
 
     DOUBLE max = 0;
     for (int i = 0; i < nz; i++) {
-        DOUBLE x1 = coo[i].a;
+        DOUBLE x1 = a[i];
         DOUBLE x2 = x1;
         DOUBLE error = (x1 - x2) / x1;
         if (error > max) max = error;
     }
 
-#ifdef USE_PRECOND
-    struct matrix *M = jacobi_create(n, nz, coo);
-#else
     struct matrix *M = NULL;
-#endif
-    DOUBLE norm = coo_norm_inf(n, nz, coo);
-    free(coo);
+    if (!strcmp(precond, "jacobi")) M = jacobi_create(n, ia, ja, a);
+    else if (!strcmp(precond, "ic0")) M = ic0_create(n, ia, ja, a);
+    else if (!strcmp(precond, "cheb")) M = poly_create(A, n, ia, ja, a, POLY_CHEBYSHEV, degree);
+    else if (!strcmp(precond, "neumann")) M = poly_create(A, n, ia, ja, a, POLY_NEUMANN, degree);
+    DOUBLE norm = csr_norm_inf(n, ia, a);
+    free(ia);
+    free(ja);
+    free(a);
 
     printf("# algorithm: %s\n", argv[1]);
     printf("# sizeof FLOAT: %lu\n", sizeof(FLOAT));
@@ -75,27 +164,51 @@ int main (int argc, char *argv[])
     printf("# matrix: %s\n", argv[2]);
     printf("# problem_size: %d\n", n);
     printf("# nnz: %d\n", nz);
+    printf("# load_time: %f\n", load_time);
     printf("# matrix_norm: %e\n", (double)norm);
     printf("# matrix_error: %e\n", (double)max);
-    printf("# bnorm: %e\n", (double)vector_norm2(n, b));
+    printf("# solver: %s\n", solver);
+    if (solve == gmres) printf("# restart: %d\n", gmres_restart);
+    if (prec) printf("# inner_precision: %s\n", prec);
+    printf("# rhs: %d\n", nrhs);
+    printf("# preconditioner: %s\n", precond);
+    if (!strcmp(precond, "ic0")) printf("# precond_levels: %d\n", ic0_levels(M));
+    if (!strcmp(precond, "cheb") || !strcmp(precond, "neumann")) printf("# precond_degree: %d\n", degree);
+    printf("# bnorm: %e\n", (double)vector_norm2(n * nrhs, b));
 
-    vector_rand(n, x);
+    vector_rand(n * nrhs, x);
 
     int out_iter = 0, in_iter = 0;
+    int level_iter[PREC_LEVELS] = { 0 };
 
     oprecomp_start();
     do {
 
-        iterative_refinement(n, A, M, b, x, out_maxiter, out_tol, in_maxiter, in_tol, step_check,
-                             &out_iter, &in_iter);
+        if (prec)
+            precision_refinement(n, A, M, b, x, level, adaptive, min_reduction, out_maxiter, out_tol,
+                                 in_maxiter, in_tol, step_check, &out_iter, &in_iter, level_iter);
+        else if (nrhs == 1)
+            iterative_refinement(solve, n, A, M, b, x, out_maxiter, out_tol, in_maxiter, in_tol, step_check,
+                                 &out_iter, &in_iter);
+        else
+            block_iterative_refinement(n, nrhs, A, M, b, x, out_maxiter, out_tol, in_maxiter, in_tol, step_check,
+                                       &out_iter, &in_iter);
 
     } while (oprecomp_iterate());
     oprecomp_stop();
 
-    matrix_mult(A, x, r);
-    vector_xpby(n, b, -1.0, r);
-    DOUBLE residual = vector_norm2(n, r);
-    DOUBLE normalized_residual = residual / (vector_norm2(n, x) * norm);
+    // report the worst column
+    DOUBLE residual = 0.0, normalized_residual = 0.0;
+    DOUBLE *rnorm = ALLOC(DOUBLE, nrhs);
+    DOUBLE *xnorm = ALLOC(DOUBLE, nrhs);
+    matrix_mmult(A, nrhs, x, r);
+    vector_xpby(n * nrhs, b, -1.0, r);
+    vector_block_norm2(n, nrhs, r, rnorm);
+    vector_block_norm2(n, nrhs, x, xnorm);
+    for (int c = 0; c < nrhs; c++) {
+        if (rnorm[c] > residual) residual = rnorm[c];
+        if (rnorm[c] / (xnorm[c] * norm) > normalized_residual) normalized_residual = rnorm[c] / (xnorm[c] * norm);
+    }
 
     printf("# outer_maxiter: %d\n", out_maxiter);
     printf("# outer_tolerance: %e\n", (double)out_tol);
@@ -103,6 +216,9 @@ int main (int argc, char *argv[])
     printf("# inner_tolerance: %e\n", (double)in_tol);
     printf("# outer_iterations: %d\n", out_iter);
     printf("# inner_iterations: %d\n", in_iter);
+    if (prec)
+        for (int l = 0; l < PREC_LEVELS; l++)
+            printf("# outer_iterations_%s: %d\n", precision_name[l], level_iter[l]);
     printf("# residual: %e\n", (double)residual);
     printf("# normalized_residual: %e\n", (double)normalized_residual);
 }
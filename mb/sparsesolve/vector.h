@@ -30,6 +30,17 @@ static inline DOUBLE vector_norm2(int n, DOUBLE *x) {
     return sqrt(vector_dot(n, x, x));
 }
 
+// block versions over k vectors stored as an n x k row major block,
+// producing one result per column
+
+static inline void vector_block_norm2(int n, int k, DOUBLE *x, DOUBLE *r) {
+    DOUBLE t[k];
+    for (int c = 0; c < k; c++) t[c] = 0.0;
+    for (int i = 0; i < n; i++)
+        for (int c = 0; c < k; c++) t[c] += x[i * k + c] * x[i * k + c];
+    for (int c = 0; c < k; c++) r[c] = sqrt(t[c]);
+}
+
 // limited precision version
 
 static inline void floatm_set(int n, FLOAT a, FLOAT *x) {
@@ -45,6 +56,10 @@ static inline void floatm_copy(int n, FLOAT *x, FLOAT *y) {
     for (int i = 0; i < n; i++) y[i] = x[i];
 }
 
+static inline void floatm_scal(int n, FLOAT a, FLOAT *x) {
+    for (int i = 0; i < n; i++) x[i] = x[i] * a;
+}
+
 static inline void floatm_axpy(int n, FLOAT a, FLOAT *x, FLOAT *y) {
     for (int i = 0; i < n; i++) y[i] = y[i] + x[i] * a;
 }
@@ -75,6 +90,31 @@ static inline FLOAT2 floatm_axpy_dot(int n, FLOAT a, FLOAT *x, FLOAT *y) {
     return r;
 }
 
+// block versions, one scalar per column
+
+static inline void floatm_block_axpy(int n, int k, FLOAT2 *a, FLOAT *x, FLOAT *y) {
+    for (int i = 0; i < n; i++)
+        for (int c = 0; c < k; c++) y[i * k + c] = y[i * k + c] + x[i * k + c] * (FLOAT)a[c];
+}
+
+static inline void floatm_block_xpby(int n, int k, FLOAT *x, FLOAT2 *b, FLOAT *y) {
+    for (int i = 0; i < n; i++)
+        for (int c = 0; c < k; c++) y[i * k + c] = x[i * k + c] + (FLOAT)b[c] * y[i * k + c];
+}
+
+static inline void floatm_block_dot(int n, int k, FLOAT *x, FLOAT *y, FLOAT2 *r) {
+    FLOAT2 t[k];
+    for (int c = 0; c < k; c++) t[c] = 0.0;
+    for (int i = 0; i < n; i++)
+        for (int c = 0; c < k; c++) t[c] += y[i * k + c] * x[i * k + c];
+    for (int c = 0; c < k; c++) r[c] = t[c];
+}
+
+static inline void floatm_block_norm2(int n, int k, FLOAT *x, FLOAT2 *r) {
+    floatm_block_dot(n, k, x, x, r);
+    for (int c = 0; c < k; c++) r[c] = sqrt(r[c]);
+}
+
 static inline FLOAT2 floatm_diff_norm2(int n, FLOAT *x, FLOAT *y) {
     FLOAT2 r = 0.0;
     for (int i = 0; i < n; i++) {